@@ -0,0 +1,265 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * trace-replay benchmark of the eviction policies.
+ * 
+ * every access is a `bkvs_get()`, a miss is followed by a `bkvs_put()` just
+ * like a look-aside cache would do. the trace is either read from a file with
+ * one key per line, or generated: zipfian accesses over a key space mixed
+ * with periodic one-shot scans.
+ * 
+ * usage: bench_cache [-c capacity] [-n accesses] [-k keys] [-s skew]
+ *                    [-p scan_period] [-l scan_len] [-t trace_file]
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bufferkvs.h"
+
+typedef struct _bench_trace {
+    char **keys;
+    bkvs_u32 num;
+} bench_trace;
+
+static bkvs_u64 rand_state = 0x9e3779b97f4a7c15ULL;
+
+static bkvs_u64 rand_next(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+
+    return rand_state;
+}
+
+static double rand_unit(void) {
+    return (rand_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int trace_push(bench_trace *trace, bkvs_u32 *cap, const char *key) {
+    if (trace->num == *cap) {
+        char **keys;
+
+        *cap = *cap != 0 ? *cap * 2 : 1024;
+        keys = (char **)realloc(trace->keys, sizeof(char *) * *cap);
+        if (keys == NULL) {
+            return -1;
+        }
+        trace->keys = keys;
+    }
+    trace->keys[trace->num] = strdup(key);
+    if (trace->keys[trace->num] == NULL) {
+        return -1;
+    }
+    trace->num++;
+
+    return 0;
+}
+
+static int trace_load(bench_trace *trace, const char *path) {
+    char line[1024];
+    bkvs_u32 cap;
+    FILE *file;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    cap = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+        if (trace_push(trace, &cap, line) != 0) {
+            fclose(file);
+
+            return -1;
+        }
+    }
+    fclose(file);
+
+    return 0;
+}
+
+static int trace_generate(bench_trace *trace, bkvs_u32 access_num, bkvs_u32 key_num,
+                          double skew, bkvs_u32 scan_period, bkvs_u32 scan_len) {
+    double *cdf;
+    double sum;
+    bkvs_u32 cap;
+    bkvs_u32 scan_key;
+    char key[64];
+
+    /* cumulative distribution of the zipfian key ranks. */
+    cdf = (double *)malloc(sizeof(double) * key_num);
+    if (cdf == NULL) {
+        return -1;
+    }
+    sum = 0;
+    for (bkvs_u32 i = 0; i < key_num; i++) {
+        sum += 1.0 / pow(i + 1, skew);
+        cdf[i] = sum;
+    }
+
+    cap = 0;
+    scan_key = 0;
+    for (bkvs_u32 i = 0; i < access_num; i++) {
+
+        /* one-shot scan over keys that are never accessed again. */
+        if (scan_period != 0 && i % scan_period == 0) {
+            for (bkvs_u32 j = 0; j < scan_len && i < access_num; j++, i++) {
+                snprintf(key, sizeof(key), "scan:%u", scan_key++);
+                if (trace_push(trace, &cap, key) != 0) {
+                    free(cdf);
+
+                    return -1;
+                }
+            }
+        }
+
+        double target = rand_unit() * sum;
+        bkvs_u32 lo = 0;
+        bkvs_u32 hi = key_num - 1;
+        while (lo < hi) {
+            bkvs_u32 mid = (lo + hi) / 2;
+            if (cdf[mid] < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        snprintf(key, sizeof(key), "key:%u", lo);
+        if (trace_push(trace, &cap, key) != 0) {
+            free(cdf);
+
+            return -1;
+        }
+    }
+    free(cdf);
+
+    return 0;
+}
+
+static int replay(bench_trace *trace, const char *name, bkvs_u32 policy, bkvs_u32 capacity) {
+    bkvs_conf conf;
+    bkvs_ctx *ctx;
+    bkvs_stat stat;
+    bkvs_buff buff;
+    bkvs_u64 hit_num;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = capacity;
+    conf.pair_num_max = capacity;
+    conf.evict_policy = policy;
+    if (bkvs_new(&ctx, &conf) != BKVS_OK) {
+        return -1;
+    }
+
+    hit_num = 0;
+    for (bkvs_u32 i = 0; i < trace->num; i++) {
+        if (bkvs_get(ctx, trace->keys[i], &buff) == BKVS_OK) {
+            hit_num++;
+        } else if (bkvs_put(ctx, trace->keys[i], &i, sizeof(i)) != BKVS_OK) {
+            bkvs_del(ctx);
+
+            return -1;
+        }
+    }
+    bkvs_status(ctx, &stat);
+    bkvs_del(ctx);
+
+    printf("%s,%u,%u,%llu,%u,%.4f\n", name, capacity, trace->num,
+           (unsigned long long)hit_num, stat.evict_num, (double)hit_num / trace->num);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bench_trace trace = {0};
+    const char *path = NULL;
+    bkvs_u32 capacity = 1000;
+    bkvs_u32 access_num = 1000000;
+    bkvs_u32 key_num = 100000;
+    bkvs_u32 scan_period = 50000;
+    bkvs_u32 scan_len = 5000;
+    double skew = 0.9;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-c") == 0) {
+            capacity = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-n") == 0) {
+            access_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            key_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            skew = strtod(argv[i + 1], NULL);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            scan_period = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            scan_len = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            path = argv[i + 1];
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+
+            return 1;
+        }
+    }
+    if (capacity == 0 || key_num == 0) {
+        fprintf(stderr, "capacity and key number must not be zero\n");
+
+        return 1;
+    }
+
+    if (path != NULL) {
+        if (trace_load(&trace, path) != 0) {
+            fprintf(stderr, "failed to load trace: %s\n", path);
+
+            return 1;
+        }
+    } else if (trace_generate(&trace, access_num, key_num, skew, scan_period, scan_len) != 0) {
+        fprintf(stderr, "failed to generate trace\n");
+
+        return 1;
+    }
+
+    printf("policy,capacity,accesses,hits,evictions,hit_ratio\n");
+    if (replay(&trace, "lru", BKVS_EVICT_LRU, capacity) != 0 ||
+        replay(&trace, "tinylfu", BKVS_EVICT_TINYLFU, capacity) != 0) {
+        fprintf(stderr, "replay failed\n");
+
+        return 1;
+    }
+
+    for (bkvs_u32 i = 0; i < trace.num; i++) {
+        free(trace.keys[i]);
+    }
+    free(trace.keys);
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * microbenchmark of the core operations.
+ * 
+ * for each configuration a fresh set is filled with `bkvs_put()`, looked up
+ * with `bkvs_get()` and `bkvs_has()` at the given hit ratio, updated in place,
+ * walked with `bkvs_foreach()` and emptied with `bkvs_drop()`. one CSV line
+ * is printed per operation, keeping the best of the repeated runs.
+ * 
+ * by default each parameter is swept on its own while the others keep their
+ * first value, `-x` runs the full cross product instead. lists are comma
+ * separated.
+ * 
+ * usage: bench_core [-n pair_nums] [-k key_lens] [-v value_sizes]
+ *                   [-h hit_pcts] [-b bucket_nums] [-r repeat] [-x]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bufferkvs.h"
+
+#define BENCH_LIST_MAX      16
+
+enum _bench_op {
+    BENCH_OP_PUT,
+    BENCH_OP_GET,
+    BENCH_OP_HAS,
+    BENCH_OP_UPDATE,
+    BENCH_OP_FOREACH,
+    BENCH_OP_DROP,
+    BENCH_OP_NUM,
+};
+
+static const char *op_names[BENCH_OP_NUM] = {
+    "put", "get", "has", "update", "foreach", "drop",
+};
+
+typedef struct _bench_list {
+    bkvs_u32 vals[BENCH_LIST_MAX];
+    bkvs_u32 num;
+} bench_list;
+
+typedef struct _bench_param {
+    bkvs_u32 pair_num;
+    bkvs_u32 key_len;
+    bkvs_u32 value_size;
+    bkvs_u32 hit_pct;
+    bkvs_u32 bucket_num;
+} bench_param;
+
+static bkvs_u64 rand_state = 0x9e3779b97f4a7c15ULL;
+
+static volatile bkvs_u64 sink;
+
+static bkvs_u64 rand_next(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+
+    return rand_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int parse_list(const char *str, bench_list *list) {
+    char *end;
+
+    list->num = 0;
+    while (*str != '\0') {
+        if (list->num == BENCH_LIST_MAX) {
+            return -1;
+        }
+        list->vals[list->num++] = strtoul(str, &end, 0);
+        if (end == str || (*end != ',' && *end != '\0')) {
+            return -1;
+        }
+        str = *end == ',' ? end + 1 : end;
+    }
+
+    return list->num != 0 ? 0 : -1;
+}
+
+/* keys are unique by their index and padded to the length, misses use another prefix.
+   NULL is returned if the length is too short to keep the keys unique. */
+static char *make_keys(bkvs_u32 num, bkvs_u32 key_len, char prefix) {
+    char *keys;
+
+    keys = (char *)malloc((size_t)num * (key_len + 1));
+    if (keys == NULL) {
+        return NULL;
+    }
+    for (bkvs_u32 i = 0; i < num; i++) {
+        char *key;
+        int len;
+
+        key = keys + (size_t)i * (key_len + 1);
+        memset(key, 'x', key_len);
+        len = snprintf(key, key_len + 1, "%c%u", prefix, i);
+        if (len > (int)key_len) {
+            free(keys);
+
+            return NULL;
+        }
+        if (len < (int)key_len) {
+            key[len] = '_';
+        }
+        key[key_len] = '\0';
+    }
+
+    return keys;
+}
+
+static bkvs_res foreach_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    sink += buff->size + (bkvs_u8)key[0];
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief run every operation once, adding the elapsed seconds to `secs`.
+*/
+static int run_once(const bench_param *param, const char *keys, const char *miss_keys,
+                    const bkvs_u32 *order, const bkvs_u8 *value, double secs[BENCH_OP_NUM]) {
+    bkvs_conf conf;
+    bkvs_ctx *ctx;
+    bkvs_buff buff;
+    size_t stride;
+    double start;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = param->bucket_num;
+    if (bkvs_new(&ctx, &conf) != BKVS_OK) {
+        return -1;
+    }
+    stride = param->key_len + 1;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < param->pair_num; i++) {
+        if (bkvs_put(ctx, keys + order[i] * stride, value, param->value_size) != BKVS_OK) {
+            bkvs_del(ctx);
+
+            return -1;
+        }
+    }
+    secs[BENCH_OP_PUT] = now_sec() - start;
+
+    /* the lookup order mixes hits and misses at the hit ratio. */
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < param->pair_num; i++) {
+        if (i % 100 < param->hit_pct) {
+            if (bkvs_get(ctx, keys + order[i] * stride, &buff) == BKVS_OK) {
+                sink += buff.ptr[0];
+            }
+        } else {
+            bkvs_get(ctx, miss_keys + order[i] * stride, &buff);
+        }
+    }
+    secs[BENCH_OP_GET] = now_sec() - start;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < param->pair_num; i++) {
+        if (i % 100 < param->hit_pct) {
+            sink += bkvs_has(ctx, keys + order[i] * stride);
+        } else {
+            sink += bkvs_has(ctx, miss_keys + order[i] * stride);
+        }
+    }
+    secs[BENCH_OP_HAS] = now_sec() - start;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < param->pair_num; i++) {
+        bkvs_put(ctx, keys + order[param->pair_num - 1 - i] * stride, value, param->value_size);
+    }
+    secs[BENCH_OP_UPDATE] = now_sec() - start;
+
+    start = now_sec();
+    bkvs_foreach(ctx, foreach_cb);
+    secs[BENCH_OP_FOREACH] = now_sec() - start;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < param->pair_num; i++) {
+        bkvs_drop(ctx, keys + order[i] * stride);
+    }
+    secs[BENCH_OP_DROP] = now_sec() - start;
+
+    bkvs_del(ctx);
+
+    return 0;
+}
+
+static int run(const bench_param *param, bkvs_u32 repeat) {
+    double best[BENCH_OP_NUM];
+    double secs[BENCH_OP_NUM];
+    bkvs_u32 *order;
+    bkvs_u8 *value;
+    char *keys;
+    char *miss_keys;
+    int res;
+
+    keys = make_keys(param->pair_num, param->key_len, 'k');
+    miss_keys = make_keys(param->pair_num, param->key_len, 'm');
+    order = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * param->pair_num);
+    value = (bkvs_u8 *)malloc(param->value_size);
+    res = -1;
+    if (keys == NULL || miss_keys == NULL || order == NULL || value == NULL) {
+        goto exit;
+    }
+    memset(value, 0xa5, param->value_size);
+
+    /* shuffle the access order. */
+    for (bkvs_u32 i = 0; i < param->pair_num; i++) {
+        order[i] = i;
+    }
+    for (bkvs_u32 i = param->pair_num - 1; i > 0; i--) {
+        bkvs_u32 j;
+        bkvs_u32 tmp;
+
+        j = rand_next() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (bkvs_u32 r = 0; r < repeat; r++) {
+        if (run_once(param, keys, miss_keys, order, value, secs) != 0) {
+            goto exit;
+        }
+        for (bkvs_u32 i = 0; i < BENCH_OP_NUM; i++) {
+            if (r == 0 || secs[i] < best[i]) {
+                best[i] = secs[i];
+            }
+        }
+    }
+
+    for (bkvs_u32 i = 0; i < BENCH_OP_NUM; i++) {
+        printf("%s,%u,%u,%u,%u,%u,%u,%.1f,%.0f\n", op_names[i], param->pair_num,
+               param->key_len, param->value_size, param->hit_pct, param->bucket_num,
+               param->pair_num, best[i] * 1e9 / param->pair_num, param->pair_num / best[i]);
+    }
+    fflush(stdout);
+    res = 0;
+
+exit:
+    free(keys);
+    free(miss_keys);
+    free(order);
+    free(value);
+
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    bench_list lists[5] = {
+        {{100000, 1000, 10000, 1000000}, 4},
+        {{16, 8, 64, 256}, 4},
+        {{64, 8, 512, 4096}, 4},
+        {{100, 0, 50, 90}, 4},
+        {{131072, 1024, 16384, 1048576}, 4},
+    };
+    const char *opts = "nkvhb";
+    bkvs_u32 idx[5];
+    bkvs_u32 repeat = 3;
+    int cross = 0;
+    int res;
+
+    for (int i = 1; i < argc; i++) {
+        const char *opt;
+
+        if (strcmp(argv[i], "-x") == 0) {
+            cross = 1;
+            continue;
+        }
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' || i + 1 == argc) {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+
+            return 1;
+        }
+        if (argv[i][1] == 'r') {
+            repeat = strtoul(argv[++i], NULL, 0);
+            continue;
+        }
+        opt = strchr(opts, argv[i][1]);
+        if (opt == NULL || parse_list(argv[++i], &lists[opt - opts]) != 0) {
+            fprintf(stderr, "bad option: %s\n", argv[i - 1]);
+
+            return 1;
+        }
+    }
+    for (bkvs_u32 i = 0; i < 5; i++) {
+        for (bkvs_u32 j = 0; j < lists[i].num; j++) {
+            if ((i != 3 && lists[i].vals[j] == 0) || (i == 3 && lists[i].vals[j] > 100)) {
+                fprintf(stderr, "bad value for -%c: %u\n", opts[i], lists[i].vals[j]);
+
+                return 1;
+            }
+        }
+    }
+    if (repeat == 0) {
+        repeat = 1;
+    }
+
+    printf("op,pair_num,key_len,value_size,hit_pct,bucket_num,ops,ns_per_op,ops_per_sec\n");
+    res = 0;
+    memset(idx, 0, sizeof(idx));
+    if (cross) {
+
+        /* count through the lists like an odometer. */
+        while (res == 0) {
+            bench_param param;
+            bkvs_u32 i;
+
+            param.pair_num = lists[0].vals[idx[0]];
+            param.key_len = lists[1].vals[idx[1]];
+            param.value_size = lists[2].vals[idx[2]];
+            param.hit_pct = lists[3].vals[idx[3]];
+            param.bucket_num = lists[4].vals[idx[4]];
+            res = run(&param, repeat);
+            for (i = 0; i < 5 && ++idx[i] == lists[i].num; i++) {
+                idx[i] = 0;
+            }
+            if (i == 5) {
+                break;
+            }
+        }
+    } else {
+
+        /* the first values form the base point, each list is swept from it. */
+        for (bkvs_u32 i = 0; i < 5 && res == 0; i++) {
+            for (bkvs_u32 j = i == 0 ? 0 : 1; j < lists[i].num && res == 0; j++) {
+                bench_param param;
+
+                param.pair_num = lists[0].vals[i == 0 ? j : 0];
+                param.key_len = lists[1].vals[i == 1 ? j : 0];
+                param.value_size = lists[2].vals[i == 2 ? j : 0];
+                param.hit_pct = lists[3].vals[i == 3 ? j : 0];
+                param.bucket_num = lists[4].vals[i == 4 ? j : 0];
+                res = run(&param, repeat);
+            }
+        }
+    }
+    if (res != 0) {
+        fprintf(stderr, "benchmark failed\n");
+
+        return 1;
+    }
+
+    return 0;
+}
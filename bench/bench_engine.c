@@ -0,0 +1,349 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * storage engine benchmark, the hash buckets against the radix tree and the
+ * cuckoo table.
+ * 
+ * each engine is filled with the keys of a shape, then looked up, updated,
+ * scanned by prefix and emptied. the hash engine is run plain and with the
+ * ordered index, its plain prefix scan filters a whole `bkvs_foreach()`, as
+ * does the one of the cuckoo engine. one
+ * CSV line is printed per operation, keeping the best of the repeated runs,
+ * with the bytes per pair estimated by `bkvs_status()`. the shapes are
+ * 
+ *   flat   unique counters, `k<i>`
+ *   tree   paths sharing long prefixes, `tenant:<t>:user:<u>:field:<f>`
+ *   url    URLs of a few hosts, `https://<host>/api/v1/items/<i>/detail`
+ * 
+ * and each prefix scan visits the keys of one user, host or counter decade.
+ * 
+ * usage: bench_engine [-n pairs] [-r repeat] [-s flat|tree|url]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bufferkvs.h"
+
+#define BENCH_KEY_MAX       64
+
+#define BENCH_SCAN_NUM      64
+
+enum _bench_engine {
+    BENCH_ENGINE_HASH,
+    BENCH_ENGINE_INDEX,
+    BENCH_ENGINE_ART,
+    BENCH_ENGINE_CUCKOO,
+    BENCH_ENGINE_NUM,
+};
+
+static const char *engine_names[BENCH_ENGINE_NUM] = {
+    "hash", "hash_index", "art", "cuckoo",
+};
+
+enum _bench_shape {
+    BENCH_SHAPE_FLAT,
+    BENCH_SHAPE_TREE,
+    BENCH_SHAPE_URL,
+    BENCH_SHAPE_NUM,
+};
+
+static const char *shape_names[BENCH_SHAPE_NUM] = {
+    "flat", "tree", "url",
+};
+
+enum _bench_op {
+    BENCH_OP_PUT,
+    BENCH_OP_GET,
+    BENCH_OP_MISS,
+    BENCH_OP_UPDATE,
+    BENCH_OP_PREFIX,
+    BENCH_OP_DROP,
+    BENCH_OP_NUM,
+};
+
+static const char *op_names[BENCH_OP_NUM] = {
+    "put", "get", "miss", "update", "prefix", "drop",
+};
+
+static bkvs_u64 rand_state = 0x9e3779b97f4a7c15ULL;
+
+static volatile bkvs_u64 sink;
+
+static const char *scan_prefix;
+
+static bkvs_u32 scan_len;
+
+static bkvs_u64 rand_next(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+
+    return rand_state;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* key of the index, and the prefix its scan group shares. */
+static void make_key(bkvs_u32 shape, bkvs_u32 i, char *key, char *prefix) {
+    switch (shape) {
+    case BENCH_SHAPE_TREE:
+        snprintf(prefix, BENCH_KEY_MAX, "tenant:%03u:user:%06u:", i % 97, i / 16);
+        snprintf(key, BENCH_KEY_MAX, "%sfield:%02u", prefix, i % 16);
+        break;
+    case BENCH_SHAPE_URL:
+        snprintf(prefix, BENCH_KEY_MAX, "https://host%u.example.com/", i % 8);
+        snprintf(key, BENCH_KEY_MAX, "%sapi/v1/items/%u/detail", prefix, i / 8);
+        break;
+    default:
+        snprintf(prefix, BENCH_KEY_MAX, "k%u", i / 10);
+        snprintf(key, BENCH_KEY_MAX, "k%u", i);
+        break;
+    }
+}
+
+static bkvs_res count_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    sink += buff->size;
+
+    return BKVS_OK;
+}
+
+static bkvs_res filter_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    if (strncmp(key, scan_prefix, scan_len) == 0) {
+        sink += buff->size;
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief run every operation once, keeping the elapsed seconds and the bytes per pair.
+*/
+static int run_once(bkvs_u32 engine, bkvs_u32 pair_num, const char *keys, const char *miss_keys,
+                    const char *prefixes, const bkvs_u32 *order, double secs[BENCH_OP_NUM],
+                    double *bytes) {
+    bkvs_u64 value;
+    bkvs_conf conf;
+    bkvs_stat stat;
+    bkvs_ctx *ctx;
+    bkvs_buff buff;
+    double start;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = pair_num;
+    conf.ordered_index = engine == BENCH_ENGINE_INDEX;
+    if (engine == BENCH_ENGINE_ART) {
+        conf.engine = BKVS_ENGINE_ART;
+    } else if (engine == BENCH_ENGINE_CUCKOO) {
+        conf.engine = BKVS_ENGINE_CUCKOO;
+    } else {
+        conf.engine = BKVS_ENGINE_HASH;
+    }
+    if (bkvs_new(&ctx, &conf) != BKVS_OK) {
+        return -1;
+    }
+    value = 0xa5a5a5a5a5a5a5a5ULL;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        if (bkvs_put(ctx, keys + (size_t)order[i] * BENCH_KEY_MAX, &value, sizeof(value)) != BKVS_OK) {
+            bkvs_del(ctx);
+
+            return -1;
+        }
+    }
+    secs[BENCH_OP_PUT] = now_sec() - start;
+    bkvs_status(ctx, &stat);
+    *bytes = (double)(stat.key_size + stat.value_size + stat.overhead_size) / pair_num;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        if (bkvs_get(ctx, keys + (size_t)order[i] * BENCH_KEY_MAX, &buff) == BKVS_OK) {
+            sink += buff.ptr[0];
+        }
+    }
+    secs[BENCH_OP_GET] = now_sec() - start;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        sink += bkvs_get(ctx, miss_keys + (size_t)order[i] * BENCH_KEY_MAX, &buff);
+    }
+    secs[BENCH_OP_MISS] = now_sec() - start;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        value++;
+        bkvs_put(ctx, keys + (size_t)order[pair_num - 1 - i] * BENCH_KEY_MAX, &value, sizeof(value));
+    }
+    secs[BENCH_OP_UPDATE] = now_sec() - start;
+
+    /* a handful of scans, without the index each one walks the whole set. */
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < BENCH_SCAN_NUM; i++) {
+        scan_prefix = prefixes + (size_t)order[i] * BENCH_KEY_MAX;
+        if (engine == BENCH_ENGINE_HASH || engine == BENCH_ENGINE_CUCKOO) {
+            scan_len = strlen(scan_prefix);
+            bkvs_foreach(ctx, filter_cb);
+        } else {
+            bkvs_prefix(ctx, scan_prefix, count_cb);
+        }
+    }
+    secs[BENCH_OP_PREFIX] = now_sec() - start;
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        bkvs_drop(ctx, keys + (size_t)order[i] * BENCH_KEY_MAX);
+    }
+    secs[BENCH_OP_DROP] = now_sec() - start;
+
+    bkvs_del(ctx);
+
+    return 0;
+}
+
+static int run(bkvs_u32 shape, bkvs_u32 pair_num, bkvs_u32 repeat) {
+    double best[BENCH_OP_NUM];
+    double secs[BENCH_OP_NUM];
+    double bytes;
+    bkvs_u32 *order;
+    char *keys;
+    char *miss_keys;
+    char *prefixes;
+    int res;
+
+    keys = (char *)malloc((size_t)pair_num * BENCH_KEY_MAX);
+    miss_keys = (char *)malloc((size_t)pair_num * BENCH_KEY_MAX);
+    prefixes = (char *)malloc((size_t)pair_num * BENCH_KEY_MAX);
+    order = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * pair_num);
+    res = -1;
+    if (keys == NULL || miss_keys == NULL || prefixes == NULL || order == NULL) {
+        goto exit;
+    }
+
+    /* misses share the shape, they are the keys past the filled ones. */
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        char prefix[BENCH_KEY_MAX];
+
+        make_key(shape, i, keys + (size_t)i * BENCH_KEY_MAX, prefixes + (size_t)i * BENCH_KEY_MAX);
+        make_key(shape, pair_num + i, miss_keys + (size_t)i * BENCH_KEY_MAX, prefix);
+        order[i] = i;
+    }
+    for (bkvs_u32 i = pair_num - 1; i > 0; i--) {
+        bkvs_u32 j;
+        bkvs_u32 tmp;
+
+        j = rand_next() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    for (bkvs_u32 e = 0; e < BENCH_ENGINE_NUM; e++) {
+        for (bkvs_u32 r = 0; r < repeat; r++) {
+            if (run_once(e, pair_num, keys, miss_keys, prefixes, order, secs, &bytes) != 0) {
+                goto exit;
+            }
+            for (bkvs_u32 i = 0; i < BENCH_OP_NUM; i++) {
+                if (r == 0 || secs[i] < best[i]) {
+                    best[i] = secs[i];
+                }
+            }
+        }
+        for (bkvs_u32 i = 0; i < BENCH_OP_NUM; i++) {
+            bkvs_u32 ops;
+
+            ops = i == BENCH_OP_PREFIX ? BENCH_SCAN_NUM : pair_num;
+            printf("%s,%s,%u,%s,%u,%.1f,%.0f,%.1f\n", engine_names[e], shape_names[shape], pair_num,
+                   op_names[i], ops, best[i] * 1e9 / ops, ops / best[i], bytes);
+        }
+        fflush(stdout);
+    }
+    res = 0;
+
+exit:
+    free(keys);
+    free(miss_keys);
+    free(prefixes);
+    free(order);
+
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    bkvs_u32 pair_num = 1000000;
+    bkvs_u32 repeat = 3;
+    int shape = -1;
+    int res;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            pair_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            repeat = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            for (shape = BENCH_SHAPE_NUM - 1; shape >= 0 && strcmp(argv[i + 1], shape_names[shape]) != 0; shape--);
+            if (shape < 0) {
+                fprintf(stderr, "unknown shape: %s\n", argv[i + 1]);
+
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+
+            return 1;
+        }
+    }
+    if (pair_num < BENCH_SCAN_NUM) {
+        fprintf(stderr, "pair number must be at least %u\n", BENCH_SCAN_NUM);
+
+        return 1;
+    }
+    if (repeat == 0) {
+        repeat = 1;
+    }
+
+    printf("engine,shape,pair_num,op,ops,ns_per_op,ops_per_sec,bytes_per_pair\n");
+    res = 0;
+    for (bkvs_u32 s = 0; s < BENCH_SHAPE_NUM && res == 0; s++) {
+        if (shape < 0 || (bkvs_u32)shape == s) {
+            res = run(s, pair_num, repeat);
+        }
+    }
+    if (res != 0) {
+        fprintf(stderr, "benchmark failed\n");
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,287 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * memory footprint benchmark, in bytes per stored pair.
+ * 
+ * for each key length and value size a fresh set is filled and the heap
+ * growth is divided by the number of the pairs. every layout is measured:
+ * pairs put one by one, pairs loaded from a snapshot into arena blocks, and
+ * the frozen set. the CSV columns are
+ * 
+ *   heap      heap growth as seen by the allocator, glibc only
+ *   counted   blocks allocated by the set itself, with -DBKVS_MEM_ACCOUNT
+ *   estimate  key, value and overhead sizes reported by `bkvs_status()`
+ * 
+ * and `overhead` is the heap growth minus the key and value bytes.
+ * 
+ * flat keys are unique counters, tree keys look like `xxxx:o<object>:f<field>`
+ * with 16 fields per object, so that `-m prefix` can share their prefixes.
+ * 
+ * usage: bench_mem [-n pairs] [-b bucket_num] [-d dir] [-s flat|tree]
+ *                  [-m plain|prefix]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "bufferkvs.h"
+
+enum _bench_layout {
+    BENCH_LAYOUT_PUT,
+    BENCH_LAYOUT_LOAD,
+    BENCH_LAYOUT_FROZEN,
+    BENCH_LAYOUT_NUM,
+};
+
+static const char *layout_names[BENCH_LAYOUT_NUM] = {
+    "put", "load", "frozen",
+};
+
+enum _bench_shape {
+    BENCH_SHAPE_FLAT,
+    BENCH_SHAPE_TREE,
+};
+
+static const bkvs_u32 key_lens[] = {8, 16, 32, 64};
+
+static const bkvs_u32 value_sizes[] = {8, 32, 128, 1024};
+
+static long long heap_used(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+
+    return (long long)(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+    struct mallinfo info = mallinfo();
+
+    return (long long)info.uordblks + info.hblkhd;
+#else
+    return -1;
+#endif
+}
+
+static long long counted_used(void) {
+    bkvs_u64 size;
+    bkvs_u64 num;
+
+    if (bkvs_mem_usage(&size, &num) != BKVS_OK) {
+        return -1;
+    }
+
+    return (long long)size;
+}
+
+static int fill(bkvs_ctx *ctx, bkvs_u32 pair_num, bkvs_u32 shape, bkvs_u32 key_len,
+                const bkvs_u8 *value, bkvs_u32 value_size) {
+    char key[128];
+    char tail[32];
+    int len;
+
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        memset(key, 'x', key_len);
+        if (shape == BENCH_SHAPE_TREE) {
+            len = snprintf(tail, sizeof(tail), ":o%u:f%02u", i / 16, i % 16);
+            if (len >= (int)key_len) {
+                return -1;
+            }
+            memcpy(key + key_len - len, tail, len);
+        } else {
+            len = snprintf(key, key_len + 1, "k%u", i);
+            if (len > (int)key_len) {
+                return -1;
+            }
+            if (len < (int)key_len) {
+                key[len] = '_';
+            }
+        }
+        key[key_len] = '\0';
+        if (bkvs_put(ctx, key, value, value_size) != BKVS_OK) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void print_per_pair(long long after, long long before, bkvs_u32 pair_num) {
+    if (after < 0 || before < 0) {
+        printf(",");
+    } else {
+        printf(",%.1f", (double)(after - before) / pair_num);
+    }
+}
+
+static int run(bkvs_u32 layout, bkvs_u32 pair_num, bkvs_u32 bucket_num, bkvs_u32 shape,
+               bkvs_u32 key_mode, bkvs_u32 key_len, bkvs_u32 value_size, const char *snap_path) {
+    long long heap_before;
+    long long counted_before;
+    long long heap_after;
+    long long counted_after;
+    bkvs_conf conf;
+    bkvs_stat stat;
+    bkvs_ctx *ctx;
+    bkvs_u8 *value;
+    double payload;
+
+    value = (bkvs_u8 *)malloc(value_size);
+    if (value == NULL) {
+        return -1;
+    }
+    memset(value, 0xa5, value_size);
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = bucket_num;
+    conf.key_mode = key_mode;
+
+    /* the snapshot is written by a set that is gone before measuring. */
+    if (layout == BENCH_LAYOUT_LOAD) {
+        if (bkvs_new(&ctx, &conf) != BKVS_OK) {
+            free(value);
+
+            return -1;
+        }
+        if (fill(ctx, pair_num, shape, key_len, value, value_size) != 0 ||
+            bkvs_save(ctx, snap_path) != BKVS_OK) {
+            bkvs_del(ctx);
+            free(value);
+
+            return -1;
+        }
+        bkvs_del(ctx);
+    }
+
+    heap_before = heap_used();
+    counted_before = counted_used();
+    if (layout == BENCH_LAYOUT_LOAD) {
+        if (bkvs_load(snap_path, &ctx, &conf) != BKVS_OK) {
+            free(value);
+
+            return -1;
+        }
+        remove(snap_path);
+    } else {
+        if (bkvs_new(&ctx, &conf) != BKVS_OK) {
+            free(value);
+
+            return -1;
+        }
+        if (fill(ctx, pair_num, shape, key_len, value, value_size) != 0 ||
+            (layout == BENCH_LAYOUT_FROZEN && bkvs_freeze(ctx) != BKVS_OK)) {
+            bkvs_del(ctx);
+            free(value);
+
+            return -1;
+        }
+    }
+    heap_after = heap_used();
+    counted_after = counted_used();
+    bkvs_status(ctx, &stat);
+    payload = (double)(stat.key_size + stat.value_size) / pair_num;
+
+    printf("%s,%u,%u,%u,%u,%.1f", layout_names[layout], pair_num, bucket_num, key_len,
+           value_size, payload);
+    print_per_pair(heap_after, heap_before, pair_num);
+    if (heap_after >= 0 && heap_before >= 0) {
+        printf(",%.1f", (double)(heap_after - heap_before) / pair_num - payload);
+    } else {
+        printf(",");
+    }
+    print_per_pair(counted_after, counted_before, pair_num);
+    printf(",%.1f,%u\n", (double)(stat.key_size + stat.value_size + stat.overhead_size) / pair_num,
+           stat.prefix_num);
+    fflush(stdout);
+
+    bkvs_del(ctx);
+    free(value);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = ".";
+    bkvs_u32 pair_num = 100000;
+    bkvs_u32 bucket_num = 0;
+    bkvs_u32 shape = BENCH_SHAPE_FLAT;
+    bkvs_u32 key_mode = BKVS_KEY_PLAIN;
+    char snap_path[4096];
+    int res;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            pair_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            bucket_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            dir = argv[i + 1];
+        } else if (strcmp(argv[i], "-s") == 0 && strcmp(argv[i + 1], "flat") == 0) {
+            shape = BENCH_SHAPE_FLAT;
+        } else if (strcmp(argv[i], "-s") == 0 && strcmp(argv[i + 1], "tree") == 0) {
+            shape = BENCH_SHAPE_TREE;
+        } else if (strcmp(argv[i], "-m") == 0 && strcmp(argv[i + 1], "plain") == 0) {
+            key_mode = BKVS_KEY_PLAIN;
+        } else if (strcmp(argv[i], "-m") == 0 && strcmp(argv[i + 1], "prefix") == 0) {
+            key_mode = BKVS_KEY_PREFIX;
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+
+            return 1;
+        }
+    }
+    if (pair_num == 0) {
+        fprintf(stderr, "pair number must not be zero\n");
+
+        return 1;
+    }
+    if (bucket_num == 0) {
+        bucket_num = pair_num;
+    }
+    snprintf(snap_path, sizeof(snap_path), "%s/bench_mem.bkvs", dir);
+
+    printf("layout,pairs,bucket_num,key_len,value_size,payload,heap,overhead,counted,estimate,prefixes\n");
+    res = 0;
+    for (bkvs_u32 l = 0; l < BENCH_LAYOUT_NUM && res == 0; l++) {
+        for (bkvs_u32 k = 0; k < sizeof(key_lens) / sizeof(key_lens[0]) && res == 0; k++) {
+
+            /* the shortest keys cannot hold a tree path. */
+            if (shape == BENCH_SHAPE_TREE && key_lens[k] < 16) {
+                continue;
+            }
+            for (bkvs_u32 v = 0; v < sizeof(value_sizes) / sizeof(value_sizes[0]) && res == 0; v++) {
+                res = run(l, pair_num, bucket_num, shape, key_mode, key_lens[k], value_sizes[v], snap_path);
+            }
+        }
+    }
+    if (res != 0) {
+        fprintf(stderr, "benchmark failed\n");
+
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,368 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * NUMA placement benchmark, one set per worker thread.
+ * 
+ * the workers are pinned round robin to the CPUs of the nodes listed under
+ * /sys/devices/system/node, and each one looks up random keys of its own set.
+ * the sets are placed in one of two ways:
+ * 
+ *   central  the main thread, on the first node, creates and fills every set
+ *   local    each worker creates and fills its set, bound to its own node
+ * 
+ * so that with several nodes `central` shows the remote accesses of the
+ * workers away from the first node. one CSV line is printed per mode and
+ * node, plus a line for all of them. a single node machine runs both modes
+ * alike; booting with `numa=fake=<n>` or a VM with several nodes emulates a
+ * multi-node host.
+ * 
+ * usage: bench_numa [-n pairs_per_set] [-o gets_per_thread] [-t threads]
+ *                   [-e hash|cuckoo]
+*/
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "bufferkvs.h"
+
+#define BENCH_KEY_SIZE      32
+
+#define BENCH_CPU_MAX       1024
+
+enum _bench_mode {
+    BENCH_MODE_CENTRAL,
+    BENCH_MODE_LOCAL,
+    BENCH_MODE_NUM,
+};
+
+static const char *mode_names[BENCH_MODE_NUM] = {
+    "central", "local",
+};
+
+typedef struct _bench_worker {
+    pthread_t thread;
+    bkvs_ctx *ctx;
+    bkvs_u32 cpu;
+    bkvs_u32 node;
+    double secs;
+    int res;
+} bench_worker;
+
+static struct _bench {
+    bkvs_u32 mode;
+    bkvs_u32 pair_num;
+    bkvs_u32 op_num;
+    bkvs_u32 engine;
+    pthread_barrier_t barrier;
+} bench;
+
+/* CPU numbers of the nodes, listed node by node, and the node of each one. */
+static bkvs_u32 cpu_ids[BENCH_CPU_MAX];
+static bkvs_u32 cpu_nodes[BENCH_CPU_MAX];
+
+static bkvs_u32 cpu_num;
+
+static bkvs_u32 node_ids[BKVS_NUMA_NODE_MAX];
+
+static bkvs_u32 node_num;
+
+static volatile bkvs_u64 sink;
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* CPUs of each node, read from "0-3,8-11" style lists. a machine without the
+   listing is taken as one node of CPU 0. */
+static void list_cpus(void) {
+    char path[64];
+    char list[4096];
+    bkvs_u32 lo;
+    bkvs_u32 hi;
+    FILE *file;
+    char *ptr;
+
+    for (bkvs_u32 node = 0; node < BKVS_NUMA_NODE_MAX && cpu_num < BENCH_CPU_MAX; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        if (fgets(list, sizeof(list), file) != NULL && list[0] >= '0' && list[0] <= '9') {
+            node_ids[node_num++] = node;
+            for (ptr = list; *ptr >= '0' && *ptr <= '9'; ) {
+                lo = strtoul(ptr, &ptr, 10);
+                hi = *ptr == '-' ? strtoul(ptr + 1, &ptr, 10) : lo;
+                for (bkvs_u32 cpu = lo; cpu <= hi && cpu_num < BENCH_CPU_MAX; cpu++) {
+                    cpu_ids[cpu_num] = cpu;
+                    cpu_nodes[cpu_num++] = node;
+                }
+                if (*ptr == ',') {
+                    ptr++;
+                }
+            }
+        }
+        fclose(file);
+    }
+    if (cpu_num == 0) {
+        cpu_ids[0] = 0;
+        cpu_nodes[0] = 0;
+        cpu_num = 1;
+        node_ids[0] = 0;
+        node_num = 1;
+    }
+}
+
+/* CPU list index of the i-th worker, the workers going round robin over the nodes. */
+static bkvs_u32 pick_cpu(bkvs_u32 i) {
+    bkvs_u32 node;
+    bkvs_u32 num;
+    bkvs_u32 skip;
+
+    node = node_ids[i % node_num];
+    num = 0;
+    for (bkvs_u32 n = 0; n < cpu_num; n++) {
+        num += cpu_nodes[n] == node;
+    }
+    skip = (i / node_num) % num;
+    for (bkvs_u32 n = 0; n < cpu_num; n++) {
+        if (cpu_nodes[n] == node && skip-- == 0) {
+            return n;
+        }
+    }
+
+    return 0;
+}
+
+static void pin_cpu(bkvs_u32 cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu_ids[cpu], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+static void make_key(bkvs_u32 i, char *key) {
+    snprintf(key, BENCH_KEY_SIZE, "user:%010u", i * 2654435761u);
+}
+
+static int fill(bkvs_ctx **ctx, bkvs_u32 numa_node) {
+    char key[BENCH_KEY_SIZE];
+    bkvs_conf conf;
+    bkvs_u64 value;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = bench.pair_num;
+    conf.engine = bench.engine;
+    conf.numa_node = numa_node;
+    if (bkvs_new(ctx, &conf) != BKVS_OK) {
+        return -1;
+    }
+    for (bkvs_u32 i = 0; i < bench.pair_num; i++) {
+        make_key(i, key);
+        value = i;
+        if (bkvs_put(*ctx, key, &value, sizeof(value)) != BKVS_OK) {
+            bkvs_del(*ctx);
+
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void *run_worker(void *arg) {
+    char key[BENCH_KEY_SIZE];
+    bench_worker *worker;
+    bkvs_u64 state;
+    bkvs_buff buff;
+    double start;
+
+    worker = (bench_worker *)arg;
+    pin_cpu(worker->cpu);
+    if (bench.mode == BENCH_MODE_LOCAL) {
+        worker->res = fill(&worker->ctx, BKVS_NUMA_NODE(worker->node));
+    }
+    pthread_barrier_wait(&bench.barrier);
+    if (worker->res != 0) {
+        return NULL;
+    }
+
+    state = 0x9e3779b97f4a7c15ULL ^ worker->cpu;
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < bench.op_num; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        make_key((bkvs_u32)(state % bench.pair_num), key);
+        if (bkvs_get(worker->ctx, key, &buff) == BKVS_OK) {
+            sink += buff.ptr[0];
+        }
+    }
+    worker->secs = now_sec() - start;
+
+    return NULL;
+}
+
+static int run(bkvs_u32 mode, bkvs_u32 thread_num) {
+    bench_worker *workers;
+    bkvs_u64 ops;
+    double secs;
+    int res;
+
+    workers = (bench_worker *)calloc(thread_num, sizeof(bench_worker));
+    if (workers == NULL) {
+        return -1;
+    }
+    for (bkvs_u32 i = 0; i < thread_num; i++) {
+        workers[i].cpu = pick_cpu(i);
+        workers[i].node = cpu_nodes[workers[i].cpu];
+    }
+
+    /* the sets of the central mode are all first touched from the first node. */
+    bench.mode = mode;
+    res = 0;
+    if (mode == BENCH_MODE_CENTRAL) {
+        pin_cpu(0);
+        for (bkvs_u32 i = 0; i < thread_num && res == 0; i++) {
+            res = workers[i].res = fill(&workers[i].ctx, 0);
+        }
+    }
+    pthread_barrier_init(&bench.barrier, NULL, thread_num);
+    for (bkvs_u32 i = 0; i < thread_num && res == 0; i++) {
+        if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+            fprintf(stderr, "cannot create thread %u\n", i);
+            exit(1);
+        }
+    }
+    for (bkvs_u32 i = 0; i < thread_num && res == 0; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_barrier_destroy(&bench.barrier);
+    for (bkvs_u32 i = 0; i < thread_num; i++) {
+        if (workers[i].res != 0) {
+            res = -1;
+        }
+    }
+
+    /* one line per node, then all of them. the throughput adds up the threads. */
+    for (bkvs_u32 node = 0; node <= BKVS_NUMA_NODE_MAX && res == 0; node++) {
+        bkvs_u32 num;
+
+        ops = 0;
+        secs = 0;
+        num = 0;
+        for (bkvs_u32 i = 0; i < thread_num; i++) {
+            if (node == BKVS_NUMA_NODE_MAX || workers[i].node == node) {
+                ops += bench.op_num;
+                secs += workers[i].secs;
+                num++;
+            }
+        }
+        if (num == 0) {
+            continue;
+        }
+        if (node == BKVS_NUMA_NODE_MAX) {
+            printf("%s,all,", mode_names[mode]);
+        } else {
+            printf("%s,%u,", mode_names[mode], node);
+        }
+        printf("%u,%u,%llu,%.1f,%.0f\n", num, bench.pair_num, (unsigned long long)ops, secs * 1e9 / ops,
+               ops / (secs / num));
+    }
+    fflush(stdout);
+
+    for (bkvs_u32 i = 0; i < thread_num; i++) {
+        if (workers[i].ctx != NULL && workers[i].res == 0) {
+            bkvs_del(workers[i].ctx);
+        }
+    }
+    free(workers);
+
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+    bkvs_u32 thread_num = 0;
+
+    bench.pair_num = 1000000;
+    bench.op_num = 2000000;
+    bench.engine = BKVS_ENGINE_HASH;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            bench.pair_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            bench.op_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            thread_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-e") == 0 && strcmp(argv[i + 1], "hash") == 0) {
+            bench.engine = BKVS_ENGINE_HASH;
+        } else if (strcmp(argv[i], "-e") == 0 && strcmp(argv[i + 1], "cuckoo") == 0) {
+            bench.engine = BKVS_ENGINE_CUCKOO;
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+
+            return 1;
+        }
+    }
+    if (bench.pair_num == 0 || bench.op_num == 0) {
+        fprintf(stderr, "pair and operation numbers must not be zero\n");
+
+        return 1;
+    }
+    list_cpus();
+    if (thread_num == 0) {
+        thread_num = cpu_num;
+    }
+    fprintf(stderr, "%u nodes, %u cpus, %u threads\n", node_num, cpu_num, thread_num);
+
+    printf("mode,node,threads,pairs,ops,ns_per_op,ops_per_sec\n");
+    for (bkvs_u32 mode = 0; mode < BENCH_MODE_NUM; mode++) {
+        if (run(mode, thread_num) != 0) {
+            fprintf(stderr, "benchmark failed\n");
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
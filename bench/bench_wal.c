@@ -0,0 +1,150 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * put throughput benchmark of the write-ahead log sync policies.
+ * 
+ * every run puts the same keys into a fresh set logging to `dir`, and
+ * prints one CSV line per policy: no log, fsync per put, group commit with
+ * a few batch sizes, and no fsync at all.
+ * 
+ * usage: bench_wal [-n puts] [-v value_size] [-d dir]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bufferkvs.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int run(const char *name, const char *wal_path, bkvs_u32 sync, bkvs_u32 batch_num,
+               bkvs_u32 put_num, bkvs_u32 value_size) {
+    bkvs_conf conf;
+    bkvs_ctx *ctx;
+    bkvs_u8 *value;
+    char key[32];
+    double start;
+    double elapsed;
+
+    value = (bkvs_u8 *)malloc(value_size);
+    if (value == NULL) {
+        return -1;
+    }
+    memset(value, 0xa5, value_size);
+
+    if (wal_path != NULL) {
+        unlink(wal_path);
+    }
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = put_num;
+    conf.wal_path = wal_path;
+    conf.wal_sync = sync;
+    conf.wal_batch_num = batch_num;
+    if (bkvs_new(&ctx, &conf) != BKVS_OK) {
+        free(value);
+
+        return -1;
+    }
+
+    start = now_sec();
+    for (bkvs_u32 i = 0; i < put_num; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        if (bkvs_put(ctx, key, value, value_size) != BKVS_OK) {
+            bkvs_del(ctx);
+            free(value);
+
+            return -1;
+        }
+    }
+    if (bkvs_sync(ctx) != BKVS_OK) {
+        bkvs_del(ctx);
+        free(value);
+
+        return -1;
+    }
+    elapsed = now_sec() - start;
+    bkvs_del(ctx);
+    free(value);
+    if (wal_path != NULL) {
+        unlink(wal_path);
+    }
+
+    printf("%s,%u,%u,%u,%.3f,%.0f\n", name, batch_num, put_num, value_size,
+           elapsed, put_num / elapsed);
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = ".";
+    bkvs_u32 put_num = 10000;
+    bkvs_u32 value_size = 100;
+    char wal_path[4096];
+    int res;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) {
+            put_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            value_size = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            dir = argv[i + 1];
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+
+            return 1;
+        }
+    }
+    if (put_num == 0 || value_size == 0) {
+        fprintf(stderr, "put number and value size must not be zero\n");
+
+        return 1;
+    }
+    snprintf(wal_path, sizeof(wal_path), "%s/bench_wal.log", dir);
+
+    printf("policy,batch_num,puts,value_size,seconds,puts_per_sec\n");
+    res = run("none", NULL, 0, 0, put_num, value_size);
+    res |= run("always", wal_path, BKVS_WAL_SYNC_ALWAYS, 0, put_num, value_size);
+    res |= run("batch", wal_path, BKVS_WAL_SYNC_BATCH, 16, put_num, value_size);
+    res |= run("batch", wal_path, BKVS_WAL_SYNC_BATCH, 256, put_num, value_size);
+    res |= run("batch", wal_path, BKVS_WAL_SYNC_BATCH, 4096, put_num, value_size);
+    res |= run("os", wal_path, BKVS_WAL_SYNC_NONE, 0, put_num, value_size);
+    if (res != 0) {
+        fprintf(stderr, "benchmark failed\n");
+
+        return 1;
+    }
+
+    return 0;
+}
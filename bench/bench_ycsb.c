@@ -0,0 +1,707 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * YCSB-style workload replay benchmark.
+ * 
+ * the records are loaded first, then the threads run the operation mix of
+ * one of the YCSB core workloads against the set, or replay a recorded
+ * trace. the set is shared through `-m global` (one set behind one mutex) or
+ * `-m striped` (keys hashed over `-S` sets, each with its own mutex). one CSV
+ * line is printed per operation type with throughput and latency
+ * percentiles, plus a line for all of them.
+ * 
+ *   a: 50% read, 50% update, zipfian      d: 95% read, 5% insert, latest
+ *   b: 95% read, 5% update, zipfian       e: 95% scan, 5% insert, zipfian
+ *   c: 100% read, zipfian                 f: 50% read, 50% read-modify-write
+ * 
+ * the set has no ordered index, so a scan reads up to 100 consecutive record
+ * numbers one by one. a trace file has one operation per line: "get key",
+ * "has key", "put key [value_size]" or "drop key"; the records column then
+ * counts the operations of the trace.
+ * 
+ * usage: bench_ycsb [-w a-f] [-n records] [-o operations] [-t threads]
+ *                   [-s zipf_theta] [-v value_size] [-b bucket_num]
+ *                   [-m global|striped] [-S stripes] [-T trace_file]
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bufferkvs.h"
+
+#define BENCH_KEY_SIZE          32
+
+#define BENCH_SCAN_MAX          100
+
+/* bits of the value kept by a latency bucket, 16 buckets per power of 2. */
+#define BENCH_LAT_SUB_BITS      4
+
+#define BENCH_LAT_BUCKET_NUM    ((64 - BENCH_LAT_SUB_BITS + 1) << BENCH_LAT_SUB_BITS)
+
+enum _bench_op {
+    BENCH_OP_READ,
+    BENCH_OP_UPDATE,
+    BENCH_OP_INSERT,
+    BENCH_OP_SCAN,
+    BENCH_OP_RMW,
+    BENCH_OP_DELETE,
+    BENCH_OP_HAS,
+    BENCH_OP_NUM,
+};
+
+static const char *op_names[BENCH_OP_NUM] = {
+    "read", "update", "insert", "scan", "rmw", "delete", "has",
+};
+
+enum _bench_dist {
+    BENCH_DIST_ZIPF,
+    BENCH_DIST_LATEST,
+};
+
+typedef struct _bench_workload {
+    char name;
+
+    /* percentage of each operation. */
+    bkvs_u32 pcts[BENCH_OP_NUM];
+
+    bkvs_u32 dist;
+} bench_workload;
+
+static const bench_workload workloads[] = {
+    {'a', {50, 50, 0, 0, 0, 0}, BENCH_DIST_ZIPF},
+    {'b', {95, 5, 0, 0, 0, 0}, BENCH_DIST_ZIPF},
+    {'c', {100, 0, 0, 0, 0, 0}, BENCH_DIST_ZIPF},
+    {'d', {95, 0, 5, 0, 0, 0}, BENCH_DIST_LATEST},
+    {'e', {0, 0, 5, 95, 0, 0}, BENCH_DIST_ZIPF},
+    {'f', {50, 0, 0, 0, 50, 0}, BENCH_DIST_ZIPF},
+};
+
+typedef struct _bench_trace_op {
+    bkvs_u32 op;
+    bkvs_u32 value_size;
+    char key[BENCH_KEY_SIZE];
+} bench_trace_op;
+
+typedef struct _bench_zipf {
+    bkvs_u64 item_num;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+} bench_zipf;
+
+typedef struct _bench_thread {
+    pthread_t thread;
+    bkvs_u32 idx;
+    bkvs_u64 rand_state;
+    bkvs_u64 hist[BENCH_OP_NUM][BENCH_LAT_BUCKET_NUM];
+    bkvs_u64 max[BENCH_OP_NUM];
+    int res;
+} bench_thread;
+
+static struct _bench_global {
+    const bench_workload *workload;
+    bench_trace_op *trace;
+    bkvs_u64 trace_num;
+    bkvs_u64 record_num;
+    bkvs_u64 op_num;
+    bkvs_u32 thread_num;
+    bkvs_u32 value_size;
+    bkvs_u32 stripe_num;
+    bench_zipf zipf;
+
+    /* next record number to be inserted. */
+    bkvs_u64 insert_next;
+
+    bkvs_ctx **sets;
+    pthread_mutex_t *locks;
+} bench;
+
+static bkvs_u64 rand_next(bkvs_u64 *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+static double rand_unit(bkvs_u64 *state) {
+    return (rand_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bkvs_u64 now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (bkvs_u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bkvs_u64 fnv_hash(const void *data, size_t size) {
+    const bkvs_u8 *ptr = (const bkvs_u8 *)data;
+    bkvs_u64 hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ ptr[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/* zipfian ranks as generated by YCSB, after Gray et al. */
+static void zipf_init(bench_zipf *zipf, bkvs_u64 item_num, double theta) {
+    double zeta2;
+
+    zipf->item_num = item_num;
+    zipf->theta = theta;
+    zipf->zetan = 0;
+    for (bkvs_u64 i = 1; i <= item_num; i++) {
+        zipf->zetan += 1 / pow((double)i, theta);
+    }
+    zeta2 = 1 + 1 / pow(2, theta);
+    zipf->alpha = 1 / (1 - theta);
+    zipf->eta = (1 - pow(2.0 / item_num, 1 - theta)) / (1 - zeta2 / zipf->zetan);
+}
+
+static bkvs_u64 zipf_next(bench_zipf *zipf, bkvs_u64 *state) {
+    double u;
+    double uz;
+    bkvs_u64 rank;
+
+    u = rand_unit(state);
+    if (zipf->theta == 0) {
+        return (bkvs_u64)(u * zipf->item_num);
+    }
+    uz = u * zipf->zetan;
+    if (uz < 1) {
+        return 0;
+    }
+    if (uz < 1 + pow(0.5, zipf->theta)) {
+        return 1;
+    }
+    rank = (bkvs_u64)(zipf->item_num * pow(zipf->eta * u - zipf->eta + 1, zipf->alpha));
+
+    return rank < zipf->item_num ? rank : zipf->item_num - 1;
+}
+
+static bkvs_u32 lat_bucket(bkvs_u64 value) {
+    bkvs_u32 msb;
+
+    if (value < (1 << (BENCH_LAT_SUB_BITS + 1))) {
+        return (bkvs_u32)value;
+    }
+    msb = 63 - __builtin_clzll(value);
+
+    return ((msb - BENCH_LAT_SUB_BITS + 1) << BENCH_LAT_SUB_BITS) +
+        (bkvs_u32)((value >> (msb - BENCH_LAT_SUB_BITS)) & ((1 << BENCH_LAT_SUB_BITS) - 1));
+}
+
+static bkvs_u64 lat_value(bkvs_u32 bucket_idx) {
+    bkvs_u32 shift;
+
+    if (bucket_idx < (1 << (BENCH_LAT_SUB_BITS + 1))) {
+        return bucket_idx;
+    }
+    shift = (bucket_idx >> BENCH_LAT_SUB_BITS) - 1;
+
+    return (((1ULL << BENCH_LAT_SUB_BITS) + (bucket_idx & ((1 << BENCH_LAT_SUB_BITS) - 1)) + 1) << shift) - 1;
+}
+
+static bkvs_u32 stripe_of(const char *key) {
+    return (bkvs_u32)(fnv_hash(key, strlen(key)) % bench.stripe_num);
+}
+
+static void record_key(char *key, bkvs_u64 record) {
+    snprintf(key, BENCH_KEY_SIZE, "user%012llu", (unsigned long long)record);
+}
+
+static bkvs_res do_get(const char *key, bkvs_u8 *copy, bkvs_u32 *size) {
+    bkvs_u32 stripe;
+    bkvs_buff buff;
+    bkvs_res res;
+
+    stripe = stripe_of(key);
+    pthread_mutex_lock(&bench.locks[stripe]);
+    res = bkvs_get(bench.sets[stripe], key, &buff);
+
+    /* the value may be replaced as soon as the lock is released. */
+    if (res == BKVS_OK && copy != NULL) {
+        *size = buff.size < bench.value_size ? buff.size : bench.value_size;
+        memcpy(copy, buff.ptr, *size);
+    }
+    pthread_mutex_unlock(&bench.locks[stripe]);
+
+    return res;
+}
+
+static bkvs_res do_put(const char *key, const bkvs_u8 *value, bkvs_u32 size) {
+    bkvs_u32 stripe;
+    bkvs_res res;
+
+    stripe = stripe_of(key);
+    pthread_mutex_lock(&bench.locks[stripe]);
+    res = bkvs_put(bench.sets[stripe], key, value, size);
+    pthread_mutex_unlock(&bench.locks[stripe]);
+
+    return res;
+}
+
+static bkvs_res do_has(const char *key) {
+    bkvs_u32 stripe;
+    bkvs_res res;
+
+    stripe = stripe_of(key);
+    pthread_mutex_lock(&bench.locks[stripe]);
+    res = bkvs_has(bench.sets[stripe], key);
+    pthread_mutex_unlock(&bench.locks[stripe]);
+
+    return res;
+}
+
+static bkvs_res do_drop(const char *key) {
+    bkvs_u32 stripe;
+    bkvs_res res;
+
+    stripe = stripe_of(key);
+    pthread_mutex_lock(&bench.locks[stripe]);
+    res = bkvs_drop(bench.sets[stripe], key);
+    pthread_mutex_unlock(&bench.locks[stripe]);
+
+    return res;
+}
+
+/* record number of the next access, scrambled so that hot records spread over the sets. */
+static bkvs_u64 next_record(bench_thread *thread) {
+    bkvs_u64 rank;
+    bkvs_u64 last;
+
+    rank = zipf_next(&bench.zipf, &thread->rand_state);
+    if (bench.workload->dist == BENCH_DIST_LATEST) {
+        last = __atomic_load_n(&bench.insert_next, __ATOMIC_RELAXED) - 1;
+
+        return rank <= last ? last - rank : 0;
+    }
+
+    return fnv_hash(&rank, sizeof(rank)) % bench.record_num;
+}
+
+static bkvs_u32 pick_op(bench_thread *thread) {
+    bkvs_u32 pct;
+
+    pct = rand_next(&thread->rand_state) % 100;
+    for (bkvs_u32 i = 0; i < BENCH_OP_NUM; i++) {
+        if (pct < bench.workload->pcts[i]) {
+            return i;
+        }
+        pct -= bench.workload->pcts[i];
+    }
+
+    return BENCH_OP_READ;
+}
+
+static void count_op(bench_thread *thread, bkvs_u32 op, bkvs_u64 start) {
+    bkvs_u64 value;
+
+    value = now_ns() - start;
+    thread->hist[op][lat_bucket(value)]++;
+    if (value > thread->max[op]) {
+        thread->max[op] = value;
+    }
+}
+
+static void *run_workload(void *arg) {
+    bench_thread *thread = (bench_thread *)arg;
+    char key[BENCH_KEY_SIZE];
+    bkvs_u8 *value;
+    bkvs_u32 size;
+    bkvs_u64 op_num;
+
+    value = (bkvs_u8 *)malloc(bench.value_size);
+    if (value == NULL) {
+        thread->res = -1;
+
+        return NULL;
+    }
+    memset(value, 0x5a, bench.value_size);
+
+    /* share the operations out, the first threads take the remainder. */
+    op_num = bench.op_num / bench.thread_num + (thread->idx < bench.op_num % bench.thread_num);
+    for (bkvs_u64 i = 0; i < op_num; i++) {
+        bkvs_u32 op;
+        bkvs_u64 start;
+        bkvs_u64 record;
+
+        op = pick_op(thread);
+        start = now_ns();
+        switch (op) {
+        case BENCH_OP_READ:
+            record_key(key, next_record(thread));
+            do_get(key, NULL, NULL);
+            break;
+        case BENCH_OP_UPDATE:
+            record_key(key, next_record(thread));
+            do_put(key, value, bench.value_size);
+            break;
+        case BENCH_OP_INSERT:
+            record = __atomic_fetch_add(&bench.insert_next, 1, __ATOMIC_RELAXED);
+            record_key(key, record);
+            do_put(key, value, bench.value_size);
+            break;
+        case BENCH_OP_SCAN:
+            record = next_record(thread);
+            for (bkvs_u64 j = rand_next(&thread->rand_state) % BENCH_SCAN_MAX + 1; j != 0; j--) {
+                record_key(key, record++);
+                do_get(key, NULL, NULL);
+            }
+            break;
+        case BENCH_OP_RMW:
+            record_key(key, next_record(thread));
+            if (do_get(key, value, &size) == BKVS_OK) {
+                value[0]++;
+                do_put(key, value, size);
+            }
+            break;
+        }
+        count_op(thread, op, start);
+    }
+    free(value);
+
+    return NULL;
+}
+
+static void *run_trace(void *arg) {
+    bench_thread *thread = (bench_thread *)arg;
+    bkvs_u8 *value;
+
+    value = (bkvs_u8 *)malloc(bench.value_size);
+    if (value == NULL) {
+        thread->res = -1;
+
+        return NULL;
+    }
+    memset(value, 0x5a, bench.value_size);
+
+    /* the threads take every n-th operation of the trace. */
+    for (bkvs_u64 i = thread->idx; i < bench.trace_num; i += bench.thread_num) {
+        bench_trace_op *trace_op;
+        bkvs_u64 start;
+
+        trace_op = &bench.trace[i];
+        start = now_ns();
+        switch (trace_op->op) {
+        case BENCH_OP_READ:
+            do_get(trace_op->key, NULL, NULL);
+            break;
+        case BENCH_OP_UPDATE:
+            do_put(trace_op->key, value, trace_op->value_size);
+            break;
+        case BENCH_OP_HAS:
+            do_has(trace_op->key);
+            break;
+        case BENCH_OP_DELETE:
+            do_drop(trace_op->key);
+            break;
+        }
+        count_op(thread, trace_op->op, start);
+    }
+    free(value);
+
+    return NULL;
+}
+
+static int load_trace(const char *path) {
+    char line[256];
+    char name[16];
+    bkvs_u64 cap;
+    FILE *file;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    cap = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        bench_trace_op *trace_op;
+        unsigned size;
+        int num;
+
+        if (bench.trace_num == cap) {
+            bench_trace_op *trace;
+
+            cap = cap != 0 ? cap * 2 : 4096;
+            trace = (bench_trace_op *)realloc(bench.trace, sizeof(bench_trace_op) * cap);
+            if (trace == NULL) {
+                fclose(file);
+
+                return -1;
+            }
+            bench.trace = trace;
+        }
+        trace_op = &bench.trace[bench.trace_num];
+        size = bench.value_size;
+        num = sscanf(line, "%15s %31s %u", name, trace_op->key, &size);
+        if (num < 2) {
+            continue;
+        }
+
+        if (strcmp(name, "get") == 0) {
+            trace_op->op = BENCH_OP_READ;
+        } else if (strcmp(name, "put") == 0) {
+            trace_op->op = BENCH_OP_UPDATE;
+        } else if (strcmp(name, "has") == 0) {
+            trace_op->op = BENCH_OP_HAS;
+        } else if (strcmp(name, "drop") == 0) {
+            trace_op->op = BENCH_OP_DELETE;
+        } else {
+            continue;
+        }
+        if (size == 0 || size > bench.value_size) {
+            size = bench.value_size;
+        }
+        trace_op->value_size = size;
+        bench.trace_num++;
+    }
+    fclose(file);
+
+    return bench.trace_num != 0 ? 0 : -1;
+}
+
+static void report(const char *workload, const char *mode, bench_thread *threads, double secs) {
+    static bkvs_u64 hist[BENCH_OP_NUM + 1][BENCH_LAT_BUCKET_NUM];
+    bkvs_u64 max[BENCH_OP_NUM + 1];
+    bkvs_u64 count[BENCH_OP_NUM + 1];
+
+    /* merge the threads, the last row sums up all the operations. */
+    memset(hist, 0, sizeof(hist));
+    memset(max, 0, sizeof(max));
+    memset(count, 0, sizeof(count));
+    for (bkvs_u32 t = 0; t < bench.thread_num; t++) {
+        for (bkvs_u32 op = 0; op < BENCH_OP_NUM; op++) {
+            for (bkvs_u32 i = 0; i < BENCH_LAT_BUCKET_NUM; i++) {
+                hist[op][i] += threads[t].hist[op][i];
+                hist[BENCH_OP_NUM][i] += threads[t].hist[op][i];
+                count[op] += threads[t].hist[op][i];
+            }
+            if (threads[t].max[op] > max[op]) {
+                max[op] = threads[t].max[op];
+            }
+            if (threads[t].max[op] > max[BENCH_OP_NUM]) {
+                max[BENCH_OP_NUM] = threads[t].max[op];
+            }
+        }
+    }
+    for (bkvs_u32 op = 0; op < BENCH_OP_NUM; op++) {
+        count[BENCH_OP_NUM] += count[op];
+    }
+
+    for (bkvs_u32 op = 0; op <= BENCH_OP_NUM; op++) {
+        bkvs_u64 ranks[3];
+        bkvs_u64 values[3] = {0, 0, 0};
+        bkvs_u64 sum;
+        bkvs_u32 rank_idx;
+
+        if (count[op] == 0) {
+            continue;
+        }
+        ranks[0] = count[op] - count[op] * 500 / 1000;
+        ranks[1] = count[op] - count[op] * 10 / 1000;
+        ranks[2] = count[op] - count[op] * 1 / 1000;
+        sum = 0;
+        rank_idx = 0;
+        for (bkvs_u32 i = 0; i < BENCH_LAT_BUCKET_NUM && rank_idx < 3; i++) {
+            sum += hist[op][i];
+            while (rank_idx < 3 && sum >= ranks[rank_idx]) {
+                values[rank_idx++] = lat_value(i) < max[op] ? lat_value(i) : max[op];
+            }
+        }
+        printf("%s,%s,%u,%u,%llu,%s,%llu,%.3f,%.0f,%llu,%llu,%llu,%llu\n", workload, mode,
+               bench.thread_num, bench.stripe_num, (unsigned long long)bench.record_num,
+               op < BENCH_OP_NUM ? op_names[op] : "all", (unsigned long long)count[op],
+               secs, count[op] / secs, (unsigned long long)values[0],
+               (unsigned long long)values[1], (unsigned long long)values[2],
+               (unsigned long long)max[op]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench_thread *threads;
+    const char *trace_path = NULL;
+    const char *mode = "global";
+    char workload[2] = "a";
+    char key[BENCH_KEY_SIZE];
+    bkvs_u32 bucket_num = 0;
+    bkvs_u32 stripe_num = 0;
+    double theta = 0.99;
+    bkvs_conf conf;
+    bkvs_u8 *value;
+    bkvs_u64 start;
+    double secs;
+    int res;
+
+    bench.record_num = 100000;
+    bench.op_num = 1000000;
+    bench.thread_num = 1;
+    bench.value_size = 100;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-w") == 0) {
+            workload[0] = argv[i + 1][0];
+        } else if (strcmp(argv[i], "-n") == 0) {
+            bench.record_num = strtoull(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            bench.op_num = strtoull(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-t") == 0) {
+            bench.thread_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            theta = strtod(argv[i + 1], NULL);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            bench.value_size = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            bucket_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-m") == 0) {
+            mode = argv[i + 1];
+        } else if (strcmp(argv[i], "-S") == 0) {
+            stripe_num = strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "-T") == 0) {
+            trace_path = argv[i + 1];
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+
+            return 1;
+        }
+    }
+    for (bkvs_u32 i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+        if (workloads[i].name == workload[0]) {
+            bench.workload = &workloads[i];
+        }
+    }
+    if (bench.workload == NULL || bench.record_num == 0 || bench.thread_num == 0 ||
+        bench.value_size == 0 || theta < 0 || theta >= 1) {
+        fprintf(stderr, "bad workload, record, thread, value size or skew setting\n");
+
+        return 1;
+    }
+    if (strcmp(mode, "global") == 0) {
+        bench.stripe_num = 1;
+    } else if (strcmp(mode, "striped") == 0) {
+        bench.stripe_num = stripe_num != 0 ? stripe_num : bench.thread_num * 16;
+    } else {
+        fprintf(stderr, "unknown mode: %s\n", mode);
+
+        return 1;
+    }
+    if (trace_path != NULL) {
+        if (load_trace(trace_path) != 0) {
+            fprintf(stderr, "failed to read trace: %s\n", trace_path);
+
+            return 1;
+        }
+        bench.record_num = bench.trace_num;
+    }
+
+    /* every set gets its share of the buckets. */
+    if (bucket_num == 0) {
+        bucket_num = bench.record_num;
+    }
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = bucket_num / bench.stripe_num + 1;
+    bench.sets = (bkvs_ctx **)calloc(bench.stripe_num, sizeof(bkvs_ctx *));
+    bench.locks = (pthread_mutex_t *)calloc(bench.stripe_num, sizeof(pthread_mutex_t));
+    threads = (bench_thread *)calloc(bench.thread_num, sizeof(bench_thread));
+    value = (bkvs_u8 *)calloc(1, bench.value_size);
+    if (bench.sets == NULL || bench.locks == NULL || threads == NULL || value == NULL) {
+        fprintf(stderr, "out of memory\n");
+
+        return 1;
+    }
+    for (bkvs_u32 i = 0; i < bench.stripe_num; i++) {
+        pthread_mutex_init(&bench.locks[i], NULL);
+        if (bkvs_new(&bench.sets[i], &conf) != BKVS_OK) {
+            fprintf(stderr, "failed to create the set\n");
+
+            return 1;
+        }
+    }
+
+    /* load the records, a trace brings its own. */
+    printf("workload,mode,threads,stripes,records,op,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+    if (trace_path == NULL) {
+        start = now_ns();
+        for (bkvs_u64 i = 0; i < bench.record_num; i++) {
+            record_key(key, i);
+            if (do_put(key, value, bench.value_size) != BKVS_OK) {
+                fprintf(stderr, "failed to load the records\n");
+
+                return 1;
+            }
+        }
+        secs = (now_ns() - start) * 1e-9;
+        printf("load,%s,1,%u,%llu,insert,%llu,%.3f,%.0f,,,,\n", mode, bench.stripe_num,
+               (unsigned long long)bench.record_num, (unsigned long long)bench.record_num,
+               secs, bench.record_num / secs);
+        bench.insert_next = bench.record_num;
+        zipf_init(&bench.zipf, bench.record_num, theta);
+    }
+
+    /* run. */
+    start = now_ns();
+    for (bkvs_u32 i = 0; i < bench.thread_num; i++) {
+        threads[i].idx = i;
+        threads[i].rand_state = 0x9e3779b97f4a7c15ULL * (i + 1);
+        if (pthread_create(&threads[i].thread, NULL, trace_path != NULL ? run_trace : run_workload,
+                           &threads[i]) != 0) {
+            fprintf(stderr, "failed to start thread\n");
+
+            return 1;
+        }
+    }
+    res = 0;
+    for (bkvs_u32 i = 0; i < bench.thread_num; i++) {
+        pthread_join(threads[i].thread, NULL);
+        res |= threads[i].res;
+    }
+    secs = (now_ns() - start) * 1e-9;
+    if (res != 0) {
+        fprintf(stderr, "benchmark failed\n");
+
+        return 1;
+    }
+    report(trace_path != NULL ? "trace" : workload, mode, threads, secs);
+
+    for (bkvs_u32 i = 0; i < bench.stripe_num; i++) {
+        bkvs_del(bench.sets[i]);
+        pthread_mutex_destroy(&bench.locks[i]);
+    }
+    free(bench.sets);
+    free(bench.locks);
+    free(bench.trace);
+    free(threads);
+    free(value);
+
+    return 0;
+}
@@ -22,12 +22,482 @@
  * SOFTWARE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#ifndef BKVS_NO_POSIX
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+
+#include <sys/syscall.h>
+
+#endif
+
+#endif
+
+#if !defined(BKVS_NO_SIMD) && defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+/* AVX2 variants are compiled in and picked at runtime. */
+#define BKVS_SIMD_AVX2
+
+#endif
+
+#define BKVS_SIMD_SSE2
+
+#elif !defined(BKVS_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#define BKVS_SIMD_NEON
+
+#endif
 
 #include "bufferkvs.h"
 #include "bufferqueue.h"
 
+/* state handed to the queue callbacks is kept per thread, so that distinct
+   sets can be used from distinct threads. */
+#if defined(BKVS_NO_THREAD)
+#define BKVS_THREAD_LOCAL
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define BKVS_THREAD_LOCAL   _Thread_local
+#elif defined(__GNUC__)
+#define BKVS_THREAD_LOCAL   __thread
+#else
+#define BKVS_THREAD_LOCAL
+#endif
+
+#ifdef BKVS_MEM_ACCOUNT
+
+/* size header in front of each counted block, keeping the alignment of malloc. */
+#define BKVS_MEM_HEAD_SIZE      16
+
+/* live blocks allocated by all the sets, bufferqueue nodes not included. */
+static bkvs_u64 mem_size = 0;
+static bkvs_u64 mem_num = 0;
+
+static void mem_count(bkvs_s64 size, bkvs_s64 num) {
+#if defined(__GNUC__)
+    __atomic_add_fetch(&mem_size, (bkvs_u64)size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mem_num, (bkvs_u64)num, __ATOMIC_RELAXED);
+#else
+    mem_size += (bkvs_u64)size;
+    mem_num += (bkvs_u64)num;
+#endif
+}
+
+static inline void *mem_malloc(size_t size) {
+    bkvs_u8 *ptr;
+
+    ptr = (bkvs_u8 *)malloc(size + BKVS_MEM_HEAD_SIZE);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    memcpy(ptr, &size, sizeof(size));
+    mem_count((bkvs_s64)size, 1);
+
+    return ptr + BKVS_MEM_HEAD_SIZE;
+}
+
+static inline void *mem_calloc(size_t num, size_t size) {
+    void *ptr;
+
+    if (size != 0 && num > (size_t)-1 / size) {
+        return NULL;
+    }
+    ptr = mem_malloc(num * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, num * size);
+    }
+
+    return ptr;
+}
+
+static inline void *mem_realloc(void *ptr, size_t size) {
+    bkvs_u8 *base;
+    size_t old_size;
+
+    if (ptr == NULL) {
+        return mem_malloc(size);
+    }
+    base = (bkvs_u8 *)ptr - BKVS_MEM_HEAD_SIZE;
+    memcpy(&old_size, base, sizeof(old_size));
+    base = (bkvs_u8 *)realloc(base, size + BKVS_MEM_HEAD_SIZE);
+    if (base == NULL) {
+        return NULL;
+    }
+    memcpy(base, &size, sizeof(size));
+    mem_count((bkvs_s64)size - (bkvs_s64)old_size, 0);
+
+    return base + BKVS_MEM_HEAD_SIZE;
+}
+
+static inline void mem_free(void *ptr) {
+    bkvs_u8 *base;
+    size_t size;
+
+    if (ptr == NULL) {
+        return;
+    }
+    base = (bkvs_u8 *)ptr - BKVS_MEM_HEAD_SIZE;
+    memcpy(&size, base, sizeof(size));
+    mem_count(-(bkvs_s64)size, -1);
+    free(base);
+}
+
+/**
+ * @brief get the memory held by all the sets, as counted by the accounting mode.
+ * 
+ * @param size total size of the live blocks.
+ * @param num number of the live blocks.
+*/
+bkvs_res bkvs_mem_usage(bkvs_u64 *size, bkvs_u64 *num) {
+    BKVS_ASSERT(size != NULL);
+    BKVS_ASSERT(num != NULL);
+
+#if defined(__GNUC__)
+    *size = __atomic_load_n(&mem_size, __ATOMIC_RELAXED);
+    *num = __atomic_load_n(&mem_num, __ATOMIC_RELAXED);
+#else
+    *size = mem_size;
+    *num = mem_num;
+#endif
+
+    return BKVS_OK;
+}
+
+/* every allocation below goes through the counting wrappers. */
+#define malloc(size)            mem_malloc(size)
+#define calloc(num, size)       mem_calloc(num, size)
+#define realloc(ptr, size)      mem_realloc(ptr, size)
+#define free(ptr)               mem_free(ptr)
+
+#else
+
+bkvs_res bkvs_mem_usage(bkvs_u64 *size, bkvs_u64 *num) {
+    return BKVS_ERR;
+}
+
+#endif
+
+#if !defined(BKVS_NO_POSIX) && defined(SYS_mbind) && defined(SYS_getcpu)
+
+/* memory policy preferring one node, as defined by the kernel. */
+#define BKVS_MPOL_PREFERRED     1
+
+/**
+ * @brief prefer a NUMA node for the pages of a block not touched yet.
+ * 
+ * only the whole pages inside the block are bound, the first touch of the
+ * calling thread places the rest. the binding is a hint, a failure is ignored.
+ * 
+ * @param numa_node node plus one, 0 to leave the block alone.
+ * @param ptr block pointer.
+ * @param size size of the block.
+*/
+static void numa_bind(bkvs_u32 numa_node, void *ptr, size_t size) {
+    unsigned long mask[BKVS_NUMA_NODE_MAX / (8 * sizeof(unsigned long))];
+    uintptr_t page;
+    uintptr_t start;
+    uintptr_t end;
+
+    if (numa_node == 0 || numa_node > BKVS_NUMA_NODE_MAX || ptr == NULL) {
+        return;
+    }
+    page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    start = ((uintptr_t)ptr + page - 1) & ~(page - 1);
+    end = ((uintptr_t)ptr + size) & ~(page - 1);
+    if (end <= start) {
+        return;
+    }
+    memset(mask, 0, sizeof(mask));
+    mask[(numa_node - 1) / (8 * sizeof(unsigned long))] = 1UL << ((numa_node - 1) % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, (void *)start, (unsigned long)(end - start), BKVS_MPOL_PREFERRED, mask,
+            (unsigned long)BKVS_NUMA_NODE_MAX + 1, 0);
+}
+
+/**
+ * @brief get the NUMA node of the CPU the calling thread runs on.
+ * 
+ * @param node node index, to be passed as `BKVS_NUMA_NODE(node)`.
+*/
+bkvs_res bkvs_numa_node(bkvs_u32 *node) {
+    unsigned int cpu;
+    unsigned int got;
+
+    BKVS_ASSERT(node != NULL);
+
+    if (syscall(SYS_getcpu, &cpu, &got, NULL) != 0) {
+        return BKVS_ERR;
+    }
+    *node = got;
+
+    return BKVS_OK;
+}
+
+#else
+
+static void numa_bind(bkvs_u32 numa_node, void *ptr, size_t size) {
+}
+
+bkvs_res bkvs_numa_node(bkvs_u32 *node) {
+    return BKVS_ERR;
+}
+
+#endif
+
+/* probe index of a bucket, one tag byte and the address of each queued pair, in queue order.
+   the tags follow the pair addresses in the same block. a bucket grown past `BKVS_SORT_MIN`
+   pairs also keeps `order`, the pair indexes sorted by hash and key, NULL otherwise. */
+typedef struct _bkvs_probe {
+    struct _bkvs_pair **pairs;
+    bkvs_u8 *tags;
+    bkvs_u32 *order;
+    bkvs_u32 num;
+    bkvs_u32 cap;
+} bkvs_probe;
+
+/* number of the pairs in a bucket of the cuckoo engine. */
+#define BKVS_CUCKOO_WAYS        4
+
+/* size of a cache line, which the buckets of the cuckoo engine are aligned to. */
+#define BKVS_CUCKOO_LINE        64
+
+/* most pairs of the cuckoo engine kept outside their buckets, searched on every miss. */
+#define BKVS_CUCKOO_STASH_MAX   8
+
+/* bucket of the cuckoo engine, the hashes of its pairs first, padded to one cache line.
+   an empty slot has a NULL pair. */
+typedef struct _bkvs_cuckoo_bucket {
+    bkvs_u32 hashes[BKVS_CUCKOO_WAYS];
+    struct _bkvs_pair *pairs[BKVS_CUCKOO_WAYS];
+    bkvs_u8 pad[BKVS_CUCKOO_LINE - (sizeof(bkvs_u32) + sizeof(void *)) * BKVS_CUCKOO_WAYS];
+} bkvs_cuckoo_bucket;
+
+/* step of the search for a free slot, reached by moving the pair in `slot` of the parent's bucket. */
+typedef struct _bkvs_cuckoo_step {
+    bkvs_u32 bucket_idx;
+    bkvs_u16 parent;
+    bkvs_u8 slot;
+} bkvs_cuckoo_step;
+
+/* find the first tag equal to `tag` from index `from`, `num` if there is none. */
+typedef bkvs_u32 (*bkvs_probe_find)(const bkvs_u8 *tags, bkvs_u32 num, bkvs_u8 tag, bkvs_u32 from);
+
+/* compare two keys of the same size. */
+typedef int (*bkvs_key_equal)(const char *key1, const char *key2, bkvs_u32 size);
+
+/* keys up to this size, terminator included, are kept inside the pair record. */
+#define BKVS_PAIR_INLINE_KEY_SIZE       16
+
+/* values up to this size are kept inside the pair record. */
+#define BKVS_PAIR_INLINE_VALUE_SIZE     8
+
+/* pair of the key-value. */
+typedef struct _bkvs_pair {
+    bkvs_u32 key_size;
+    bkvs_u32 value_size;
+    char *key;
+    char *value;
+
+    /* hash of the key. */
+    bkvs_u32 hash;
+
+    /* eviction segment the pair belongs to. */
+    bkvs_u8 seg;
+
+    /* flags of the pair, see `enum _bkvs_pair_flag`. */
+    bkvs_u8 flags;
+
+    /* neighbours in the eviction segment, `prev` is more recently used. */
+    struct _bkvs_pair *prev;
+    struct _bkvs_pair *next;
+
+    /* inline storage of the short key, or the shared prefix and the short suffix of a prefix key. */
+    union {
+        char key_buff[BKVS_PAIR_INLINE_KEY_SIZE];
+        struct {
+            struct _bkvs_key_prefix *prefix;
+            char suffix_buff[BKVS_PAIR_INLINE_KEY_SIZE - sizeof(void *)];
+        };
+    };
+
+    /* inline storage of the short value, 8-byte aligned. */
+    char value_buff[BKVS_PAIR_INLINE_VALUE_SIZE];
+} bkvs_pair;
+
+/* flags of the pair. */
+enum _bkvs_pair_flag {
+
+    /* key lives in an arena block and must not be freed alone. */
+    BKVS_PAIR_ARENA_KEY     = 0x01,
+
+    /* value lives in an arena block and must not be freed alone. */
+    BKVS_PAIR_ARENA_VALUE   = 0x02,
+
+    /* key lives in `key_buff` of the pair. */
+    BKVS_PAIR_INLINE_KEY    = 0x04,
+
+    /* value lives in `value_buff` of the pair. */
+    BKVS_PAIR_INLINE_VALUE  = 0x08,
+
+    /* `key` is the suffix following `prefix`, it lives in `suffix_buff` if also inline. */
+    BKVS_PAIR_PREFIX_KEY    = 0x10,
+
+    /* value is compressed, `value_size` is the size of the compressed block. */
+    BKVS_PAIR_PACKED_VALUE  = 0x20,
+};
+
+/* key or value that is not a block of its own. */
+#define BKVS_PAIR_SHARED_KEY    (BKVS_PAIR_ARENA_KEY | BKVS_PAIR_INLINE_KEY)
+#define BKVS_PAIR_SHARED_VALUE  (BKVS_PAIR_ARENA_VALUE | BKVS_PAIR_INLINE_VALUE)
+
+/* key prefix shared by the pairs, in the prefix key mode. */
+typedef struct _bkvs_key_prefix {
+    struct _bkvs_key_prefix *next;
+    bkvs_u32 hash;
+
+    /* number of the pairs using the prefix. */
+    bkvs_u32 ref;
+
+    /* size of the prefix, which has no terminator. */
+    bkvs_u32 size;
+    char data[];
+} bkvs_key_prefix;
+
+/* types of the write-ahead log records. */
+enum _bkvs_wal_type {
+    BKVS_WAL_PUT        = 1,
+    BKVS_WAL_DROP       = 2,
+    BKVS_WAL_EMPTY      = 3,
+    BKVS_WAL_BATCH      = 4,
+};
+
+/* block of memory shared by many pairs, freed when the set is emptied. */
+typedef struct _bkvs_arena {
+    struct _bkvs_arena *next;
+    bkvs_u8 data[];
+} bkvs_arena;
+
+/* eviction segments. */
+enum _bkvs_seg {
+
+    /* admission window, the only segment used by plain LRU. */
+    BKVS_SEG_WINDOW     = 0,
+
+    /* main segment, pairs that have not been hit since admission. */
+    BKVS_SEG_PROBATION  = 1,
+
+    /* main segment, pairs that have been hit since admission. */
+    BKVS_SEG_PROTECTED  = 2,
+
+    BKVS_SEG_NUM        = 3,
+};
+
+/* LRU list of the pairs. */
+typedef struct _bkvs_lru {
+
+    /* most recently used pair. */
+    bkvs_pair *head;
+
+    /* least recently used pair. */
+    bkvs_pair *tail;
+
+    /* number of the pairs in the list. */
+    bkvs_u32 num;
+
+    /* maximum number of the pairs in the list. */
+    bkvs_u32 num_max;
+} bkvs_lru;
+
+/* copy of a bucket as it was before its first change after a point-in-time view was taken. */
+typedef struct _bkvs_snap_ver {
+
+    /* older copy of the same bucket. */
+    struct _bkvs_snap_ver *next;
+
+    /* next copy of any bucket, in the list of the set. */
+    struct _bkvs_snap_ver *link;
+
+    bkvs_u32 bucket_idx;
+
+    /* the copy serves the views of generation above `from` up to `upto`. */
+    bkvs_u32 from;
+    bkvs_u32 upto;
+
+    /* size of the whole block. */
+    bkvs_u64 size;
+
+    /* pairs of the bucket in queue order, their keys and values follow. */
+    bkvs_u32 num;
+    bkvs_pair pairs[];
+} bkvs_snap_ver;
+
+/* copy-on-write state of a bucket. */
+typedef struct _bkvs_cow {
+
+    /* generation of the newest view the bucket has been copied for. */
+    bkvs_u32 gen;
+
+    /* copies of the bucket, newest first. */
+    bkvs_snap_ver *vers;
+} bkvs_cow;
+
+/* point-in-time view of the set. */
+struct _bkvs_snap {
+    bkvs_ctx *ctx;
+
+    /* generation of the view, unique and increasing per set. */
+    bkvs_u32 gen;
+
+    /* number of the pairs when the view was taken. */
+    bkvs_u32 pair_num;
+
+    /* neighbours in the list of the views of the set, oldest first. */
+    struct _bkvs_snap *prev;
+    struct _bkvs_snap *next;
+};
+
+/* size of the header of a batched change: type, key size and value size. */
+#define BKVS_BATCH_OP_SIZE      9
+
+/* changes applied to a set all at once. */
+struct _bkvs_batch {
+
+    /* changes in the order they were added, encoded as the log records them. */
+    bkvs_u8 *data;
+    bkvs_u32 len;
+    bkvs_u32 cap;
+
+    /* number of the changes. */
+    bkvs_u32 num;
+};
+
+/* value a batched change replaced, to undo the change with. */
+typedef struct _bkvs_batch_undo {
+    const char *key;
+    void *value;
+    bkvs_u32 value_size;
+} bkvs_batch_undo;
+
+/* bits of the value kept by a latency bucket, 16 buckets per power of 2. */
+#define BKVS_LAT_SUB_BITS       4
+
+#define BKVS_LAT_BUCKET_NUM     ((64 - BKVS_LAT_SUB_BITS + 1) << BKVS_LAT_SUB_BITS)
+
 /* context of the buffer key-value set. */
 struct _bkvs_ctx {
     struct _bkvs_ctx_conf {
@@ -40,28 +510,257 @@ struct _bkvs_ctx {
 
         /* maximum number of the the key-value pairs. */
         bkvs_u32 pair_num_max;
+
+        /* eviction policy. */
+        bkvs_u32 evict_policy;
+
+        /* storage of the keys and the delimiter ending a shared prefix. */
+        bkvs_u32 key_mode;
+        char key_delim;
+
+        /* size from which values are compressed, 0 if disabled. */
+        bkvs_u32 compress_min_size;
+
+        /* whether the ordered index of the keys is kept. */
+        bkvs_u32 ordered_index;
+
+        /* storage engine of the pairs. */
+        bkvs_u32 engine;
+
+        /* merge callback function. */
+        bkvs_merge_cb merge_cb;
+
+        /* NUMA node plus one the large blocks are bound to, 0 if not bound. */
+        bkvs_u32 numa_node;
     } conf;
     struct _bkvs_ctx_cache {
 
         /* number of the the key-value pairs. */
         bkvs_u32 pair_num;
+
+        /* number of the pairs evicted so far. */
+        bkvs_u32 evict_num;
+
+        /* number of the lookups that found or missed the key. */
+        bkvs_u64 get_hit_num;
+        bkvs_u64 get_miss_num;
+        bkvs_u64 has_hit_num;
+        bkvs_u64 has_miss_num;
+
+        /* number and time of the value compressions and decompressions. */
+        bkvs_u64 compress_num;
+        bkvs_u64 compress_ns;
+        bkvs_u64 decompress_num;
+        bkvs_u64 decompress_ns;
     } cache;
+    struct _bkvs_ctx_evict {
+
+        /* eviction segments. */
+        bkvs_lru segs[BKVS_SEG_NUM];
+
+        /* count-min sketch, 16 4-bit counters per word. */
+        bkvs_u64 *sketch;
+
+        /* mask of the sketch word index. */
+        bkvs_u32 sketch_mask;
+
+        /* number of the increments since the last aging. */
+        bkvs_u32 sketch_add;
+
+        /* number of the increments that triggers aging. */
+        bkvs_u32 sketch_add_max;
+    } evict;
+    struct _bkvs_ctx_mem {
+
+        /* arena blocks holding loaded keys and values. */
+        bkvs_arena *arenas;
+    } mem;
+    struct _bkvs_ctx_keys {
+
+        /* hash table of the shared key prefixes. */
+        bkvs_key_prefix **prefixes;
+
+        /* mask of the prefix table index. */
+        bkvs_u32 prefix_mask;
+
+        /* number of the prefixes. */
+        bkvs_u32 prefix_num;
+
+        /* scratch buffer the prefix keys are joined into. */
+        char *buff;
+        bkvs_u32 buff_size;
+    } keys;
+    struct _bkvs_ctx_pack {
+
+        /* scratch buffer the values are compressed into. */
+        bkvs_u8 *buff;
+        bkvs_u32 buff_size;
+
+        /* scratch buffer the values are decompressed into. */
+        bkvs_u8 *value;
+        bkvs_u32 value_size;
+    } pack;
+    struct _bkvs_ctx_hash {
+
+        /* key of the hash of the buckets, random per set. */
+        bkvs_u64 seed[2];
+
+        /* whether the buckets use the keyed hash rather than `hash_cb`. */
+        bkvs_u32 seeded;
+
+        /* number of the times the buckets were rehashed with a new seed. */
+        bkvs_u32 rehash_num;
+    } hash;
+    struct _bkvs_ctx_merge {
+
+        /* scratch buffer the values are merged into. */
+        bkvs_u8 *buff;
+        bkvs_u32 buff_size;
+    } merge;
+    struct _bkvs_ctx_index {
+
+        /* root of the radix tree over the whole keys, NULL if empty. */
+        void *root;
+
+        /* number and total size of the tree nodes. */
+        bkvs_u32 node_num;
+        bkvs_u64 size;
+    } index;
+    struct _bkvs_ctx_cuckoo {
+
+        /* buckets of the cuckoo engine, aligned inside `block`, NULL for the other engines. */
+        bkvs_cuckoo_bucket *buckets;
+        void *block;
+
+        /* mask of the bucket index, one less than the number of the buckets. */
+        bkvs_u32 mask;
+
+        /* pairs left without a slot while the table was still sparse, searched last. */
+        struct _bkvs_pair *stash[BKVS_CUCKOO_STASH_MAX];
+        bkvs_u32 stash_num;
+    } cuckoo;
+    struct _bkvs_ctx_probe {
+
+        /* probe index of each bucket, placed after the buckets. */
+        bkvs_probe *groups;
+
+        /* tag matching and key comparing routines picked for the CPU. */
+        bkvs_probe_find find;
+        bkvs_key_equal equal;
+    } probe;
+    struct _bkvs_ctx_snap {
+
+        /* live point-in-time views, oldest first. */
+        struct _bkvs_snap *head;
+        struct _bkvs_snap *tail;
+
+        /* generation of the last view taken. */
+        bkvs_u32 gen;
+
+        /* copy-on-write state of each bucket, NULL while no view is live. */
+        bkvs_cow *cows;
+
+        /* all bucket copies, and their total size. */
+        bkvs_snap_ver *vers;
+        bkvs_u64 size;
+    } snap;
+    struct _bkvs_ctx_map {
+
+        /* mapped table file, NULL if the set is not mapped. */
+        bkvs_u8 *base;
+
+        /* size of the mapped table file. */
+        bkvs_u64 size;
+
+        /* offset of the bucket index. */
+        bkvs_u64 index_offset;
+    } map;
+    struct _bkvs_ctx_frozen {
+
+        /* 8-byte aligned records of the frozen pairs. */
+        bkvs_u8 *blob;
+
+        /* record offsets in 8-byte units, NULL if the set is not frozen. */
+        bkvs_u32 *slots;
+
+        /* displacement of each perfect hash bucket. */
+        bkvs_u16 *pilots;
+
+        /* number of the slots. */
+        bkvs_u32 slot_num;
+
+        /* number of the perfect hash buckets. */
+        bkvs_u32 pilot_num;
+
+        /* seed of the perfect hash. */
+        bkvs_u64 seed;
+    } frozen;
+    struct _bkvs_ctx_wal {
+
+        /* path of the log file, NULL if logging is disabled. */
+        char *path;
+
+        /* descriptor of the log file. */
+        int fd;
+
+        /* sync policy. */
+        bkvs_u32 sync;
+
+        /* number of the records per group commit. */
+        bkvs_u32 batch_num;
+
+        /* number of the records not synced yet. */
+        bkvs_u32 pending;
+
+        /* records not written yet. */
+        bkvs_u8 *buff;
+        bkvs_u32 len;
+
+        /* sequence number of the last change. */
+        bkvs_u64 seq;
+    } wal;
+    struct _bkvs_ctx_compact {
+
+        /* writer of the new snapshot, NULL if no compaction is running. */
+        struct _bkvs_writer *writer;
+
+        /* path of the new snapshot. */
+        char *path;
+
+        /* path the new snapshot is written to before being renamed. */
+        char *tmp_path;
+
+        /* path the log is rotated to until the compaction finishes. */
+        char *next_path;
+
+        /* next bucket to be written. */
+        bkvs_u32 cursor;
+
+        /* sequence number of the last change before the compaction. */
+        bkvs_u64 seq;
+    } compact;
+
+#ifdef BKVS_LATENCY
+
+    struct _bkvs_ctx_lat {
+
+        /* log-linear histograms of the latencies, per operation. */
+        bkvs_u64 hist[BKVS_OP_NUM][BKVS_LAT_BUCKET_NUM];
+
+        /* slowest call, per operation. */
+        bkvs_u64 max[BKVS_OP_NUM];
+    } lat;
+
+#endif
 
     /* buckets. */
     bque_ctx *buckets[];
 };
 
-/* pair of the key-value. */
-typedef struct _bkvs_pair {
-    bkvs_u32 key_size;
-    bkvs_u32 value_size;
-    char *key;
-    char *value;
-} bkvs_pair;
-
 typedef struct _bkvs_search_ctx {
     const char *key;
     bque_u32 key_size;
+    bkvs_u32 hash;
     bque_u32 bucket_idx;
     bque_u32 pair_idx;
     bque_buff buff;
@@ -95,54 +794,429 @@ bkvs_u32 bkvs_hash_cb_sdbm(const char *str) {
 
 #define BKVS_DEF_PAIR_NUM_MAX   1024
 
-static bkvs_search_ctx search_ctx = {0};
+#define BKVS_DEF_KEY_DELIM      ':'
 
-/**
- * @brief create a buffer key-value set.
- * 
- * @param ctx the address of the context pointer.
- * @param conf configuration pointer.
-*/
-bkvs_res bkvs_new(bkvs_ctx **ctx, bkvs_conf *conf) {
-    bkvs_ctx *alloc_ctx;
-    bkvs_hash_cb hash_cb;
-    bkvs_u32 bucket_num;
-    bkvs_u32 pair_num_max;
-    bkvs_u32 alloc_size;
+/* chains longer than this plus twice the average make the keyed buckets rehash with a new seed. */
+#define BKVS_CHAIN_GUARD        32
 
-    BKVS_ASSERT(ctx != NULL);
+/* buckets longer than this are searched by halves of their sorted order. */
+#define BKVS_SORT_MIN           64
 
-    /* configure context. */
-    if (conf != NULL) {
-        if (conf->hash_cb != NULL) {
-            hash_cb = conf->hash_cb;
-        } else {
-            hash_cb = BKVS_DEF_HASH_CB;
-        }
-        if (conf->bucket_num != 0) {
-            bucket_num = conf->bucket_num;
-        } else {
-            bucket_num = BKVS_DEF_BUCKET_NUM;
-        }
+/* sorted buckets shorter than this go back to the tag scan. */
+#define BKVS_SORT_MAX_DROP      32
+
+/* most steps of the search for a free slot of the cuckoo engine, a few levels of moves. */
+#define BKVS_CUCKOO_STEP_MAX    256
+
+/* parent of the first steps, which are the two buckets of the new key. */
+#define BKVS_CUCKOO_STEP_ROOT   0xffff
+
+/* most buckets of the hash engine. */
+#define BKVS_BUCKET_MAX         ((bkvs_u32)1 << 30)
+
+/* most buckets of the cuckoo engine. */
+#define BKVS_CUCKOO_BUCKET_MAX  ((bkvs_u32)1 << 28)
+
+/* initial number of the slots of the prefix table. */
+#define BKVS_PREFIX_SLOT_NUM    64
+
+/* percentage of the capacity given to the TinyLFU admission window. */
+#define BKVS_TLFU_WINDOW_PCT    1
+
+/* percentage of the TinyLFU main segment given to protected pairs. */
+#define BKVS_TLFU_PROTECTED_PCT 80
+
+/* sketch increments per counter word before all counters are halved. */
+#define BKVS_TLFU_SAMPLE_RATIO  10
+
+/* most counter words of the TinyLFU sketch, larger sets share the counters. */
+#define BKVS_TLFU_SKETCH_MAX    ((bkvs_u32)1 << 24)
+
+static BKVS_THREAD_LOCAL bkvs_search_ctx search_ctx = {0};
+
+static bkvs_res map_search(bkvs_ctx *ctx, const char *key, bkvs_pair *pair);
+
+static bkvs_res map_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb);
+
+static void map_del(bkvs_ctx *ctx);
+
+static bkvs_res frozen_search(bkvs_ctx *ctx, const char *key, bkvs_pair *pair);
+
+static bkvs_res frozen_next(bkvs_ctx *ctx, bkvs_u64 *offset, bkvs_pair *pair);
+
+static bkvs_res frozen_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb);
+
+static void frozen_free(bkvs_ctx *ctx);
+
+static bkvs_res map_status(bkvs_ctx *ctx, bkvs_stat *stat);
+
+static void frozen_status(bkvs_ctx *ctx, bkvs_stat *stat);
+
+static void empty_pairs(bkvs_ctx *ctx);
+
+static void probe_select(bkvs_ctx *ctx);
+
+static void hash_seed(bkvs_ctx *ctx);
+
+static void snap_prune(bkvs_ctx *ctx);
+
+static bkvs_u32 pair_value_size(const bkvs_pair *pair);
+
+static void put_u32(bkvs_u8 *ptr, bkvs_u32 val);
+
+static bkvs_u32 get_u32(const bkvs_u8 *ptr);
+
+static bque_res art_each(void *ptr, bque_res (*cb)(bque_buff *buff, bque_u32 idx, bque_u32 num));
+
+static bque_res bucket_each(bkvs_ctx *ctx, bkvs_u32 bucket_idx,
+                            bque_res (*cb)(bque_buff *buff, bque_u32 idx, bque_u32 num));
+
+static bkvs_res cuckoo_create(bkvs_ctx *ctx, bkvs_u32 bucket_num);
+
+static bque_res cuckoo_each(bkvs_ctx *ctx, bque_res (*cb)(bque_buff *buff, bque_u32 idx, bque_u32 num));
+
+static bkvs_res wal_open(bkvs_ctx *ctx, const char *path, bkvs_u32 sync, bkvs_u32 batch_num);
+
+static bkvs_res wal_append(bkvs_ctx *ctx, bkvs_u8 type, const char *key, const void *value, bkvs_u32 value_size);
+
+static void wal_close(bkvs_ctx *ctx);
+
+static void compact_abort(bkvs_ctx *ctx);
+
+static const bkvs_u64 sketch_seeds[4] = {
+    0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+    0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL,
+};
+
+static bkvs_u32 sketch_spread(bkvs_u32 x) {
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+    x = ((x >> 16) ^ x) * 0x45d9f3b;
+
+    return (x >> 16) ^ x;
+}
+
+static bkvs_u32 sketch_index(bkvs_ctx *ctx, bkvs_u32 spread, bkvs_u32 i) {
+    bkvs_u64 hash;
+
+    hash = (spread + sketch_seeds[i]) * sketch_seeds[i];
+    hash += hash >> 32;
+
+    return (bkvs_u32)hash & ctx->evict.sketch_mask;
+}
+
+/**
+ * @brief halve all the sketch counters so that old popularity fades out.
+ * 
+ * @param ctx context pointer.
+*/
+static void sketch_age(bkvs_ctx *ctx) {
+    for (bkvs_u32 i = 0; i <= ctx->evict.sketch_mask; i++) {
+        ctx->evict.sketch[i] = (ctx->evict.sketch[i] >> 1) & 0x7777777777777777ULL;
+    }
+    ctx->evict.sketch_add >>= 1;
+}
+
+static void sketch_add(bkvs_ctx *ctx, bkvs_u32 hash) {
+    bkvs_u32 spread;
+    bkvs_u32 start;
+    bkvs_u32 added;
+
+    spread = sketch_spread(hash);
+    start = (spread & 3) << 2;
+    added = 0;
+    for (bkvs_u32 i = 0; i < 4; i++) {
+        bkvs_u64 *word;
+        bkvs_u32 shift;
+
+        word = &ctx->evict.sketch[sketch_index(ctx, spread, i)];
+        shift = (start + i) << 2;
+        if (((*word >> shift) & 0xf) != 0xf) {
+            *word += (bkvs_u64)1 << shift;
+            added = 1;
+        }
+    }
+
+    if (added && ++ctx->evict.sketch_add >= ctx->evict.sketch_add_max) {
+        sketch_age(ctx);
+    }
+}
+
+static bkvs_u32 sketch_freq(bkvs_ctx *ctx, bkvs_u32 hash) {
+    bkvs_u32 spread;
+    bkvs_u32 start;
+    bkvs_u32 freq;
+
+    spread = sketch_spread(hash);
+    start = (spread & 3) << 2;
+    freq = 0xf;
+    for (bkvs_u32 i = 0; i < 4; i++) {
+        bkvs_u64 word;
+        bkvs_u32 count;
+
+        word = ctx->evict.sketch[sketch_index(ctx, spread, i)];
+        count = (word >> ((start + i) << 2)) & 0xf;
+        if (count < freq) {
+            freq = count;
+        }
+    }
+
+    return freq;
+}
+
+static void lru_unlink(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_lru *lru;
+
+    lru = &ctx->evict.segs[pair->seg];
+    if (pair->prev != NULL) {
+        pair->prev->next = pair->next;
+    } else {
+        lru->head = pair->next;
+    }
+    if (pair->next != NULL) {
+        pair->next->prev = pair->prev;
+    } else {
+        lru->tail = pair->prev;
+    }
+    pair->prev = NULL;
+    pair->next = NULL;
+    lru->num--;
+}
+
+static void lru_push(bkvs_ctx *ctx, bkvs_pair *pair, bkvs_u32 seg) {
+    bkvs_lru *lru;
+
+    lru = &ctx->evict.segs[seg];
+    pair->seg = seg;
+    pair->prev = NULL;
+    pair->next = lru->head;
+    if (lru->head != NULL) {
+        lru->head->prev = pair;
+    } else {
+        lru->tail = pair;
+    }
+    lru->head = pair;
+    lru->num++;
+}
+
+/**
+ * @brief create the eviction segments and the frequency sketch.
+ * 
+ * @param ctx context pointer.
+*/
+static bkvs_res create_evict(bkvs_ctx *ctx) {
+    bkvs_u32 pair_num_max;
+    bkvs_u32 window_num;
+    bkvs_u32 main_num;
+    bkvs_u32 word_num;
+    bkvs_u64 add_max;
+
+    pair_num_max = ctx->conf.pair_num_max;
+    if (ctx->conf.evict_policy == BKVS_EVICT_LRU) {
+        ctx->evict.segs[BKVS_SEG_WINDOW].num_max = pair_num_max;
+    } else if (ctx->conf.evict_policy == BKVS_EVICT_TINYLFU) {
+        window_num = pair_num_max / 100 * BKVS_TLFU_WINDOW_PCT;
+        if (window_num == 0) {
+            window_num = 1;
+        }
+        main_num = pair_num_max - window_num;
+        ctx->evict.segs[BKVS_SEG_WINDOW].num_max = window_num;
+        ctx->evict.segs[BKVS_SEG_PROTECTED].num_max = main_num / 100 * BKVS_TLFU_PROTECTED_PCT;
+        ctx->evict.segs[BKVS_SEG_PROBATION].num_max =
+            main_num - ctx->evict.segs[BKVS_SEG_PROTECTED].num_max;
+
+        /* one counter word per pair, rounded up to a power of two and capped. */
+        word_num = 1;
+        while (word_num < pair_num_max && word_num < BKVS_TLFU_SKETCH_MAX) {
+            word_num <<= 1;
+        }
+        ctx->evict.sketch = (bkvs_u64 *)calloc(word_num, sizeof(bkvs_u64));
+        if (ctx->evict.sketch == NULL) {
+            return BKVS_ERR_NO_MEM;
+        }
+        ctx->evict.sketch_mask = word_num - 1;
+        add_max = (bkvs_u64)pair_num_max * BKVS_TLFU_SAMPLE_RATIO;
+        ctx->evict.sketch_add_max = add_max > 0xffffffff ? 0xffffffff : (bkvs_u32)add_max;
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief record an access to the pair in its eviction segment.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer.
+*/
+static void evict_touch(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_lru *protected;
+    bkvs_pair *demoted;
+
+    if (ctx->conf.evict_policy == BKVS_EVICT_NONE) {
+        return;
+    }
+
+    lru_unlink(ctx, pair);
+    if (pair->seg != BKVS_SEG_PROBATION) {
+        lru_push(ctx, pair, pair->seg);
+
+        return;
+    }
+
+    /* a hit on probation promotes the pair to the protected segment. */
+    lru_push(ctx, pair, BKVS_SEG_PROTECTED);
+    protected = &ctx->evict.segs[BKVS_SEG_PROTECTED];
+    if (protected->num > protected->num_max) {
+        demoted = protected->tail;
+        lru_unlink(ctx, demoted);
+        lru_push(ctx, demoted, BKVS_SEG_PROBATION);
+    }
+}
+
+/**
+ * @brief create a buffer key-value set.
+ * 
+ * @param ctx the address of the context pointer.
+ * @param conf configuration pointer.
+*/
+bkvs_res bkvs_new(bkvs_ctx **ctx, bkvs_conf *conf) {
+    bkvs_ctx *alloc_ctx;
+    bkvs_hash_cb hash_cb;
+    bkvs_u32 bucket_num;
+    bkvs_u32 pair_num_max;
+    bkvs_u32 evict_policy;
+    bkvs_u32 key_mode;
+    char key_delim;
+    bkvs_u32 compress_min_size;
+    bkvs_u32 ordered_index;
+    bkvs_u32 engine;
+    bkvs_merge_cb merge_cb;
+    bkvs_u32 numa_node;
+    bkvs_u32 seeded;
+    bkvs_u32 cuckoo_num;
+    size_t alloc_size;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+
+    /* configure context, the default hash is keyed with a random seed. */
+    seeded = conf == NULL || conf->hash_cb == NULL;
+    if (conf != NULL) {
+        if (conf->hash_cb != NULL) {
+            hash_cb = conf->hash_cb;
+        } else {
+            hash_cb = BKVS_DEF_HASH_CB;
+        }
+        if (conf->bucket_num != 0) {
+            bucket_num = conf->bucket_num;
+        } else {
+            bucket_num = BKVS_DEF_BUCKET_NUM;
+        }
         pair_num_max = conf->pair_num_max;
+        evict_policy = conf->evict_policy;
+        key_mode = conf->key_mode;
+        if (conf->key_delim != '\0') {
+            key_delim = conf->key_delim;
+        } else {
+            key_delim = BKVS_DEF_KEY_DELIM;
+        }
+        compress_min_size = conf->compress_min_size;
+        ordered_index = conf->ordered_index;
+        engine = conf->engine;
+        merge_cb = conf->merge_cb;
+        numa_node = conf->numa_node;
     } else {
         hash_cb = BKVS_DEF_HASH_CB;
         bucket_num = BKVS_DEF_BUCKET_NUM;
         pair_num_max = BKVS_DEF_PAIR_NUM_MAX;
+        evict_policy = BKVS_EVICT_NONE;
+        key_mode = BKVS_KEY_PLAIN;
+        key_delim = BKVS_DEF_KEY_DELIM;
+        compress_min_size = 0;
+        ordered_index = 0;
+        engine = BKVS_ENGINE_HASH;
+        merge_cb = NULL;
+        numa_node = 0;
+    }
+    if (evict_policy > BKVS_EVICT_TINYLFU || key_mode > BKVS_KEY_PREFIX || engine > BKVS_ENGINE_CUCKOO ||
+        numa_node > BKVS_NUMA_NODE_MAX) {
+        return BKVS_ERR;
+    }
+
+    /* the tree engine keeps the pairs in the ordered index alone. */
+    if (engine == BKVS_ENGINE_ART) {
+        bucket_num = 0;
+        ordered_index = 1;
+    }
+
+    /* the cuckoo engine keeps them in a table of its own, a power of two buckets with room for `bucket_num`. */
+    cuckoo_num = 2;
+    if (engine == BKVS_ENGINE_CUCKOO) {
+        while (cuckoo_num < BKVS_CUCKOO_BUCKET_MAX && cuckoo_num * BKVS_CUCKOO_WAYS < bucket_num) {
+            cuckoo_num *= 2;
+        }
+        bucket_num = 0;
+    }
+    if (evict_policy != BKVS_EVICT_NONE && pair_num_max == 0) {
+        pair_num_max = BKVS_DEF_PAIR_NUM_MAX;
     }
 
-    /* allocate context. */
-    alloc_size = sizeof(bkvs_ctx) + sizeof(bque_ctx *) * bucket_num;
+    /* allocate context, refusing more buckets than the size can count. */
+    if (bucket_num > BKVS_BUCKET_MAX ||
+        bucket_num > ((size_t)-1 - sizeof(bkvs_ctx)) / (sizeof(bque_ctx *) + sizeof(bkvs_probe))) {
+        return BKVS_ERR;
+    }
+    alloc_size = sizeof(bkvs_ctx) + (sizeof(bque_ctx *) + sizeof(bkvs_probe)) * (size_t)bucket_num;
     alloc_ctx = (bkvs_ctx *)malloc(alloc_size);
     if (alloc_ctx == NULL) {
         return BKVS_ERR_NO_MEM;
     }
 
-    /* initialize context. */
-    memset(alloc_ctx, 0, sizeof(bkvs_ctx));
+    /* initialize context, the buckets are bound before their first touch. */
+    numa_bind(numa_node, alloc_ctx, alloc_size);
+    memset(alloc_ctx, 0, alloc_size);
     alloc_ctx->conf.hash_cb = hash_cb;
     alloc_ctx->conf.bucket_num = bucket_num;
     alloc_ctx->conf.pair_num_max = pair_num_max;
+    alloc_ctx->conf.evict_policy = evict_policy;
+    alloc_ctx->conf.key_mode = key_mode;
+    alloc_ctx->conf.key_delim = key_delim;
+    alloc_ctx->conf.compress_min_size = compress_min_size;
+    alloc_ctx->conf.ordered_index = ordered_index != 0;
+    alloc_ctx->conf.engine = engine;
+    alloc_ctx->conf.merge_cb = merge_cb;
+    alloc_ctx->conf.numa_node = numa_node;
+    alloc_ctx->hash.seeded = seeded;
+    if (seeded) {
+        hash_seed(alloc_ctx);
+    }
+    alloc_ctx->probe.groups = (bkvs_probe *)(alloc_ctx->buckets + bucket_num);
+    probe_select(alloc_ctx);
+
+    /* initialize eviction state. */
+    res = create_evict(alloc_ctx);
+    if (res != BKVS_OK) {
+        free(alloc_ctx);
+
+        return res;
+    }
+    if (engine == BKVS_ENGINE_CUCKOO) {
+        res = cuckoo_create(alloc_ctx, cuckoo_num);
+        if (res != BKVS_OK) {
+            bkvs_del(alloc_ctx);
+
+            return res;
+        }
+    }
+
+    /* replay and reopen the write-ahead log. */
+    if (conf != NULL && conf->wal_path != NULL) {
+        res = wal_open(alloc_ctx, conf->wal_path, conf->wal_sync, conf->wal_batch_num);
+        if (res != BKVS_OK) {
+            bkvs_del(alloc_ctx);
+
+            return res;
+        }
+    }
 
     /* output context. */
     *ctx = alloc_ctx;
@@ -158,8 +1232,37 @@ bkvs_res bkvs_new(bkvs_ctx **ctx, bkvs_conf *conf) {
 bkvs_res bkvs_del(bkvs_ctx *ctx) {
     BKVS_ASSERT(ctx != NULL);
 
-    /* delete key-value pair queues. */
-    bkvs_empty(ctx);
+    /* unmap the table file. */
+    if (ctx->map.base != NULL) {
+        map_del(ctx);
+        free(ctx);
+
+        return BKVS_OK;
+    }
+
+    /* flush and close the write-ahead log. */
+    wal_close(ctx);
+
+    /* delete key-value pair queues and the views. */
+    empty_pairs(ctx);
+    frozen_free(ctx);
+    while (ctx->snap.head != NULL) {
+        bkvs_snap *next;
+
+        next = ctx->snap.head->next;
+        free(ctx->snap.head);
+        ctx->snap.head = next;
+    }
+    ctx->snap.tail = NULL;
+    snap_prune(ctx);
+
+    /* free eviction state. */
+    free(ctx->evict.sketch);
+    free(ctx->keys.buff);
+    free(ctx->pack.buff);
+    free(ctx->pack.value);
+    free(ctx->merge.buff);
+    free(ctx->cuckoo.block);
 
     /* free context. */
     free(ctx);
@@ -167,322 +1270,6631 @@ bkvs_res bkvs_del(bkvs_ctx *ctx) {
     return BKVS_OK;
 }
 
-bkvs_res bkvs_status(bkvs_ctx *ctx, bkvs_stat *stat) {
+static bkvs_u64 clock_now(void) {
+    struct timespec ts;
+
+#ifndef BKVS_NO_POSIX
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+
+    return (bkvs_u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define BKVS_SIP_ROTL(x, b)     (((x) << (b)) | ((x) >> (64 - (b))))
+
+static void sip_round(bkvs_u64 *v) {
+    v[0] += v[1];
+    v[1] = BKVS_SIP_ROTL(v[1], 13) ^ v[0];
+    v[0] = BKVS_SIP_ROTL(v[0], 32);
+    v[2] += v[3];
+    v[3] = BKVS_SIP_ROTL(v[3], 16) ^ v[2];
+    v[0] += v[3];
+    v[3] = BKVS_SIP_ROTL(v[3], 21) ^ v[0];
+    v[2] += v[1];
+    v[1] = BKVS_SIP_ROTL(v[1], 17) ^ v[2];
+    v[2] = BKVS_SIP_ROTL(v[2], 32);
+}
+
+/**
+ * @brief SipHash-1-3 of the key, folded to 32 bits.
+ * 
+ * @param seed 128-bit key of the hash.
+ * @param key key string.
+ * @param len length of the key, without the terminator.
+*/
+static bkvs_u32 sip_hash(const bkvs_u64 *seed, const char *key, bkvs_u32 len) {
+    const bkvs_u8 *ptr;
+    bkvs_u64 v[4];
+    bkvs_u64 m;
+    bkvs_u32 left;
+
+    v[0] = seed[0] ^ 0x736f6d6570736575ULL;
+    v[1] = seed[1] ^ 0x646f72616e646f6dULL;
+    v[2] = seed[0] ^ 0x6c7967656e657261ULL;
+    v[3] = seed[1] ^ 0x7465646279746573ULL;
+    ptr = (const bkvs_u8 *)key;
+    for (left = len; left >= 8; left -= 8, ptr += 8) {
+        memcpy(&m, ptr, sizeof(m));
+        v[3] ^= m;
+        sip_round(v);
+        v[0] ^= m;
+    }
+    m = (bkvs_u64)len << 56;
+    for (bkvs_u32 i = 0; i < left; i++) {
+        m |= (bkvs_u64)ptr[i] << (8 * i);
+    }
+    v[3] ^= m;
+    sip_round(v);
+    v[0] ^= m;
+    v[2] ^= 0xff;
+    sip_round(v);
+    sip_round(v);
+    sip_round(v);
+    m = v[0] ^ v[1] ^ v[2] ^ v[3];
+
+    return (bkvs_u32)(m ^ (m >> 32));
+}
+
+/**
+ * @brief pick a new random seed of the keyed hash.
+ * 
+ * @param ctx context pointer.
+*/
+static void hash_seed(bkvs_ctx *ctx) {
+    static bkvs_u64 counter;
+    bkvs_u64 seed[2];
+    bkvs_u64 mix;
+    int got;
+
+    got = 0;
+#ifndef BKVS_NO_POSIX
+    {
+        int fd;
+
+        fd = open("/dev/urandom", O_RDONLY);
+        if (fd >= 0) {
+            got = read(fd, seed, sizeof(seed)) == (ssize_t)sizeof(seed);
+            close(fd);
+        }
+    }
+#endif
+
+    /* without a random source the clock, the address and a counter are mixed. */
+    if (!got) {
+        mix = clock_now() ^ (bkvs_u64)(uintptr_t)ctx ^ (++counter * 0x9e3779b97f4a7c15ULL);
+        for (bkvs_u32 i = 0; i < 2; i++) {
+            mix += 0x9e3779b97f4a7c15ULL;
+            seed[i] = mix;
+            seed[i] = (seed[i] ^ (seed[i] >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            seed[i] = (seed[i] ^ (seed[i] >> 27)) * 0x94d049bb133111ebULL;
+            seed[i] ^= seed[i] >> 31;
+        }
+    }
+    ctx->hash.seed[0] = seed[0];
+    ctx->hash.seed[1] = seed[1];
+}
+
+/**
+ * @brief hash of the key in the buckets of the set.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+ * @param len length of the key, without the terminator.
+*/
+static bkvs_u32 hash_key(bkvs_ctx *ctx, const char *key, bkvs_u32 len) {
+    if (ctx->hash.seeded) {
+        return sip_hash(ctx->hash.seed, key, len);
+    }
+
+    return ctx->conf.hash_cb(key);
+}
+
+#ifdef BKVS_LATENCY
+
+#define BKVS_LAT_START(start)           ((start) = clock_now())
+
+#define BKVS_LAT_STOP(ctx, op, start)   lat_record((ctx), (op), (start))
+
+static bkvs_u32 lat_bucket(bkvs_u64 value) {
+    bkvs_u32 msb;
+
+    if (value < (1 << (BKVS_LAT_SUB_BITS + 1))) {
+        return (bkvs_u32)value;
+    }
+#if defined(__GNUC__)
+    msb = 63 - __builtin_clzll(value);
+#else
+    for (msb = 63; (value >> msb) == 0; msb--);
+#endif
+
+    return ((msb - BKVS_LAT_SUB_BITS + 1) << BKVS_LAT_SUB_BITS) +
+        (bkvs_u32)((value >> (msb - BKVS_LAT_SUB_BITS)) & ((1 << BKVS_LAT_SUB_BITS) - 1));
+}
+
+/* highest value that falls into the bucket. */
+static bkvs_u64 lat_value(bkvs_u32 bucket_idx) {
+    bkvs_u32 shift;
+    bkvs_u64 sub;
+
+    if (bucket_idx < (1 << (BKVS_LAT_SUB_BITS + 1))) {
+        return bucket_idx;
+    }
+    shift = (bucket_idx >> BKVS_LAT_SUB_BITS) - 1;
+    sub = bucket_idx & ((1 << BKVS_LAT_SUB_BITS) - 1);
+
+    return (((1ULL << BKVS_LAT_SUB_BITS) + sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief count the latency of a call, safe to be called from many threads.
+ * 
+ * @param ctx context pointer.
+ * @param op operation, see `enum _bkvs_op`.
+ * @param start time the call started.
+*/
+static void lat_record(bkvs_ctx *ctx, bkvs_u32 op, bkvs_u64 start) {
+    bkvs_u64 value;
+    bkvs_u64 max;
+
+    value = clock_now() - start;
+#if defined(__GNUC__)
+    __atomic_fetch_add(&ctx->lat.hist[op][lat_bucket(value)], 1, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&ctx->lat.max[op], __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&ctx->lat.max[op], &max, value, 1,
+           __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#else
+    ctx->lat.hist[op][lat_bucket(value)]++;
+    max = ctx->lat.max[op];
+    if (value > max) {
+        ctx->lat.max[op] = value;
+    }
+#endif
+}
+
+/**
+ * @brief get the latency percentiles of an operation.
+ * 
+ * @param ctx context pointer.
+ * @param op operation, see `enum _bkvs_op`.
+ * @param stat latency to be filled.
+*/
+bkvs_res bkvs_latency(bkvs_ctx *ctx, bkvs_u32 op, bkvs_lat_stat *stat) {
+    bkvs_u64 hist[BKVS_LAT_BUCKET_NUM];
+    bkvs_u64 ranks[3];
+    bkvs_u64 *values[3];
+    bkvs_u64 count;
+    bkvs_u32 rank_idx;
+
     BKVS_ASSERT(ctx != NULL);
     BKVS_ASSERT(stat != NULL);
 
-    /* get status. */
-    stat->pair_num = ctx->cache.pair_num;
+    if (op >= BKVS_OP_NUM) {
+        return BKVS_ERR;
+    }
+
+    /* take a copy, the counters may move while they are read. */
+    memset(stat, 0, sizeof(bkvs_lat_stat));
+    for (bkvs_u32 i = 0; i < BKVS_LAT_BUCKET_NUM; i++) {
+#if defined(__GNUC__)
+        hist[i] = __atomic_load_n(&ctx->lat.hist[op][i], __ATOMIC_RELAXED);
+#else
+        hist[i] = ctx->lat.hist[op][i];
+#endif
+        stat->count += hist[i];
+    }
+    stat->max = ctx->lat.max[op];
+    if (stat->count == 0) {
+        return BKVS_OK;
+    }
+
+    /* walk up to the rank of each percentile. */
+    ranks[0] = stat->count - stat->count * 500 / 1000;
+    ranks[1] = stat->count - stat->count * 10 / 1000;
+    ranks[2] = stat->count - stat->count * 1 / 1000;
+    values[0] = &stat->p50;
+    values[1] = &stat->p99;
+    values[2] = &stat->p999;
+    count = 0;
+    rank_idx = 0;
+    for (bkvs_u32 i = 0; i < BKVS_LAT_BUCKET_NUM && rank_idx < 3; i++) {
+        count += hist[i];
+        while (rank_idx < 3 && count >= ranks[rank_idx]) {
+            *values[rank_idx] = lat_value(i) < stat->max ? lat_value(i) : stat->max;
+            rank_idx++;
+        }
+    }
 
     return BKVS_OK;
 }
 
-static bkvs_res create_pair_que(bque_ctx **ctx) {
-    bque_conf conf;
-    bque_res res;
+bkvs_res bkvs_latency_reset(bkvs_ctx *ctx) {
+    BKVS_ASSERT(ctx != NULL);
 
-    /* configure key-value pair queue. */
-    conf.buff_num_max = 0;
-    conf.buff_size_max = 0;
+    memset(&ctx->lat, 0, sizeof(ctx->lat));
 
-    /* create key-value pair queue. */
-    res = bque_new(ctx, &conf);
-    if (res != BQUE_OK) {
-        if (res == BQUE_ERR_NO_MEM) {
-            return BKVS_ERR_NO_MEM;
+    return BKVS_OK;
+}
+
+#else
+
+#define BKVS_LAT_START(start)           ((start) = 0)
+
+#define BKVS_LAT_STOP(ctx, op, start)   ((void)(start))
+
+bkvs_res bkvs_latency(bkvs_ctx *ctx, bkvs_u32 op, bkvs_lat_stat *stat) {
+    return BKVS_ERR;
+}
+
+bkvs_res bkvs_latency_reset(bkvs_ctx *ctx) {
+    return BKVS_ERR;
+}
+
+#endif
+
+/* estimated bookkeeping of the allocator per allocated block. */
+#define BKVS_STAT_ALLOC_HEAD    (2 * sizeof(size_t))
+
+static BKVS_THREAD_LOCAL bkvs_stat *stat_ctx = NULL;
+
+static void stat_chain(bkvs_stat *stat, bkvs_u32 len) {
+    stat->chain_hist[len < BKVS_STAT_CHAIN_NUM ? len : BKVS_STAT_CHAIN_NUM - 1]++;
+    if (len != 0) {
+        stat->bucket_used_num++;
+    }
+    if (len > stat->chain_max) {
+        stat->chain_max = len;
+    }
+}
+
+static bque_res stat_cb(bque_buff *buff, bque_u32 idx, bque_u32 num) {
+    bkvs_pair *pair;
+
+    pair = (bkvs_pair *)buff->ptr;
+    stat_ctx->key_size += pair->key_size;
+    stat_ctx->value_size += pair->value_size;
+    if ((pair->flags & BKVS_PAIR_PREFIX_KEY) != 0) {
+        stat_ctx->key_size -= pair->prefix->size;
+    }
+    if ((pair->flags & BKVS_PAIR_PACKED_VALUE) != 0) {
+        stat_ctx->packed_num++;
+        stat_ctx->packed_raw_size += pair_value_size(pair);
+        stat_ctx->packed_size += pair->value_size;
+    }
+
+    /* loaded keys and values share arena blocks, short ones sit in the record. */
+    if ((pair->flags & BKVS_PAIR_SHARED_KEY) == 0) {
+        stat_ctx->overhead_size += BKVS_STAT_ALLOC_HEAD;
+    }
+    if ((pair->flags & BKVS_PAIR_SHARED_VALUE) == 0) {
+        stat_ctx->overhead_size += BKVS_STAT_ALLOC_HEAD;
+    }
+
+    return BQUE_OK;
+}
+
+/**
+ * @brief get the status of the set.
+ * 
+ * the counters are kept on every call, while the occupancy and the sizes
+ * are gathered by walking the buckets, so this takes time linear in the
+ * number of the pairs.
+ * 
+ * @param ctx context pointer.
+ * @param stat status to be filled.
+*/
+bkvs_res bkvs_status(bkvs_ctx *ctx, bkvs_stat *stat) {
+    bque_stat mod_bque_stat;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(stat != NULL);
+
+    /* get status. */
+    memset(stat, 0, sizeof(bkvs_stat));
+    stat->pair_num = ctx->cache.pair_num;
+    stat->evict_num = ctx->cache.evict_num;
+    stat->rehash_num = ctx->hash.rehash_num;
+    stat->get_hit_num = ctx->cache.get_hit_num;
+    stat->get_miss_num = ctx->cache.get_miss_num;
+    stat->has_hit_num = ctx->cache.has_hit_num;
+    stat->has_miss_num = ctx->cache.has_miss_num;
+    stat->compress_num = ctx->cache.compress_num;
+    stat->compress_ns = ctx->cache.compress_ns;
+    stat->decompress_num = ctx->cache.decompress_num;
+    stat->decompress_ns = ctx->cache.decompress_ns;
+    stat->overhead_size = sizeof(bkvs_ctx) + BKVS_STAT_ALLOC_HEAD;
+
+    /* get occupancy and sizes. */
+    if (ctx->map.base != NULL) {
+        res = map_status(ctx, stat);
+        if (res != BKVS_OK) {
+            return res;
+        }
+    } else if (ctx->frozen.slots != NULL) {
+        frozen_status(ctx, stat);
+    } else {
+        stat->bucket_num = ctx->conf.bucket_num;
+        stat->overhead_size += sizeof(bque_ctx *) * ctx->conf.bucket_num;
+        stat_ctx = stat;
+        for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+            if (ctx->buckets[i] == NULL) {
+                stat_chain(stat, 0);
+                continue;
+            }
+            if (bque_status(ctx->buckets[i], &mod_bque_stat) != BQUE_OK) {
+                stat_ctx = NULL;
+
+                return BKVS_ERR;
+            }
+            stat_chain(stat, mod_bque_stat.buff_num);
+            bucket_each(ctx, i, stat_cb);
+
+            /* queue context, one node and one record per pair and the probe index. */
+            stat->overhead_size += (sizeof(bkvs_pair) + sizeof(void *) * 3 + BKVS_STAT_ALLOC_HEAD * 2) *
+                (bkvs_u64)mod_bque_stat.buff_num + 64;
+            stat->overhead_size += (sizeof(bkvs_pair *) + 1) * (bkvs_u64)ctx->probe.groups[i].cap +
+                BKVS_STAT_ALLOC_HEAD;
+            if (ctx->probe.groups[i].order != NULL) {
+                stat->bucket_sorted_num++;
+                stat->overhead_size += sizeof(bkvs_u32) * (bkvs_u64)ctx->probe.groups[i].cap + BKVS_STAT_ALLOC_HEAD;
+            }
+        }
+
+        /* records of the tree engine, one block per pair. */
+        if (ctx->conf.engine == BKVS_ENGINE_ART) {
+            art_each(ctx->index.root, stat_cb);
+            stat->overhead_size += (sizeof(bkvs_pair) + BKVS_STAT_ALLOC_HEAD) * (bkvs_u64)stat->pair_num;
+        }
+
+        /* buckets of the cuckoo engine, its stash and records, one block per pair. */
+        if (ctx->conf.engine == BKVS_ENGINE_CUCKOO) {
+            stat->bucket_num = ctx->cuckoo.mask + 1;
+            stat->stash_num = ctx->cuckoo.stash_num;
+            for (bkvs_u32 i = 0; i <= ctx->cuckoo.mask; i++) {
+                bkvs_u32 num;
+
+                num = 0;
+                for (bkvs_u32 j = 0; j < BKVS_CUCKOO_WAYS; j++) {
+                    num += ctx->cuckoo.buckets[i].pairs[j] != NULL;
+                }
+                stat_chain(stat, num);
+            }
+            cuckoo_each(ctx, stat_cb);
+            stat->overhead_size += sizeof(bkvs_cuckoo_bucket) * (bkvs_u64)stat->bucket_num + BKVS_CUCKOO_LINE +
+                BKVS_STAT_ALLOC_HEAD + (sizeof(bkvs_pair) + BKVS_STAT_ALLOC_HEAD) * (bkvs_u64)stat->pair_num;
+        }
+        stat_ctx = NULL;
+        for (bkvs_arena *arena = ctx->mem.arenas; arena != NULL; arena = arena->next) {
+            stat->overhead_size += sizeof(bkvs_arena) + BKVS_STAT_ALLOC_HEAD;
+        }
+        stat->overhead_size += ctx->index.size + BKVS_STAT_ALLOC_HEAD * (bkvs_u64)ctx->index.node_num;
+
+        /* bucket copies kept for the point-in-time views. */
+        if (ctx->snap.cows != NULL) {
+            stat->overhead_size += sizeof(bkvs_cow) * (bkvs_u64)ctx->conf.bucket_num + ctx->snap.size;
+        }
+
+        /* shared key prefixes. */
+        if (ctx->keys.prefixes != NULL) {
+            stat->prefix_num = ctx->keys.prefix_num;
+            stat->overhead_size += sizeof(bkvs_key_prefix *) * (ctx->keys.prefix_mask + 1) + BKVS_STAT_ALLOC_HEAD +
+                (sizeof(bkvs_key_prefix) + BKVS_STAT_ALLOC_HEAD) * (bkvs_u64)ctx->keys.prefix_num;
+            for (bkvs_u32 i = 0; i <= ctx->keys.prefix_mask; i++) {
+                for (bkvs_key_prefix *prefix = ctx->keys.prefixes[i]; prefix != NULL; prefix = prefix->next) {
+                    stat->key_size += prefix->size;
+                }
+            }
+        }
+    }
+    if (ctx->evict.sketch != NULL) {
+        stat->overhead_size += sizeof(bkvs_u64) * (ctx->evict.sketch_mask + 1);
+    }
+    if (stat->bucket_used_num != 0) {
+        stat->chain_mean = (double)stat->pair_num / stat->bucket_used_num;
+    }
+
+    return BKVS_OK;
+}
+
+static bkvs_u32 probe_find_scalar(const bkvs_u8 *tags, bkvs_u32 num, bkvs_u8 tag, bkvs_u32 from) {
+    for (; from < num; from++) {
+        if (tags[from] == tag) {
+            break;
+        }
+    }
+
+    return from;
+}
+
+static int key_equal_scalar(const char *key1, const char *key2, bkvs_u32 size) {
+    return memcmp(key1, key2, size) == 0;
+}
+
+#if defined(BKVS_SIMD_SSE2)
+
+static bkvs_u32 probe_find_sse2(const bkvs_u8 *tags, bkvs_u32 num, bkvs_u8 tag, bkvs_u32 from) {
+    __m128i needle;
+    bkvs_u32 mask;
+
+    needle = _mm_set1_epi8((char)tag);
+    for (; from + 16 <= num; from += 16) {
+        mask = (bkvs_u32)_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *)(tags + from)), needle));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+    }
+
+    return probe_find_scalar(tags, num, tag, from);
+}
+
+static int key_equal_sse2(const char *key1, const char *key2, bkvs_u32 size) {
+    for (; size >= 16; size -= 16, key1 += 16, key2 += 16) {
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)key1),
+                                             _mm_loadu_si128((const __m128i *)key2))) != 0xffff) {
+            return 0;
+        }
+    }
+
+    return memcmp(key1, key2, size) == 0;
+}
+
+#endif
+
+#if defined(BKVS_SIMD_AVX2)
+
+__attribute__((target("avx2")))
+static bkvs_u32 probe_find_avx2(const bkvs_u8 *tags, bkvs_u32 num, bkvs_u8 tag, bkvs_u32 from) {
+    __m256i needle;
+    bkvs_u32 mask;
+
+    needle = _mm256_set1_epi8((char)tag);
+    for (; from + 32 <= num; from += 32) {
+        mask = (bkvs_u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i *)(tags + from)), needle));
+        if (mask != 0) {
+            return from + __builtin_ctz(mask);
+        }
+    }
+
+    return probe_find_sse2(tags, num, tag, from);
+}
+
+__attribute__((target("avx2")))
+static int key_equal_avx2(const char *key1, const char *key2, bkvs_u32 size) {
+    for (; size >= 32; size -= 32, key1 += 32, key2 += 32) {
+        if ((bkvs_u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i *)key1),
+                _mm256_loadu_si256((const __m256i *)key2))) != 0xffffffff) {
+            return 0;
+        }
+    }
+
+    return memcmp(key1, key2, size) == 0;
+}
+
+#endif
+
+#if defined(BKVS_SIMD_NEON)
+
+static bkvs_u32 probe_find_neon(const bkvs_u8 *tags, bkvs_u32 num, bkvs_u8 tag, bkvs_u32 from) {
+    uint8x16_t needle;
+    bkvs_u64 mask;
+
+    /* narrow the byte mask to 4 bits per tag. */
+    needle = vdupq_n_u8(tag);
+    for (; from + 16 <= num; from += 16) {
+        mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(
+            vceqq_u8(vld1q_u8(tags + from), needle)), 4)), 0);
+        if (mask != 0) {
+            return from + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return probe_find_scalar(tags, num, tag, from);
+}
+
+static int key_equal_neon(const char *key1, const char *key2, bkvs_u32 size) {
+    for (; size >= 16; size -= 16, key1 += 16, key2 += 16) {
+        if (vminvq_u8(vceqq_u8(vld1q_u8((const uint8_t *)key1),
+                               vld1q_u8((const uint8_t *)key2))) != 0xff) {
+            return 0;
+        }
+    }
+
+    return memcmp(key1, key2, size) == 0;
+}
+
+#endif
+
+/**
+ * @brief pick the widest tag matching and key comparing routines the CPU runs.
+ * 
+ * @param ctx context pointer.
+*/
+static void probe_select(bkvs_ctx *ctx) {
+    ctx->probe.find = probe_find_scalar;
+    ctx->probe.equal = key_equal_scalar;
+#if defined(BKVS_SIMD_SSE2)
+    ctx->probe.find = probe_find_sse2;
+    ctx->probe.equal = key_equal_sse2;
+#endif
+#if defined(BKVS_SIMD_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        ctx->probe.find = probe_find_avx2;
+        ctx->probe.equal = key_equal_avx2;
+    }
+#endif
+#if defined(BKVS_SIMD_NEON)
+    ctx->probe.find = probe_find_neon;
+    ctx->probe.equal = key_equal_neon;
+#endif
+}
+
+/* tag of the hash, the bucket index is taken from its low bits. */
+static bkvs_u8 probe_tag(bkvs_u32 hash) {
+    return (bkvs_u8)(hash >> 24);
+}
+
+/**
+ * @brief make room for one more pair in the probe index of the bucket.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_idx bucket index.
+*/
+static bkvs_res probe_reserve(bkvs_ctx *ctx, bkvs_u32 bucket_idx) {
+    bkvs_probe *group;
+    bkvs_pair **pairs;
+    bkvs_u32 cap;
+
+    group = &ctx->probe.groups[bucket_idx];
+    if (group->num < group->cap) {
+        return BKVS_OK;
+    }
+    cap = group->cap != 0 ? group->cap * 2 : 2;
+    if (group->order != NULL) {
+        bkvs_u32 *order;
+
+        order = (bkvs_u32 *)realloc(group->order, sizeof(bkvs_u32) * cap);
+        if (order == NULL) {
+            return BKVS_ERR_NO_MEM;
+        }
+        group->order = order;
+    }
+    pairs = (bkvs_pair **)realloc(group->pairs, (sizeof(bkvs_pair *) + 1) * cap);
+    if (pairs == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+
+    /* move the tags behind the grown addresses. */
+    memmove(pairs + cap, pairs + group->cap, group->num);
+    group->pairs = pairs;
+    group->tags = (bkvs_u8 *)(pairs + cap);
+    group->cap = cap;
+
+    return BKVS_OK;
+}
+
+static void probe_remove(bkvs_ctx *ctx, bkvs_u32 bucket_idx, bkvs_u32 pair_idx) {
+    bkvs_probe *group;
+
+    group = &ctx->probe.groups[bucket_idx];
+    group->num--;
+    memmove(group->tags + pair_idx, group->tags + pair_idx + 1, group->num - pair_idx);
+    memmove(group->pairs + pair_idx, group->pairs + pair_idx + 1,
+            sizeof(bkvs_pair *) * (group->num - pair_idx));
+
+    /* the sorted order follows the indexes down, or is dropped once the bucket is short again. */
+    if (group->order != NULL && group->num < BKVS_SORT_MAX_DROP) {
+        free(group->order);
+        group->order = NULL;
+    } else if (group->order != NULL) {
+        bkvs_u32 k;
+
+        k = 0;
+        for (bkvs_u32 i = 0; i <= group->num; i++) {
+            if (group->order[i] != pair_idx) {
+                group->order[k++] = group->order[i] - (group->order[i] > pair_idx);
+            }
+        }
+    }
+}
+
+static void probe_free(bkvs_ctx *ctx) {
+    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+        free(ctx->probe.groups[i].pairs);
+        free(ctx->probe.groups[i].order);
+    }
+    memset(ctx->probe.groups, 0, sizeof(bkvs_probe) * ctx->conf.bucket_num);
+}
+
+static bkvs_u32 prefix_hash(const char *data, bkvs_u32 size) {
+    bkvs_u32 hash = 2166136261u;
+
+    for (bkvs_u32 i = 0; i < size; i++) {
+        hash = (hash ^ (bkvs_u8)data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief get the shared copy of a key prefix, adding it if it is new.
+ * 
+ * @param ctx context pointer.
+ * @param data prefix of the key.
+ * @param size size of the prefix.
+ * 
+ * @return the prefix with one more user, NULL if out of memory.
+*/
+static bkvs_key_prefix *prefix_acquire(bkvs_ctx *ctx, const char *data, bkvs_u32 size) {
+    bkvs_key_prefix **slots;
+    bkvs_key_prefix *prefix;
+    bkvs_u32 slot_num;
+    bkvs_u32 hash;
+
+    hash = prefix_hash(data, size);
+    if (ctx->keys.prefixes != NULL) {
+        for (prefix = ctx->keys.prefixes[hash & ctx->keys.prefix_mask]; prefix != NULL; prefix = prefix->next) {
+            if (prefix->hash == hash && prefix->size == size && memcmp(prefix->data, data, size) == 0) {
+                prefix->ref++;
+
+                return prefix;
+            }
+        }
+    }
+
+    /* grow the table to keep the chains short. */
+    if (ctx->keys.prefixes == NULL || ctx->keys.prefix_num > ctx->keys.prefix_mask) {
+        slot_num = ctx->keys.prefixes != NULL ? (ctx->keys.prefix_mask + 1) * 2 : BKVS_PREFIX_SLOT_NUM;
+        slots = (bkvs_key_prefix **)calloc(slot_num, sizeof(bkvs_key_prefix *));
+        if (slots == NULL) {
+            return NULL;
+        }
+        if (ctx->keys.prefixes != NULL) {
+            for (bkvs_u32 i = 0; i <= ctx->keys.prefix_mask; i++) {
+                while (ctx->keys.prefixes[i] != NULL) {
+                    prefix = ctx->keys.prefixes[i];
+                    ctx->keys.prefixes[i] = prefix->next;
+                    prefix->next = slots[prefix->hash & (slot_num - 1)];
+                    slots[prefix->hash & (slot_num - 1)] = prefix;
+                }
+            }
+            free(ctx->keys.prefixes);
+        }
+        ctx->keys.prefixes = slots;
+        ctx->keys.prefix_mask = slot_num - 1;
+    }
+
+    prefix = (bkvs_key_prefix *)malloc(sizeof(bkvs_key_prefix) + size);
+    if (prefix == NULL) {
+        return NULL;
+    }
+    memcpy(prefix->data, data, size);
+    prefix->hash = hash;
+    prefix->ref = 1;
+    prefix->size = size;
+    prefix->next = ctx->keys.prefixes[hash & ctx->keys.prefix_mask];
+    ctx->keys.prefixes[hash & ctx->keys.prefix_mask] = prefix;
+    ctx->keys.prefix_num++;
+
+    return prefix;
+}
+
+/**
+ * @brief drop one user of the prefix, freeing it once unused.
+ * 
+ * @param ctx context pointer.
+ * @param prefix prefix pointer.
+*/
+static void prefix_release(bkvs_ctx *ctx, bkvs_key_prefix *prefix) {
+    bkvs_key_prefix **link;
+
+    if (--prefix->ref != 0) {
+        return;
+    }
+    for (link = &ctx->keys.prefixes[prefix->hash & ctx->keys.prefix_mask]; *link != prefix;
+         link = &(*link)->next);
+    *link = prefix->next;
+    ctx->keys.prefix_num--;
+    free(prefix);
+}
+
+static void prefix_free(bkvs_ctx *ctx) {
+    bkvs_key_prefix *prefix;
+
+    if (ctx->keys.prefixes == NULL) {
+        return;
+    }
+    for (bkvs_u32 i = 0; i <= ctx->keys.prefix_mask; i++) {
+        while (ctx->keys.prefixes[i] != NULL) {
+            prefix = ctx->keys.prefixes[i];
+            ctx->keys.prefixes[i] = prefix->next;
+            free(prefix);
+        }
+    }
+    free(ctx->keys.prefixes);
+    ctx->keys.prefixes = NULL;
+    ctx->keys.prefix_mask = 0;
+    ctx->keys.prefix_num = 0;
+}
+
+/**
+ * @brief copy the whole key of the pair.
+ * 
+ * @param pair pair pointer.
+ * @param key buffer of at least `key_size` bytes.
+*/
+static void pair_key_copy(const bkvs_pair *pair, char *key) {
+    bkvs_u32 prefix_size;
+
+    prefix_size = 0;
+    if ((pair->flags & BKVS_PAIR_PREFIX_KEY) != 0) {
+        prefix_size = pair->prefix->size;
+        memcpy(key, pair->prefix->data, prefix_size);
+    }
+    memcpy(key + prefix_size, pair->key, pair->key_size - prefix_size);
+}
+
+/**
+ * @brief get the whole key of the pair, joining a prefix key in the scratch buffer.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer.
+ * 
+ * @return the key, valid until the next call, NULL if out of memory.
+*/
+static const char *pair_key(bkvs_ctx *ctx, const bkvs_pair *pair) {
+    char *buff;
+
+    if ((pair->flags & BKVS_PAIR_PREFIX_KEY) == 0) {
+        return pair->key;
+    }
+    if (ctx->keys.buff_size < pair->key_size) {
+        buff = (char *)realloc(ctx->keys.buff, pair->key_size);
+        if (buff == NULL) {
+            return NULL;
+        }
+        ctx->keys.buff = buff;
+        ctx->keys.buff_size = pair->key_size;
+    }
+    pair_key_copy(pair, ctx->keys.buff);
+
+    return ctx->keys.buff;
+}
+
+/* size of the header of a compressed value, which holds the original size. */
+#define BKVS_PACK_HEAD_SIZE     4
+
+/* bits of the match finder hash. */
+#define BKVS_LZ_HASH_BITS       12
+
+/* shortest match, the match length in a token is counted from it. */
+#define BKVS_LZ_MIN_MATCH       4
+
+/* the last bytes of the input are always literals. */
+#define BKVS_LZ_LAST_LITERALS   5
+
+/* no match starts in the last bytes of the input. */
+#define BKVS_LZ_MATCH_LIMIT     12
+
+#define BKVS_LZ_MAX_OFFSET      65535
+
+static bkvs_u32 lz_read32(const bkvs_u8 *ptr) {
+    bkvs_u32 val;
+
+    memcpy(&val, ptr, 4);
+
+    return val;
+}
+
+static bkvs_u32 lz_hash(bkvs_u32 seq) {
+    return (seq * 2654435761u) >> (32 - BKVS_LZ_HASH_BITS);
+}
+
+/**
+ * @brief write one sequence, literals followed by a match if `match_len` is not 0.
+ * 
+ * @return the new output size, 0 if the output is full.
+*/
+static bkvs_u32 lz_sequence(bkvs_u8 *dst, bkvs_u32 pos, bkvs_u32 cap, const bkvs_u8 *lit,
+                            bkvs_u32 lit_len, bkvs_u32 offset, bkvs_u32 match_len) {
+    bkvs_u8 *token;
+    bkvs_u32 len;
+
+    if ((bkvs_u64)pos + 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1 > cap) {
+        return 0;
+    }
+    token = dst + pos++;
+    *token = (bkvs_u8)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) {
+        for (len = lit_len - 15; len >= 255; len -= 255) {
+            dst[pos++] = 255;
+        }
+        dst[pos++] = (bkvs_u8)len;
+    }
+    memcpy(dst + pos, lit, lit_len);
+    pos += lit_len;
+    if (match_len == 0) {
+        return pos;
+    }
+
+    dst[pos++] = (bkvs_u8)offset;
+    dst[pos++] = (bkvs_u8)(offset >> 8);
+    len = match_len - BKVS_LZ_MIN_MATCH;
+    *token |= (bkvs_u8)(len < 15 ? len : 15);
+    if (len >= 15) {
+        for (len -= 15; len >= 255; len -= 255) {
+            dst[pos++] = 255;
+        }
+        dst[pos++] = (bkvs_u8)len;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief compress into the LZ4 block format with a greedy single-probe match finder.
+ * 
+ * @param src data to be compressed.
+ * @param size size of the data.
+ * @param dst output buffer.
+ * @param cap size of the output buffer.
+ * 
+ * @return size of the compressed data, 0 if it does not fit in `cap`.
+*/
+static bkvs_u32 lz_compress(const bkvs_u8 *src, bkvs_u32 size, bkvs_u8 *dst, bkvs_u32 cap) {
+    bkvs_u32 table[1 << BKVS_LZ_HASH_BITS];
+    bkvs_u32 anchor;
+    bkvs_u32 pos;
+    bkvs_u32 out;
+    bkvs_u32 seq;
+    bkvs_u32 hash;
+    bkvs_u32 match;
+    bkvs_u32 len;
+
+    memset(table, 0, sizeof(table));
+    anchor = 0;
+    out = 0;
+    for (pos = 0; (bkvs_u64)pos + BKVS_LZ_MATCH_LIMIT <= size;) {
+        seq = lz_read32(src + pos);
+        hash = lz_hash(seq);
+        match = table[hash];
+        table[hash] = pos;
+        if (match >= pos || pos - match > BKVS_LZ_MAX_OFFSET || lz_read32(src + match) != seq) {
+            pos++;
+            continue;
+        }
+
+        /* extend the match, leaving the last literals alone. */
+        for (len = BKVS_LZ_MIN_MATCH; pos + len < size - BKVS_LZ_LAST_LITERALS &&
+             src[match + len] == src[pos + len]; len++);
+        out = lz_sequence(dst, out, cap, src + anchor, pos - anchor, pos - match, len);
+        if (out == 0) {
+            return 0;
+        }
+        pos += len;
+        anchor = pos;
+    }
+
+    return lz_sequence(dst, out, cap, src + anchor, size - anchor, 0, 0);
+}
+
+static bkvs_res lz_length(const bkvs_u8 *src, bkvs_u32 size, bkvs_u32 *pos, bkvs_u32 *len) {
+    bkvs_u8 byte;
+
+    do {
+        if (*pos >= size) {
+            return BKVS_ERR;
+        }
+        byte = src[(*pos)++];
+        *len += byte;
+    } while (byte == 255 && *len < 0x7fffffff);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief decompress a LZ4 block, checking every length and offset.
+ * 
+ * @param src compressed data.
+ * @param size size of the compressed data.
+ * @param dst output buffer.
+ * @param raw_size size of the original data.
+*/
+static bkvs_res lz_decompress(const bkvs_u8 *src, bkvs_u32 size, bkvs_u8 *dst, bkvs_u32 raw_size) {
+    bkvs_u32 pos;
+    bkvs_u32 out;
+    bkvs_u32 len;
+    bkvs_u32 offset;
+    bkvs_u8 token;
+
+    pos = 0;
+    out = 0;
+    while (pos < size) {
+        token = src[pos++];
+        len = token >> 4;
+        if (len == 15 && lz_length(src, size, &pos, &len) != BKVS_OK) {
+            return BKVS_ERR;
+        }
+        if (len > size - pos || len > raw_size - out) {
+            return BKVS_ERR;
+        }
+        memcpy(dst + out, src + pos, len);
+        pos += len;
+        out += len;
+
+        /* the last sequence has no match. */
+        if (pos == size) {
+            break;
+        }
+        if (size - pos < 2) {
+            return BKVS_ERR;
+        }
+        offset = src[pos] | (bkvs_u32)src[pos + 1] << 8;
+        pos += 2;
+        len = token & 15;
+        if (len == 15 && lz_length(src, size, &pos, &len) != BKVS_OK) {
+            return BKVS_ERR;
+        }
+        len += BKVS_LZ_MIN_MATCH;
+        if (offset == 0 || offset > out || len > raw_size - out) {
+            return BKVS_ERR;
+        }
+
+        /* the match may overlap the bytes it produces, 8-byte steps are safe from an offset of 8. */
+        if (offset >= len) {
+            memcpy(dst + out, dst + out - offset, len);
+            out += len;
+        } else if (offset >= 8) {
+            for (; len >= 8; len -= 8, out += 8) {
+                memcpy(dst + out, dst + out - offset, 8);
+            }
+            for (; len != 0; len--, out++) {
+                dst[out] = dst[out - offset];
+            }
+        } else {
+            for (; len != 0; len--, out++) {
+                dst[out] = dst[out - offset];
+            }
+        }
+    }
+
+    return out == raw_size ? BKVS_OK : BKVS_ERR;
+}
+
+static bkvs_u32 pair_value_size(const bkvs_pair *pair) {
+    bkvs_u32 raw_size;
+
+    if ((pair->flags & BKVS_PAIR_PACKED_VALUE) == 0) {
+        return pair->value_size;
+    }
+    memcpy(&raw_size, pair->value, BKVS_PACK_HEAD_SIZE);
+
+    return raw_size;
+}
+
+/**
+ * @brief compress the value if it is large enough and compresses well.
+ * 
+ * @param ctx context pointer.
+ * @param buff value.
+ * @param size size of the value.
+ * @param packed the address of the compressed block, set to NULL if the value is kept as is.
+ * @param packed_size size of the compressed block.
+*/
+static bkvs_res pack_value(bkvs_ctx *ctx, const void *buff, bkvs_u32 size, char **packed,
+                           bkvs_u32 *packed_size) {
+    bkvs_u64 start;
+    bkvs_u32 lz_size;
+    bkvs_u8 *scratch;
+
+    *packed = NULL;
+    if (ctx->conf.compress_min_size == 0 || size < ctx->conf.compress_min_size ||
+        size <= BKVS_PAIR_INLINE_VALUE_SIZE + BKVS_PACK_HEAD_SIZE) {
+        return BKVS_OK;
+    }
+    if (ctx->pack.buff_size < size) {
+        scratch = (bkvs_u8 *)realloc(ctx->pack.buff, size);
+        if (scratch == NULL) {
+            return BKVS_ERR_NO_MEM;
+        }
+        ctx->pack.buff = scratch;
+        ctx->pack.buff_size = size;
+    }
+
+    /* only keep the compressed block if it is smaller. */
+    start = clock_now();
+    lz_size = lz_compress((const bkvs_u8 *)buff, size, ctx->pack.buff, size - BKVS_PACK_HEAD_SIZE - 1);
+    ctx->cache.compress_ns += clock_now() - start;
+    ctx->cache.compress_num++;
+    if (lz_size == 0) {
+        return BKVS_OK;
+    }
+    *packed = (char *)malloc(BKVS_PACK_HEAD_SIZE + lz_size);
+    if (*packed == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    memcpy(*packed, &size, BKVS_PACK_HEAD_SIZE);
+    memcpy(*packed + BKVS_PACK_HEAD_SIZE, ctx->pack.buff, lz_size);
+    *packed_size = BKVS_PACK_HEAD_SIZE + lz_size;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief copy the original value of the pair.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer.
+ * @param dst buffer of at least `pair_value_size()` bytes.
+*/
+static bkvs_res pair_value_copy(bkvs_ctx *ctx, const bkvs_pair *pair, void *dst) {
+    bkvs_u64 start;
+    bkvs_res res;
+
+    if ((pair->flags & BKVS_PAIR_PACKED_VALUE) == 0) {
+        memcpy(dst, pair->value, pair->value_size);
+
+        return BKVS_OK;
+    }
+    start = clock_now();
+    res = lz_decompress((const bkvs_u8 *)pair->value + BKVS_PACK_HEAD_SIZE,
+        pair->value_size - BKVS_PACK_HEAD_SIZE, (bkvs_u8 *)dst, pair_value_size(pair));
+    ctx->cache.decompress_ns += clock_now() - start;
+    ctx->cache.decompress_num++;
+
+    return res;
+}
+
+/**
+ * @brief get the original value of the pair.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer.
+ * @param buff value, pointing into the pair or into the scratch buffer of a
+ *             compressed value, which is valid until the next call.
+ * @param dst buffer the value is copied into, NULL to point at it if possible.
+ * @param dst_size size of `dst`.
+*/
+static bkvs_res pair_value(bkvs_ctx *ctx, const bkvs_pair *pair, bkvs_buff *buff, void *dst,
+                           bkvs_u32 dst_size) {
+    bkvs_u32 raw_size;
+    bkvs_u8 *scratch;
+    bkvs_res res;
+
+    raw_size = pair_value_size(pair);
+    buff->size = raw_size;
+    if (dst == NULL) {
+        if ((pair->flags & BKVS_PAIR_PACKED_VALUE) == 0) {
+            buff->ptr = (bkvs_u8 *)pair->value;
+
+            return BKVS_OK;
+        }
+        if (ctx->pack.value_size < raw_size) {
+            scratch = (bkvs_u8 *)realloc(ctx->pack.value, raw_size);
+            if (scratch == NULL) {
+                return BKVS_ERR_NO_MEM;
+            }
+            ctx->pack.value = scratch;
+            ctx->pack.value_size = raw_size;
+        }
+        dst = ctx->pack.value;
+    } else if (raw_size > dst_size) {
+        return BKVS_ERR_NO_ROOM;
+    }
+    res = pair_value_copy(ctx, pair, dst);
+    buff->ptr = (bkvs_u8 *)dst;
+
+    return res;
+}
+
+/* bytes of the compressed path kept in an index node, longer paths are checked at a leaf. */
+#define BKVS_ART_PREFIX_MAX     8
+
+/* index children that are pairs rather than nodes have the low bit set. */
+#define BKVS_ART_IS_LEAF(ptr)   (((uintptr_t)(ptr) & 1) != 0)
+#define BKVS_ART_LEAF(pair)     ((void *)((uintptr_t)(pair) | 1))
+#define BKVS_ART_PAIR(ptr)      ((bkvs_pair *)((uintptr_t)(ptr) & ~(uintptr_t)1))
+
+/* the walk went past the upper bound. */
+#define BKVS_ART_DONE           1
+
+/* types of the index nodes, by the number of the children they hold. */
+enum _bkvs_art_type {
+    BKVS_ART_NODE4      = 0,
+    BKVS_ART_NODE16     = 1,
+    BKVS_ART_NODE48     = 2,
+    BKVS_ART_NODE256    = 3,
+};
+
+/* header of the index nodes. */
+typedef struct _bkvs_art_node {
+    bkvs_u8 type;
+    bkvs_u16 num;
+
+    /* length of the compressed path, of which the first bytes are kept. */
+    bkvs_u32 prefix_len;
+    bkvs_u8 prefix[BKVS_ART_PREFIX_MAX];
+} bkvs_art_node;
+
+/* node of up to 4 or 16 children, keys sorted. */
+typedef struct _bkvs_art_node4 {
+    bkvs_art_node head;
+    bkvs_u8 keys[4];
+    void *children[4];
+} bkvs_art_node4;
+
+typedef struct _bkvs_art_node16 {
+    bkvs_art_node head;
+    bkvs_u8 keys[16];
+    void *children[16];
+} bkvs_art_node16;
+
+/* node of up to 48 children, `index` holds the child slot plus 1 of each key byte. */
+typedef struct _bkvs_art_node48 {
+    bkvs_art_node head;
+    bkvs_u8 index[256];
+    void *children[48];
+} bkvs_art_node48;
+
+typedef struct _bkvs_art_node256 {
+    bkvs_art_node head;
+    void *children[256];
+} bkvs_art_node256;
+
+/* bounds of an ordered walk. */
+typedef struct _bkvs_art_walk {
+
+    /* lowest key, terminator included, NULL if unbounded. */
+    const bkvs_u8 *lo;
+    bkvs_u32 lo_len;
+
+    /* bytes bounding the keys from above, NULL if unbounded. */
+    const bkvs_u8 *hi;
+    bkvs_u32 hi_len;
+
+    /* whether keys starting with all of `hi` are included, for prefix scans. */
+    bkvs_u32 hi_incl;
+
+    bkvs_foreach_cb cb;
+    bkvs_u32 idx;
+} bkvs_art_walk;
+
+static const bkvs_u32 art_node_sizes[] = {
+    sizeof(bkvs_art_node4), sizeof(bkvs_art_node16),
+    sizeof(bkvs_art_node48), sizeof(bkvs_art_node256),
+};
+
+/**
+ * @brief get a byte of the whole key of the pair.
+ * 
+ * @param pair pair pointer.
+ * @param depth offset of the byte, less than `key_size`.
+*/
+static inline bkvs_u8 art_byte(const bkvs_pair *pair, bkvs_u32 depth) {
+    if ((pair->flags & BKVS_PAIR_PREFIX_KEY) != 0) {
+        if (depth < pair->prefix->size) {
+            return (bkvs_u8)pair->prefix->data[depth];
+        }
+        depth -= pair->prefix->size;
+    }
+
+    return (bkvs_u8)pair->key[depth];
+}
+
+static bkvs_art_node *art_alloc(bkvs_ctx *ctx, bkvs_u8 type) {
+    bkvs_art_node *node;
+
+    node = (bkvs_art_node *)calloc(1, art_node_sizes[type]);
+    if (node != NULL) {
+        node->type = type;
+        ctx->index.size += art_node_sizes[type];
+        ctx->index.node_num++;
+    }
+
+    return node;
+}
+
+static void art_release(bkvs_ctx *ctx, bkvs_art_node *node) {
+    ctx->index.size -= art_node_sizes[node->type];
+    ctx->index.node_num--;
+    free(node);
+}
+
+/**
+ * @brief free the nodes under the node, and the pair records if the tree engine owns them.
+ * 
+ * @param ctx context pointer.
+ * @param ptr node or leaf pointer, can be NULL.
+*/
+static void art_free(bkvs_ctx *ctx, void *ptr) {
+    bkvs_art_node *node;
+
+    if (ptr == NULL) {
+        return;
+    }
+    if (BKVS_ART_IS_LEAF(ptr)) {
+        if (ctx->conf.engine == BKVS_ENGINE_ART) {
+            free(BKVS_ART_PAIR(ptr));
+        }
+
+        return;
+    }
+    node = (bkvs_art_node *)ptr;
+    switch (node->type) {
+    case BKVS_ART_NODE4:
+        for (bkvs_u32 i = 0; i < node->num; i++) {
+            art_free(ctx, ((bkvs_art_node4 *)node)->children[i]);
+        }
+        break;
+    case BKVS_ART_NODE16:
+        for (bkvs_u32 i = 0; i < node->num; i++) {
+            art_free(ctx, ((bkvs_art_node16 *)node)->children[i]);
+        }
+        break;
+    case BKVS_ART_NODE48:
+        for (bkvs_u32 i = 0; i < 48; i++) {
+            art_free(ctx, ((bkvs_art_node48 *)node)->children[i]);
+        }
+        break;
+    default:
+        for (bkvs_u32 i = 0; i < 256; i++) {
+            art_free(ctx, ((bkvs_art_node256 *)node)->children[i]);
+        }
+        break;
+    }
+    art_release(ctx, node);
+}
+
+static bkvs_s32 art_find16(const bkvs_art_node16 *node, bkvs_u8 byte) {
+#if defined(BKVS_SIMD_SSE2)
+    bkvs_u32 mask;
+
+    mask = (bkvs_u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8((char)byte),
+        _mm_loadu_si128((const __m128i *)node->keys))) & ((1u << node->head.num) - 1);
+
+    return mask != 0 ? __builtin_ctz(mask) : -1;
+#elif defined(BKVS_SIMD_NEON)
+    bkvs_u64 mask;
+
+    mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(
+        vceqq_u8(vld1q_u8(node->keys), vdupq_n_u8(byte))), 4)), 0);
+    if (node->head.num < 16) {
+        mask &= (1ULL << (node->head.num * 4)) - 1;
+    }
+
+    return mask != 0 ? (bkvs_s32)(__builtin_ctzll(mask) >> 2) : -1;
+#else
+    for (bkvs_u32 i = 0; i < node->head.num; i++) {
+        if (node->keys[i] == byte) {
+            return (bkvs_s32)i;
+        }
+    }
+
+    return -1;
+#endif
+}
+
+/**
+ * @brief find the child slot of the key byte.
+ * 
+ * @return address of the child pointer, NULL if there is none.
+*/
+static void **art_child(bkvs_art_node *node, bkvs_u8 byte) {
+    bkvs_art_node4 *node4;
+    bkvs_art_node48 *node48;
+    bkvs_s32 i;
+
+    switch (node->type) {
+    case BKVS_ART_NODE4:
+        node4 = (bkvs_art_node4 *)node;
+        for (i = 0; i < node->num; i++) {
+            if (node4->keys[i] == byte) {
+                return &node4->children[i];
+            }
+        }
+
+        return NULL;
+    case BKVS_ART_NODE16:
+        i = art_find16((bkvs_art_node16 *)node, byte);
+
+        return i >= 0 ? &((bkvs_art_node16 *)node)->children[i] : NULL;
+    case BKVS_ART_NODE48:
+        node48 = (bkvs_art_node48 *)node;
+
+        return node48->index[byte] != 0 ? &node48->children[node48->index[byte] - 1] : NULL;
+    default:
+        return ((bkvs_art_node256 *)node)->children[byte] != NULL ?
+            &((bkvs_art_node256 *)node)->children[byte] : NULL;
+    }
+}
+
+/**
+ * @brief get the child with the lowest key byte.
+*/
+static void *art_first(bkvs_art_node *node) {
+    switch (node->type) {
+    case BKVS_ART_NODE4:
+        return ((bkvs_art_node4 *)node)->children[0];
+    case BKVS_ART_NODE16:
+        return ((bkvs_art_node16 *)node)->children[0];
+    case BKVS_ART_NODE48:
+        for (bkvs_u32 i = 0; i < 256; i++) {
+            if (((bkvs_art_node48 *)node)->index[i] != 0) {
+                return ((bkvs_art_node48 *)node)->children[((bkvs_art_node48 *)node)->index[i] - 1];
+            }
+        }
+
+        return NULL;
+    default:
+        for (bkvs_u32 i = 0; i < 256; i++) {
+            if (((bkvs_art_node256 *)node)->children[i] != NULL) {
+                return ((bkvs_art_node256 *)node)->children[i];
+            }
+        }
+
+        return NULL;
+    }
+}
+
+/**
+ * @brief get the pair with the lowest key under the node.
+*/
+static bkvs_pair *art_minimum(void *ptr) {
+    while (!BKVS_ART_IS_LEAF(ptr)) {
+        ptr = art_first((bkvs_art_node *)ptr);
+    }
+
+    return BKVS_ART_PAIR(ptr);
+}
+
+/**
+ * @brief add a child to the node, replacing it by a larger one if it is full.
+ * 
+ * @param ctx context pointer.
+ * @param ref address of the pointer to the node.
+ * @param byte key byte of the child.
+ * @param child child pointer.
+*/
+static bkvs_res art_add(bkvs_ctx *ctx, void **ref, bkvs_u8 byte, void *child) {
+    bkvs_art_node *node;
+    bkvs_art_node *grown;
+    bkvs_u8 *keys;
+    void **children;
+    bkvs_u32 cap;
+    bkvs_u32 i;
+
+    node = (bkvs_art_node *)*ref;
+    if (node->type == BKVS_ART_NODE256) {
+        ((bkvs_art_node256 *)node)->children[byte] = child;
+        node->num++;
+
+        return BKVS_OK;
+    }
+    if (node->type == BKVS_ART_NODE48) {
+        bkvs_art_node48 *node48;
+
+        node48 = (bkvs_art_node48 *)node;
+        if (node->num < 48) {
+            for (i = 0; node48->children[i] != NULL; i++);
+            node48->children[i] = child;
+            node48->index[byte] = (bkvs_u8)(i + 1);
+            node->num++;
+
+            return BKVS_OK;
+        }
+        grown = art_alloc(ctx, BKVS_ART_NODE256);
+        if (grown == NULL) {
+            return BKVS_ERR_NO_MEM;
+        }
+        for (i = 0; i < 256; i++) {
+            if (node48->index[i] != 0) {
+                ((bkvs_art_node256 *)grown)->children[i] = node48->children[node48->index[i] - 1];
+            }
+        }
+    } else {
+        if (node->type == BKVS_ART_NODE4) {
+            keys = ((bkvs_art_node4 *)node)->keys;
+            children = ((bkvs_art_node4 *)node)->children;
+            cap = 4;
+        } else {
+            keys = ((bkvs_art_node16 *)node)->keys;
+            children = ((bkvs_art_node16 *)node)->children;
+            cap = 16;
+        }
+
+        /* keep the keys sorted. */
+        if (node->num < cap) {
+            for (i = 0; i < node->num && keys[i] < byte; i++);
+            memmove(keys + i + 1, keys + i, node->num - i);
+            memmove(children + i + 1, children + i, sizeof(void *) * (node->num - i));
+            keys[i] = byte;
+            children[i] = child;
+            node->num++;
+
+            return BKVS_OK;
+        }
+        if (node->type == BKVS_ART_NODE4) {
+            grown = art_alloc(ctx, BKVS_ART_NODE16);
+            if (grown == NULL) {
+                return BKVS_ERR_NO_MEM;
+            }
+            memcpy(((bkvs_art_node16 *)grown)->keys, keys, cap);
+            memcpy(((bkvs_art_node16 *)grown)->children, children, sizeof(void *) * cap);
+        } else {
+            grown = art_alloc(ctx, BKVS_ART_NODE48);
+            if (grown == NULL) {
+                return BKVS_ERR_NO_MEM;
+            }
+            for (i = 0; i < cap; i++) {
+                ((bkvs_art_node48 *)grown)->index[keys[i]] = (bkvs_u8)(i + 1);
+                ((bkvs_art_node48 *)grown)->children[i] = children[i];
+            }
+        }
+    }
+
+    /* the larger node takes over the path and the children. */
+    grown->num = node->num;
+    grown->prefix_len = node->prefix_len;
+    memcpy(grown->prefix, node->prefix, BKVS_ART_PREFIX_MAX);
+    art_release(ctx, node);
+    *ref = grown;
+
+    return art_add(ctx, ref, byte, child);
+}
+
+/**
+ * @brief remove the child slot from the node, replacing it by a smaller one if it gets sparse.
+ * 
+ * @param ctx context pointer.
+ * @param ref address of the pointer to the node.
+ * @param byte key byte of the child.
+ * @param slot address of the child pointer.
+*/
+static void art_remove(bkvs_ctx *ctx, void **ref, bkvs_u8 byte, void **slot) {
+    bkvs_art_node *node;
+    bkvs_art_node *shrunk;
+    bkvs_u8 *keys;
+    void **children;
+    bkvs_u32 i;
+    bkvs_u32 j;
+
+    node = (bkvs_art_node *)*ref;
+    node->num--;
+    switch (node->type) {
+    case BKVS_ART_NODE256:
+        *slot = NULL;
+
+        /* shrinking is skipped if memory is short. */
+        if (node->num != 37 || (shrunk = art_alloc(ctx, BKVS_ART_NODE48)) == NULL) {
+            return;
+        }
+        for (i = 0, j = 0; i < 256; i++) {
+            if (((bkvs_art_node256 *)node)->children[i] != NULL) {
+                ((bkvs_art_node48 *)shrunk)->children[j] = ((bkvs_art_node256 *)node)->children[i];
+                ((bkvs_art_node48 *)shrunk)->index[i] = (bkvs_u8)++j;
+            }
+        }
+        break;
+    case BKVS_ART_NODE48:
+        ((bkvs_art_node48 *)node)->index[byte] = 0;
+        *slot = NULL;
+        if (node->num != 12 || (shrunk = art_alloc(ctx, BKVS_ART_NODE16)) == NULL) {
+            return;
+        }
+        for (i = 0, j = 0; i < 256; i++) {
+            if (((bkvs_art_node48 *)node)->index[i] != 0) {
+                ((bkvs_art_node16 *)shrunk)->keys[j] = (bkvs_u8)i;
+                ((bkvs_art_node16 *)shrunk)->children[j++] =
+                    ((bkvs_art_node48 *)node)->children[((bkvs_art_node48 *)node)->index[i] - 1];
+            }
+        }
+        break;
+    default:
+        if (node->type == BKVS_ART_NODE4) {
+            keys = ((bkvs_art_node4 *)node)->keys;
+            children = ((bkvs_art_node4 *)node)->children;
+        } else {
+            keys = ((bkvs_art_node16 *)node)->keys;
+            children = ((bkvs_art_node16 *)node)->children;
+        }
+        i = (bkvs_u32)(slot - children);
+        memmove(keys + i, keys + i + 1, node->num - i);
+        memmove(children + i, children + i + 1, sizeof(void *) * (node->num - i));
+        if (node->type == BKVS_ART_NODE16) {
+            if (node->num != 3 || (shrunk = art_alloc(ctx, BKVS_ART_NODE4)) == NULL) {
+                return;
+            }
+            memcpy(((bkvs_art_node4 *)shrunk)->keys, keys, 3);
+            memcpy(((bkvs_art_node4 *)shrunk)->children, children, sizeof(void *) * 3);
+            break;
+        }
+        if (node->num != 1) {
+            return;
+        }
+
+        /* a node with one child is merged into it. */
+        if (!BKVS_ART_IS_LEAF(children[0])) {
+            bkvs_art_node *child;
+            bkvs_u8 prefix[BKVS_ART_PREFIX_MAX * 2 + 1];
+            bkvs_u32 len;
+
+            child = (bkvs_art_node *)children[0];
+            len = node->prefix_len < BKVS_ART_PREFIX_MAX ? node->prefix_len : BKVS_ART_PREFIX_MAX;
+            memcpy(prefix, node->prefix, len);
+            prefix[len++] = keys[0];
+            memcpy(prefix + len, child->prefix, BKVS_ART_PREFIX_MAX);
+            memcpy(child->prefix, prefix, BKVS_ART_PREFIX_MAX);
+            child->prefix_len += node->prefix_len + 1;
+        }
+        *ref = children[0];
+        art_release(ctx, node);
+
+        return;
+    }
+
+    shrunk->num = node->num;
+    shrunk->prefix_len = node->prefix_len;
+    memcpy(shrunk->prefix, node->prefix, BKVS_ART_PREFIX_MAX);
+    art_release(ctx, node);
+    *ref = shrunk;
+}
+
+/**
+ * @brief get the number of the path bytes of the node the pair's key matches.
+ * 
+ * @param node node pointer.
+ * @param pair pair pointer.
+ * @param depth depth of the node.
+*/
+static bkvs_u32 art_prefix_match(bkvs_art_node *node, const bkvs_pair *pair, bkvs_u32 depth) {
+    const bkvs_pair *min;
+    bkvs_u32 len;
+    bkvs_u32 i;
+
+    len = node->prefix_len < pair->key_size - depth ? node->prefix_len : pair->key_size - depth;
+    for (i = 0; i < len && i < BKVS_ART_PREFIX_MAX; i++) {
+        if (node->prefix[i] != art_byte(pair, depth + i)) {
+            return i;
+        }
+    }
+
+    /* the rest of a long path is read from a leaf under the node. */
+    if (i < len) {
+        min = art_minimum(node);
+        for (; i < len; i++) {
+            if (art_byte(min, depth + i) != art_byte(pair, depth + i)) {
+                return i;
+            }
+        }
+    }
+
+    return i;
+}
+
+/**
+ * @brief insert the pair into the index, its key must not be there yet.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer, its address must be stable.
+*/
+static bkvs_res art_insert(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_art_node *node;
+    bkvs_art_node *split;
+    bkvs_pair *other;
+    bkvs_u32 depth;
+    bkvs_u32 len;
+    void **ref;
+    void **child;
+
+    ref = &ctx->index.root;
+    depth = 0;
+    while (*ref != NULL) {
+
+        /* split a leaf at the first byte the keys differ. */
+        if (BKVS_ART_IS_LEAF(*ref)) {
+            other = BKVS_ART_PAIR(*ref);
+            for (len = 0; art_byte(other, depth + len) == art_byte(pair, depth + len); len++);
+            split = art_alloc(ctx, BKVS_ART_NODE4);
+            if (split == NULL) {
+                return BKVS_ERR_NO_MEM;
+            }
+            split->prefix_len = len;
+            for (bkvs_u32 i = 0; i < len && i < BKVS_ART_PREFIX_MAX; i++) {
+                split->prefix[i] = art_byte(pair, depth + i);
+            }
+            art_add(ctx, (void **)&split, art_byte(other, depth + len), *ref);
+            art_add(ctx, (void **)&split, art_byte(pair, depth + len), BKVS_ART_LEAF(pair));
+            *ref = split;
+
+            return BKVS_OK;
+        }
+
+        /* split the path of a node at the first byte the key differs. */
+        node = (bkvs_art_node *)*ref;
+        if (node->prefix_len != 0) {
+            len = art_prefix_match(node, pair, depth);
+            if (len < node->prefix_len) {
+                split = art_alloc(ctx, BKVS_ART_NODE4);
+                if (split == NULL) {
+                    return BKVS_ERR_NO_MEM;
+                }
+                split->prefix_len = len;
+                for (bkvs_u32 i = 0; i < len && i < BKVS_ART_PREFIX_MAX; i++) {
+                    split->prefix[i] = art_byte(pair, depth + i);
+                }
+                if (node->prefix_len <= BKVS_ART_PREFIX_MAX) {
+                    art_add(ctx, (void **)&split, node->prefix[len], node);
+                    node->prefix_len -= len + 1;
+                    memmove(node->prefix, node->prefix + len + 1, node->prefix_len);
+                } else {
+                    other = art_minimum(node);
+                    art_add(ctx, (void **)&split, art_byte(other, depth + len), node);
+                    node->prefix_len -= len + 1;
+                    for (bkvs_u32 i = 0; i < node->prefix_len && i < BKVS_ART_PREFIX_MAX; i++) {
+                        node->prefix[i] = art_byte(other, depth + len + 1 + i);
+                    }
+                }
+                art_add(ctx, (void **)&split, art_byte(pair, depth + len), BKVS_ART_LEAF(pair));
+                *ref = split;
+
+                return BKVS_OK;
+            }
+            depth += node->prefix_len;
+        }
+
+        child = art_child(node, art_byte(pair, depth));
+        if (child == NULL) {
+            return art_add(ctx, ref, art_byte(pair, depth), BKVS_ART_LEAF(pair));
+        }
+        ref = child;
+        depth++;
+    }
+    *ref = BKVS_ART_LEAF(pair);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief remove the pair from the index.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer, as inserted.
+*/
+static void art_delete(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_art_node *node;
+    bkvs_u32 depth;
+    void **ref;
+    void **child;
+
+    ref = &ctx->index.root;
+    depth = 0;
+    if (*ref == BKVS_ART_LEAF(pair)) {
+        *ref = NULL;
+
+        return;
+    }
+
+    /* the path of the pair is only followed, the leaf is matched by address. */
+    while (*ref != NULL && !BKVS_ART_IS_LEAF(*ref)) {
+        node = (bkvs_art_node *)*ref;
+        depth += node->prefix_len;
+        if (depth >= pair->key_size) {
+            return;
+        }
+        child = art_child(node, art_byte(pair, depth));
+        if (child == NULL) {
+            return;
+        }
+        if (*child == BKVS_ART_LEAF(pair)) {
+            art_remove(ctx, ref, art_byte(pair, depth), child);
+
+            return;
+        }
+        ref = child;
+        depth++;
+    }
+}
+
+/**
+ * @brief compare the key of the pair with the bound bytes, from `depth` on.
+ * 
+ * @return negative, zero or positive as the key is lower, starts with or is higher than the bound.
+*/
+static bkvs_s32 art_compare(const bkvs_pair *pair, const bkvs_u8 *bound, bkvs_u32 len, bkvs_u32 depth) {
+    bkvs_u8 byte;
+
+    for (; depth < len; depth++) {
+        byte = art_byte(pair, depth);
+        if (byte != bound[depth]) {
+            return byte < bound[depth] ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief check the path byte at `depth` against the bounds the path so far is equal to.
+ * 
+ * @param walk bounds of the walk.
+ * @param byte path byte.
+ * @param depth offset of the byte.
+ * @param lo_tight whether the path so far equals the lower bound, cleared once it is above.
+ * @param hi_tight whether the path so far equals the upper bound, cleared once it is below.
+ * @return negative if the path is below the bounds, positive if above, zero if within.
+*/
+static bkvs_s32 art_bound(const bkvs_art_walk *walk, bkvs_u8 byte, bkvs_u32 depth,
+                          bkvs_u32 *lo_tight, bkvs_u32 *hi_tight) {
+    if (*lo_tight) {
+        if (depth >= walk->lo_len || byte > walk->lo[depth]) {
+            *lo_tight = 0;
+        } else if (byte < walk->lo[depth]) {
+            return -1;
+        }
+    }
+    if (*hi_tight) {
+        if (depth >= walk->hi_len || byte < walk->hi[depth]) {
+            *hi_tight = 0;
+        } else if (byte > walk->hi[depth]) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief walk the pairs under the node in key order, within the bounds.
+ * 
+ * @param ctx context pointer.
+ * @param walk bounds and callback.
+ * @param ptr node or leaf pointer.
+ * @param depth depth of the node.
+ * @param lo_tight whether the path so far equals the lower bound.
+ * @param hi_tight whether the path so far equals the upper bound.
+*/
+static bkvs_res art_walk(bkvs_ctx *ctx, bkvs_art_walk *walk, void *ptr, bkvs_u32 depth,
+                         bkvs_u32 lo_tight, bkvs_u32 hi_tight) {
+    bkvs_art_node *node;
+    const bkvs_pair *min;
+    const char *key;
+    bkvs_buff buff;
+    bkvs_pair *pair;
+    void *child;
+    bkvs_u32 child_lo_tight;
+    bkvs_u32 child_hi_tight;
+    bkvs_u32 len;
+    bkvs_s32 cmp;
+    bkvs_u8 byte;
+    bkvs_res res;
+
+    if (BKVS_ART_IS_LEAF(ptr)) {
+        pair = BKVS_ART_PAIR(ptr);
+        if (lo_tight && art_compare(pair, walk->lo, walk->lo_len, depth) < 0) {
+            return BKVS_OK;
+        }
+        if (hi_tight) {
+            cmp = art_compare(pair, walk->hi, walk->hi_len, depth);
+            if (cmp > 0 || (cmp == 0 && !walk->hi_incl)) {
+                return BKVS_ART_DONE;
+            }
+        }
+        key = pair_key(ctx, pair);
+        if (key == NULL) {
+            return BKVS_ERR_NO_MEM;
+        }
+        res = pair_value(ctx, pair, &buff, NULL, 0);
+        if (res != BKVS_OK) {
+            return res;
+        }
+        res = walk->cb(key, &buff, walk->idx++, ctx->cache.pair_num);
+
+        return res == BKVS_ERR_ITER_STOP ? BKVS_ERR_ITER_STOP : BKVS_OK;
+    }
+
+    /* narrow the bounds along the compressed path of the node. */
+    node = (bkvs_art_node *)ptr;
+    min = NULL;
+    for (bkvs_u32 i = 0; i < node->prefix_len; i++) {
+        if (lo_tight || hi_tight) {
+            if (i < BKVS_ART_PREFIX_MAX) {
+                byte = node->prefix[i];
+            } else {
+                if (min == NULL) {
+                    min = art_minimum(node);
+                }
+                byte = art_byte(min, depth + i);
+            }
+            cmp = art_bound(walk, byte, depth + i, &lo_tight, &hi_tight);
+            if (cmp != 0) {
+                return cmp < 0 ? BKVS_OK : BKVS_ART_DONE;
+            }
+        }
+    }
+    depth += node->prefix_len;
+
+    /* visit the children in key order. */
+    len = node->type <= BKVS_ART_NODE16 ? node->num : 256;
+    for (bkvs_u32 i = 0; i < len; i++) {
+        if (node->type == BKVS_ART_NODE4) {
+            byte = ((bkvs_art_node4 *)node)->keys[i];
+            child = ((bkvs_art_node4 *)node)->children[i];
+        } else if (node->type == BKVS_ART_NODE16) {
+            byte = ((bkvs_art_node16 *)node)->keys[i];
+            child = ((bkvs_art_node16 *)node)->children[i];
+        } else if (node->type == BKVS_ART_NODE48) {
+            byte = (bkvs_u8)i;
+            child = ((bkvs_art_node48 *)node)->index[i] != 0 ?
+                ((bkvs_art_node48 *)node)->children[((bkvs_art_node48 *)node)->index[i] - 1] : NULL;
+        } else {
+            byte = (bkvs_u8)i;
+            child = ((bkvs_art_node256 *)node)->children[i];
+        }
+        if (child == NULL) {
+            continue;
+        }
+        child_lo_tight = lo_tight;
+        child_hi_tight = hi_tight;
+        cmp = art_bound(walk, byte, depth, &child_lo_tight, &child_hi_tight);
+        if (cmp < 0) {
+            continue;
+        }
+        if (cmp > 0) {
+            return BKVS_ART_DONE;
+        }
+        res = art_walk(ctx, walk, child, depth + 1, child_lo_tight, child_hi_tight);
+        if (res != BKVS_OK) {
+            return res;
+        }
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief call back the pairs under the node in key order, the way `bque_foreach()` does.
+ * 
+ * @param ptr node or leaf pointer, can be NULL.
+ * @param cb callback function, stopping the walk unless it returns `BQUE_OK`.
+*/
+static bque_res art_each(void *ptr, bque_res (*cb)(bque_buff *buff, bque_u32 idx, bque_u32 num)) {
+    bkvs_art_node *node;
+    bque_buff buff;
+    void *child;
+    bque_res res;
+
+    if (ptr == NULL) {
+        return BQUE_OK;
+    }
+    if (BKVS_ART_IS_LEAF(ptr)) {
+        buff.ptr = (bque_u8 *)BKVS_ART_PAIR(ptr);
+        buff.size = sizeof(bkvs_pair);
+
+        return cb(&buff, 0, 0);
+    }
+    node = (bkvs_art_node *)ptr;
+    for (bkvs_u32 i = 0; i < (node->type <= BKVS_ART_NODE16 ? node->num : 256u); i++) {
+        if (node->type == BKVS_ART_NODE4) {
+            child = ((bkvs_art_node4 *)node)->children[i];
+        } else if (node->type == BKVS_ART_NODE16) {
+            child = ((bkvs_art_node16 *)node)->children[i];
+        } else if (node->type == BKVS_ART_NODE48) {
+            child = ((bkvs_art_node48 *)node)->index[i] != 0 ?
+                ((bkvs_art_node48 *)node)->children[((bkvs_art_node48 *)node)->index[i] - 1] : NULL;
+        } else {
+            child = ((bkvs_art_node256 *)node)->children[i];
+        }
+        res = art_each(child, cb);
+        if (res != BQUE_OK) {
+            return res;
+        }
+    }
+
+    return BQUE_OK;
+}
+
+static bkvs_res create_pair_que(bque_ctx **ctx) {
+    bque_conf conf;
+    bque_res res;
+
+    /* configure key-value pair queue. */
+    conf.buff_num_max = 0;
+    conf.buff_size_max = 0;
+
+    /* create key-value pair queue. */
+    res = bque_new(ctx, &conf);
+    if (res != BQUE_OK) {
+        if (res == BQUE_ERR_NO_MEM) {
+            return BKVS_ERR_NO_MEM;
+        } else {
+            return BKVS_ERR;
+        }
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief call back the pairs of the bucket in queue order, the way `bque_foreach()` does.
+ * 
+ * the queue holds the addresses of the records, the callback gets the record itself.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_idx bucket index.
+ * @param cb callback function, stopping the walk unless it returns `BQUE_OK`.
+*/
+static bque_res bucket_each(bkvs_ctx *ctx, bkvs_u32 bucket_idx,
+                            bque_res (*cb)(bque_buff *buff, bque_u32 idx, bque_u32 num)) {
+    bkvs_probe *group;
+    bque_buff buff;
+    bque_res res;
+
+    group = &ctx->probe.groups[bucket_idx];
+    for (bkvs_u32 i = 0; i < group->num; i++) {
+        buff.ptr = (bque_u8 *)group->pairs[i];
+        buff.size = sizeof(bkvs_pair);
+        res = cb(&buff, i, group->num);
+        if (res != BQUE_OK) {
+            return res;
+        }
+    }
+
+    return BQUE_OK;
+}
+
+static bkvs_res create_pair(bkvs_ctx *ctx, bkvs_pair *pair, const char *key, const void *buff, bkvs_u32 size) {
+    bkvs_key_prefix *prefix;
+    bkvs_u32 prefix_size;
+    bkvs_u32 key_size;
+    bkvs_u32 value_size;
+    char *alloc_key;
+    char *alloc_value;
+    bkvs_u8 flags;
+    bkvs_res res;
+
+    BKVS_ASSERT(pair != NULL);
+    BKVS_ASSERT(key != NULL);
+    BKVS_ASSERT(buff != NULL);
+    BKVS_ASSERT(size != 0);
+
+    /* split a key too long for the record after its last delimiter. */
+    key_size = strlen(key) + 1;
+    prefix_size = 0;
+    if (ctx->conf.key_mode == BKVS_KEY_PREFIX && key_size > BKVS_PAIR_INLINE_KEY_SIZE) {
+        for (prefix_size = key_size - 1; prefix_size > 0 && key[prefix_size - 1] != ctx->conf.key_delim;
+             prefix_size--);
+    }
+
+    /* allocate memory for key, unless it fits in the record. */
+    flags = 0;
+    prefix = NULL;
+    if (prefix_size != 0) {
+        prefix = prefix_acquire(ctx, key, prefix_size);
+        if (prefix == NULL) {
+            return BKVS_ERR_NO_MEM;
+        }
+        flags |= BKVS_PAIR_PREFIX_KEY;
+    }
+    if (prefix != NULL && key_size - prefix_size <= sizeof(pair->suffix_buff)) {
+        alloc_key = pair->suffix_buff;
+        flags |= BKVS_PAIR_INLINE_KEY;
+    } else if (prefix == NULL && key_size <= BKVS_PAIR_INLINE_KEY_SIZE) {
+        alloc_key = pair->key_buff;
+        flags |= BKVS_PAIR_INLINE_KEY;
+    } else {
+        alloc_key = (char *)malloc(key_size - prefix_size);
+        if (alloc_key == NULL) {
+            if (prefix != NULL) {
+                prefix_release(ctx, prefix);
+            }
+
+            return BKVS_ERR_NO_MEM;
+        }
+    }
+
+    /* compress value, or allocate memory for it unless it fits in the record. */
+    value_size = size;
+    res = pack_value(ctx, buff, size, &alloc_value, &value_size);
+    if (res == BKVS_OK && alloc_value != NULL) {
+        flags |= BKVS_PAIR_PACKED_VALUE;
+    } else if (res == BKVS_OK && size <= BKVS_PAIR_INLINE_VALUE_SIZE) {
+        alloc_value = pair->value_buff;
+        flags |= BKVS_PAIR_INLINE_VALUE;
+    } else if (res == BKVS_OK) {
+        alloc_value = (char *)malloc(size);
+        if (alloc_value == NULL) {
+            res = BKVS_ERR_NO_MEM;
+        }
+    }
+    if (res != BKVS_OK) {
+        if ((flags & BKVS_PAIR_INLINE_KEY) == 0) {
+            free(alloc_key);
+        }
+        if (prefix != NULL) {
+            prefix_release(ctx, prefix);
+        }
+
+        return res;
+    }
+
+    // /* allocate memory for key-value pair. */
+    // alloc_pair = (bkvs_pair *)malloc(sizeof(bkvs_pair));
+    // if (alloc_pair == NULL) {
+    //     free(alloc_key);
+    //     free(alloc_value);
+
+    //     return BKVS_ERR_NO_MEM;
+    // }
+
+    /* copy key and value. */
+    memcpy(alloc_key, key + prefix_size, key_size - prefix_size);
+    if ((flags & BKVS_PAIR_PACKED_VALUE) == 0) {
+        memcpy(alloc_value, buff, size);
+    }
+    if (prefix != NULL) {
+        pair->prefix = prefix;
+    }
+
+    /* initialize key-value pair. */
+    pair->key = alloc_key;
+    pair->key_size = key_size;
+    pair->value = alloc_value;
+    pair->value_size = value_size;
+    pair->hash = 0;
+    pair->seg = BKVS_SEG_WINDOW;
+    pair->flags = flags;
+    pair->prev = NULL;
+    pair->next = NULL;
+
+    // /* output key-value pair. */
+    // *pair = alloc_pair;
+
+    return BKVS_OK;
+}
+
+static void free_pair(bkvs_pair *pair) {
+    if ((pair->flags & BKVS_PAIR_SHARED_KEY) == 0) {
+        free(pair->key);
+    }
+    if ((pair->flags & BKVS_PAIR_SHARED_VALUE) == 0) {
+        free(pair->value);
+    }
+}
+
+/**
+ * @brief compare the key of the pair with a key of the same size.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer.
+ * @param key key string.
+ * @param key_size size of both keys.
+*/
+static inline int pair_key_equal(bkvs_ctx *ctx, const bkvs_pair *pair, const char *key, bkvs_u32 key_size) {
+    bkvs_u32 prefix_size;
+
+    if ((pair->flags & BKVS_PAIR_PREFIX_KEY) == 0) {
+        return ctx->probe.equal(pair->key, key, key_size);
+    }
+    prefix_size = pair->prefix->size;
+
+    return memcmp(pair->prefix->data, key, prefix_size) == 0 &&
+        ctx->probe.equal(pair->key, key + prefix_size, key_size - prefix_size);
+}
+
+/**
+ * @brief search the key in the tree engine, without hashing it unless the eviction policy needs it.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+*/
+static bkvs_res search_tree(bkvs_ctx *ctx, const char *key) {
+    bkvs_art_node *node;
+    bkvs_pair *pair;
+    bkvs_u32 key_size;
+    bkvs_u32 depth;
+    void **child;
+    void *ptr;
+
+    key_size = strlen(key) + 1;
+    if (ctx->conf.evict_policy == BKVS_EVICT_TINYLFU) {
+        search_ctx.hash = hash_key(ctx, key, key_size - 1);
+    }
+    ptr = ctx->index.root;
+    depth = 0;
+    while (ptr != NULL && !BKVS_ART_IS_LEAF(ptr)) {
+
+        /* the kept bytes of the path are checked, the rest is checked at the leaf. */
+        node = (bkvs_art_node *)ptr;
+        for (bkvs_u32 i = 0; i < node->prefix_len && i < BKVS_ART_PREFIX_MAX; i++) {
+            if (depth + i >= key_size || node->prefix[i] != (bkvs_u8)key[depth + i]) {
+                return BKVS_ERR_NO_KEY;
+            }
+        }
+        depth += node->prefix_len;
+        if (depth >= key_size) {
+            return BKVS_ERR_NO_KEY;
+        }
+        child = art_child(node, (bkvs_u8)key[depth]);
+        if (child == NULL) {
+            return BKVS_ERR_NO_KEY;
+        }
+        ptr = *child;
+        depth++;
+    }
+    if (ptr == NULL) {
+        return BKVS_ERR_NO_KEY;
+    }
+    pair = BKVS_ART_PAIR(ptr);
+    if (pair->key_size != key_size || !pair_key_equal(ctx, pair, key, key_size)) {
+        return BKVS_ERR_NO_KEY;
+    }
+    search_ctx.key = key;
+    search_ctx.key_size = key_size;
+    search_ctx.buff.ptr = (bque_u8 *)pair;
+    search_ctx.buff.size = sizeof(bkvs_pair);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief get the other bucket of a key of the cuckoo engine.
+ * 
+ * the two buckets are paired by xor, so either one gives the other.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_idx one bucket of the key.
+ * @param hash hash of the key.
+*/
+static inline bkvs_u32 cuckoo_alt(bkvs_ctx *ctx, bkvs_u32 bucket_idx, bkvs_u32 hash) {
+    return (bucket_idx ^ (sketch_spread(hash) | 1)) & ctx->cuckoo.mask;
+}
+
+/**
+ * @brief allocate empty buckets of the cuckoo engine, replacing the current ones.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_num number of the buckets, a power of two of at least 2.
+*/
+static bkvs_res cuckoo_create(bkvs_ctx *ctx, bkvs_u32 bucket_num) {
+    bkvs_u8 *block;
+    bkvs_u8 *aligned;
+
+    block = (bkvs_u8 *)malloc(sizeof(bkvs_cuckoo_bucket) * (size_t)bucket_num + BKVS_CUCKOO_LINE - 1);
+    if (block == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    aligned = block + ((BKVS_CUCKOO_LINE - (uintptr_t)block % BKVS_CUCKOO_LINE) % BKVS_CUCKOO_LINE);
+    numa_bind(ctx->conf.numa_node, block, sizeof(bkvs_cuckoo_bucket) * (size_t)bucket_num + BKVS_CUCKOO_LINE - 1);
+    memset(aligned, 0, sizeof(bkvs_cuckoo_bucket) * (size_t)bucket_num);
+    ctx->cuckoo.block = block;
+    ctx->cuckoo.buckets = (bkvs_cuckoo_bucket *)aligned;
+    ctx->cuckoo.mask = bucket_num - 1;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief get the pair of a slot of the cuckoo engine, the stash following the buckets.
+ * 
+ * @return the pair, NULL if the slot is empty.
+*/
+static inline bkvs_pair *cuckoo_slot(bkvs_ctx *ctx, bkvs_u32 slot_idx) {
+    bkvs_u32 slot_num;
+
+    slot_num = (ctx->cuckoo.mask + 1) * BKVS_CUCKOO_WAYS;
+    if (slot_idx < slot_num) {
+        return ctx->cuckoo.buckets[slot_idx / BKVS_CUCKOO_WAYS].pairs[slot_idx % BKVS_CUCKOO_WAYS];
+    }
+
+    return ctx->cuckoo.stash[slot_idx - slot_num];
+}
+
+/**
+ * @brief call back the pairs of the cuckoo engine, the way `bque_foreach()` does.
+ * 
+ * @param ctx context pointer, of any engine.
+ * @param cb callback function, stopping the walk unless it returns `BQUE_OK`.
+*/
+static bque_res cuckoo_each(bkvs_ctx *ctx, bque_res (*cb)(bque_buff *buff, bque_u32 idx, bque_u32 num)) {
+    bque_buff buff;
+    bkvs_u32 slot_num;
+    bque_res res;
+
+    if (ctx->cuckoo.buckets == NULL) {
+        return BQUE_OK;
+    }
+    slot_num = (ctx->cuckoo.mask + 1) * BKVS_CUCKOO_WAYS + ctx->cuckoo.stash_num;
+    for (bkvs_u32 i = 0; i < slot_num; i++) {
+        buff.ptr = (bque_u8 *)cuckoo_slot(ctx, i);
+        if (buff.ptr == NULL) {
+            continue;
+        }
+        buff.size = sizeof(bkvs_pair);
+        res = cb(&buff, 0, 0);
+        if (res != BQUE_OK) {
+            return res;
+        }
+    }
+
+    return BQUE_OK;
+}
+
+/**
+ * @brief search the key in the cuckoo engine, in its two buckets and then in the stash.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+*/
+static bkvs_res search_cuckoo(bkvs_ctx *ctx, const char *key) {
+    bkvs_cuckoo_bucket *bucket;
+    bkvs_u32 bucket_idx;
+    bkvs_pair *pair;
+
+    search_ctx.key = key;
+    search_ctx.key_size = strlen(key) + 1;
+    search_ctx.hash = hash_key(ctx, key, search_ctx.key_size - 1);
+    bucket_idx = search_ctx.hash & ctx->cuckoo.mask;
+    for (bkvs_u32 i = 0; i < 2; i++) {
+        bucket = &ctx->cuckoo.buckets[bucket_idx];
+        for (bkvs_u32 j = 0; j < BKVS_CUCKOO_WAYS; j++) {
+            pair = bucket->pairs[j];
+            if (bucket->hashes[j] == search_ctx.hash && pair != NULL && pair->key_size == search_ctx.key_size &&
+                pair_key_equal(ctx, pair, key, search_ctx.key_size)) {
+                search_ctx.bucket_idx = bucket_idx;
+                search_ctx.pair_idx = j;
+                search_ctx.buff.ptr = (bque_u8 *)pair;
+                search_ctx.buff.size = sizeof(bkvs_pair);
+
+                return BKVS_OK;
+            }
+        }
+        bucket_idx = cuckoo_alt(ctx, bucket_idx, search_ctx.hash);
+    }
+
+    /* the stash is told apart by a bucket index past the buckets. */
+    for (bkvs_u32 i = 0; i < ctx->cuckoo.stash_num; i++) {
+        pair = ctx->cuckoo.stash[i];
+        if (pair->hash == search_ctx.hash && pair->key_size == search_ctx.key_size &&
+            pair_key_equal(ctx, pair, key, search_ctx.key_size)) {
+            search_ctx.bucket_idx = ctx->cuckoo.mask + 1;
+            search_ctx.pair_idx = i;
+            search_ctx.buff.ptr = (bque_u8 *)pair;
+            search_ctx.buff.size = sizeof(bkvs_pair);
+
+            return BKVS_OK;
+        }
+    }
+
+    return BKVS_ERR_NO_KEY;
+}
+
+/**
+ * @brief move the pairs along a found path of steps, then put the pair in the first bucket of the path.
+ * 
+ * each pair is copied into the free slot before its old slot is cleared, so
+ * no key is ever missing from both of its buckets.
+ * 
+ * @param ctx context pointer.
+ * @param steps steps of the search.
+ * @param step_idx step whose bucket has a free slot.
+ * @param slot the free slot.
+ * @param pair pair to be put.
+ * @return BKVS_ERR_NO_ROOM if the path crossed itself and went stale, the moves made so far are kept.
+*/
+static bkvs_res cuckoo_shift(bkvs_ctx *ctx, const bkvs_cuckoo_step *steps, bkvs_u32 step_idx, bkvs_u32 slot,
+                             bkvs_pair *pair) {
+    bkvs_cuckoo_bucket *from;
+    bkvs_cuckoo_bucket *to;
+    bkvs_u32 parent;
+    bkvs_u32 moved;
+
+    while (steps[step_idx].parent != BKVS_CUCKOO_STEP_ROOT) {
+        parent = steps[step_idx].parent;
+        from = &ctx->cuckoo.buckets[steps[parent].bucket_idx];
+        to = &ctx->cuckoo.buckets[steps[step_idx].bucket_idx];
+        moved = steps[step_idx].slot;
+        if (from->pairs[moved] == NULL || to->pairs[slot] != NULL ||
+            cuckoo_alt(ctx, steps[parent].bucket_idx, from->hashes[moved]) != steps[step_idx].bucket_idx) {
+            return BKVS_ERR_NO_ROOM;
+        }
+        to->hashes[slot] = from->hashes[moved];
+        to->pairs[slot] = from->pairs[moved];
+        from->pairs[moved] = NULL;
+        slot = moved;
+        step_idx = parent;
+    }
+    to = &ctx->cuckoo.buckets[steps[step_idx].bucket_idx];
+    to->hashes[slot] = pair->hash;
+    to->pairs[slot] = pair;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief put the pair in one of its two buckets, moving other pairs to their other buckets if needed.
+ * 
+ * the free slot nearest to the two buckets is searched breadth first.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair to be put, with its hash.
+ * @return BKVS_ERR_NO_ROOM if no free slot is found within `BKVS_CUCKOO_STEP_MAX` steps.
+*/
+static bkvs_res cuckoo_place(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_cuckoo_step steps[BKVS_CUCKOO_STEP_MAX];
+    bkvs_cuckoo_bucket *bucket;
+    bkvs_u32 step_num;
+    bkvs_u32 slot;
+
+    steps[0].bucket_idx = pair->hash & ctx->cuckoo.mask;
+    steps[0].parent = BKVS_CUCKOO_STEP_ROOT;
+    steps[1].bucket_idx = cuckoo_alt(ctx, steps[0].bucket_idx, pair->hash);
+    steps[1].parent = BKVS_CUCKOO_STEP_ROOT;
+    step_num = 2;
+    for (bkvs_u32 i = 0; i < step_num; i++) {
+        bucket = &ctx->cuckoo.buckets[steps[i].bucket_idx];
+        for (slot = 0; slot < BKVS_CUCKOO_WAYS && bucket->pairs[slot] != NULL; slot++);
+        if (slot < BKVS_CUCKOO_WAYS) {
+            return cuckoo_shift(ctx, steps, i, slot, pair);
+        }
+
+        /* the bucket is full, each of its pairs could move to its other bucket. */
+        for (slot = 0; slot < BKVS_CUCKOO_WAYS && step_num < BKVS_CUCKOO_STEP_MAX; slot++) {
+            steps[step_num].bucket_idx = cuckoo_alt(ctx, steps[i].bucket_idx, bucket->hashes[slot]);
+            steps[step_num].parent = (bkvs_u16)i;
+            steps[step_num].slot = (bkvs_u8)slot;
+            step_num++;
+        }
+    }
+
+    return BKVS_ERR_NO_ROOM;
+}
+
+/**
+ * @brief keep the pair in the stash of the cuckoo engine, outside the buckets.
+ * 
+ * @return BKVS_ERR_NO_ROOM if the stash is full.
+*/
+static bkvs_res cuckoo_stash(bkvs_ctx *ctx, bkvs_pair *pair) {
+    if (ctx->cuckoo.stash_num == BKVS_CUCKOO_STASH_MAX) {
+        return BKVS_ERR_NO_ROOM;
+    }
+    ctx->cuckoo.stash[ctx->cuckoo.stash_num++] = pair;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief move all the pairs of the cuckoo engine into new buckets, the stash included.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_num number of the new buckets.
+*/
+static bkvs_res cuckoo_resize(bkvs_ctx *ctx, bkvs_u32 bucket_num) {
+    struct _bkvs_ctx_cuckoo old;
+    bkvs_pair *pair;
+    bkvs_u32 slot_num;
+    bkvs_res res;
+
+    old = ctx->cuckoo;
+    res = cuckoo_create(ctx, bucket_num);
+    if (res != BKVS_OK) {
+        return res;
+    }
+    ctx->cuckoo.stash_num = 0;
+    slot_num = (old.mask + 1) * BKVS_CUCKOO_WAYS;
+    for (bkvs_u32 i = 0; i < slot_num + old.stash_num && res == BKVS_OK; i++) {
+        pair = i < slot_num ? old.buckets[i / BKVS_CUCKOO_WAYS].pairs[i % BKVS_CUCKOO_WAYS] :
+            old.stash[i - slot_num];
+        if (pair == NULL) {
+            continue;
+        }
+        res = cuckoo_place(ctx, pair);
+        if (res == BKVS_ERR_NO_ROOM) {
+            res = cuckoo_stash(ctx, pair);
+        }
+    }
+
+    /* the old buckets are untouched until the copy is complete. */
+    if (res != BKVS_OK) {
+        free(ctx->cuckoo.block);
+        ctx->cuckoo = old;
+
+        return res;
+    }
+    free(old.block);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief store the pair record in the cuckoo engine.
+ * 
+ * a pair finding no free slot goes to the stash while it has room. once it
+ * is full, the buckets are doubled if at least half of the slots are used,
+ * and otherwise the keys collide too much for more buckets to help.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair record, with its hash.
+ * @return BKVS_ERR_NO_ROOM if the pair has no slot and the buckets are not doubled.
+*/
+static bkvs_res cuckoo_insert(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_u32 bucket_num;
+    bkvs_res res;
+
+    res = cuckoo_place(ctx, pair);
+    while (res == BKVS_ERR_NO_ROOM) {
+        res = cuckoo_stash(ctx, pair);
+        if (res != BKVS_ERR_NO_ROOM) {
+            break;
+        }
+        bucket_num = ctx->cuckoo.mask + 1;
+        if (ctx->cache.pair_num < bucket_num * BKVS_CUCKOO_WAYS / 2 || bucket_num >= BKVS_CUCKOO_BUCKET_MAX) {
+            break;
+        }
+        res = cuckoo_resize(ctx, bucket_num * 2);
+        if (res == BKVS_OK) {
+            res = cuckoo_place(ctx, pair);
+        } else if (res == BKVS_ERR_NO_ROOM) {
+            break;
+        }
+    }
+
+    return res;
+}
+
+/**
+ * @brief find the bucket and slot of a stored pair of the cuckoo engine.
+ * 
+ * @return BKVS_ERR if the pair is not stored.
+*/
+static bkvs_res cuckoo_locate(bkvs_ctx *ctx, const bkvs_pair *pair, bkvs_u32 *bucket_idx, bkvs_u32 *slot) {
+    *bucket_idx = pair->hash & ctx->cuckoo.mask;
+    for (bkvs_u32 i = 0; i < 2; i++) {
+        for (bkvs_u32 j = 0; j < BKVS_CUCKOO_WAYS; j++) {
+            if (ctx->cuckoo.buckets[*bucket_idx].pairs[j] == pair) {
+                *slot = j;
+
+                return BKVS_OK;
+            }
+        }
+        *bucket_idx = cuckoo_alt(ctx, *bucket_idx, pair->hash);
+    }
+    *bucket_idx = ctx->cuckoo.mask + 1;
+    for (bkvs_u32 i = 0; i < ctx->cuckoo.stash_num; i++) {
+        if (ctx->cuckoo.stash[i] == pair) {
+            *slot = i;
+
+            return BKVS_OK;
+        }
+    }
+
+    return BKVS_ERR;
+}
+
+/**
+ * @brief clear a slot of the cuckoo engine, or take the pair out of the stash.
+*/
+static void cuckoo_remove(bkvs_ctx *ctx, bkvs_u32 bucket_idx, bkvs_u32 slot) {
+    if (bucket_idx <= ctx->cuckoo.mask) {
+        ctx->cuckoo.buckets[bucket_idx].pairs[slot] = NULL;
+    } else {
+        ctx->cuckoo.stash[slot] = ctx->cuckoo.stash[--ctx->cuckoo.stash_num];
+    }
+}
+
+/**
+ * @brief free the pair records of the cuckoo engine and empty its buckets, keeping their size.
+*/
+static void cuckoo_clear(bkvs_ctx *ctx) {
+    bkvs_u32 slot_num;
+
+    if (ctx->cuckoo.buckets == NULL) {
+        return;
+    }
+    slot_num = (ctx->cuckoo.mask + 1) * BKVS_CUCKOO_WAYS + ctx->cuckoo.stash_num;
+    for (bkvs_u32 i = 0; i < slot_num; i++) {
+        free(cuckoo_slot(ctx, i));
+    }
+    memset(ctx->cuckoo.buckets, 0, sizeof(bkvs_cuckoo_bucket) * ((size_t)ctx->cuckoo.mask + 1));
+    ctx->cuckoo.stash_num = 0;
+}
+
+/**
+ * @brief compare the pair with a key, by hash first and then by key bytes.
+ * 
+ * @param pair pair pointer.
+ * @param other pair holding the key, NULL to compare with `key`.
+ * @param key key string, used when `other` is NULL.
+ * 
+ * @return negative, zero or positive as the pair is lower, equal or higher.
+*/
+static bkvs_s32 probe_compare(const bkvs_pair *pair, bkvs_u32 hash, const bkvs_pair *other, const char *key,
+                              bkvs_u32 key_size) {
+    bkvs_u8 byte;
+    bkvs_u8 with;
+
+    if (pair->hash != hash) {
+        return pair->hash < hash ? -1 : 1;
+    }
+
+    /* keys end with their terminator, so a shorter key differs at it. */
+    for (bkvs_u32 i = 0; i < pair->key_size && i < key_size; i++) {
+        byte = art_byte(pair, i);
+        with = other != NULL ? art_byte(other, i) : (bkvs_u8)key[i];
+        if (byte != with) {
+            return byte < with ? -1 : 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief find the first of the sorted pairs not lower than the key.
+ * 
+ * @param group probe index of the bucket.
+ * @param num number of the sorted pairs.
+ * @param other pair holding the key, NULL to look for `key`.
+*/
+static bkvs_u32 probe_bound(const bkvs_probe *group, bkvs_u32 num, bkvs_u32 hash, const bkvs_pair *other,
+                            const char *key, bkvs_u32 key_size) {
+    bkvs_u32 lo;
+    bkvs_u32 hi;
+    bkvs_u32 mid;
+
+    lo = 0;
+    hi = num;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (probe_compare(group->pairs[group->order[mid]], hash, other, key, key_size) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * @brief add the last pair of the bucket to the sorted order, sorting the
+ *        whole bucket once it grows past `BKVS_SORT_MIN` pairs.
+ * 
+ * the bucket is left to the tag scan if memory runs out.
+ * 
+ * @param group probe index of the bucket.
+*/
+static void probe_sort(bkvs_probe *group) {
+    bkvs_pair *pair;
+    bkvs_u32 from;
+    bkvs_u32 pos;
+
+    if (group->order == NULL) {
+        if (group->num <= BKVS_SORT_MIN) {
+            return;
+        }
+        group->order = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * group->cap);
+        if (group->order == NULL) {
+            return;
+        }
+        from = 0;
+    } else {
+        from = group->num - 1;
+    }
+
+    /* insert the pairs one by one. */
+    for (bkvs_u32 i = from; i < group->num; i++) {
+        pair = group->pairs[i];
+        pos = probe_bound(group, i, pair->hash, pair, NULL, pair->key_size);
+        memmove(group->order + pos + 1, group->order + pos, sizeof(bkvs_u32) * (i - pos));
+        group->order[pos] = i;
+    }
+}
+
+static bkvs_res search_key(bkvs_ctx *ctx, const char *key) {
+    bque_u32 bucket_idx;
+    bkvs_probe *group;
+    bkvs_pair *pair;
+    bkvs_u32 pair_idx;
+    bkvs_u8 tag;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+
+    if (ctx->conf.engine == BKVS_ENGINE_ART) {
+        return search_tree(ctx, key);
+    }
+    if (ctx->conf.engine == BKVS_ENGINE_CUCKOO) {
+        return search_cuckoo(ctx, key);
+    }
+
+    /* hash key string and get the bucket index. */
+    search_ctx.key = key;
+    search_ctx.key_size = strlen(key) + 1;
+    search_ctx.hash = hash_key(ctx, key, search_ctx.key_size - 1);
+    bucket_idx = search_ctx.hash % ctx->conf.bucket_num;
+    if (ctx->buckets[bucket_idx] == NULL) {
+        return BKVS_ERR_NO_KEY;
+    }
+
+    /* a long bucket is searched by halves, a short one only at the pairs with a matching tag. */
+    group = &ctx->probe.groups[bucket_idx];
+    if (group->order != NULL) {
+        pair_idx = probe_bound(group, group->num, search_ctx.hash, NULL, key, search_ctx.key_size);
+        if (pair_idx == group->num || probe_compare(group->pairs[group->order[pair_idx]], search_ctx.hash, NULL, key,
+                                                    search_ctx.key_size) != 0) {
+            return BKVS_ERR_NO_KEY;
+        }
+        pair_idx = group->order[pair_idx];
+    } else {
+        tag = probe_tag(search_ctx.hash);
+        for (pair_idx = ctx->probe.find(group->tags, group->num, tag, 0); pair_idx < group->num;
+             pair_idx = ctx->probe.find(group->tags, group->num, tag, pair_idx + 1)) {
+            pair = group->pairs[pair_idx];
+            if (pair->hash == search_ctx.hash && pair->key_size == search_ctx.key_size &&
+                pair_key_equal(ctx, pair, key, search_ctx.key_size)) {
+                break;
+            }
+        }
+        if (pair_idx == group->num) {
+            return BKVS_ERR_NO_KEY;
+        }
+    }
+    search_ctx.bucket_idx = bucket_idx;
+    search_ctx.pair_idx = pair_idx;
+    search_ctx.buff.ptr = (bque_u8 *)group->pairs[pair_idx];
+    search_ctx.buff.size = sizeof(bkvs_pair);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief copy the bucket for the live views before it is changed, unless it already is.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_idx bucket index.
+*/
+static bkvs_res snap_preserve(bkvs_ctx *ctx, bkvs_u32 bucket_idx) {
+    bkvs_snap_ver *ver;
+    bkvs_probe *group;
+    bkvs_pair *pair;
+    bkvs_pair *copy;
+    bkvs_cow *cow;
+    bkvs_u64 size;
+    char *data;
+
+    if (ctx->snap.tail == NULL) {
+        return BKVS_OK;
+    }
+    cow = &ctx->snap.cows[bucket_idx];
+    if (cow->gen >= ctx->snap.tail->gen) {
+        return BKVS_OK;
+    }
+
+    /* keys are copied whole and values as stored, both 8-byte aligned. */
+    group = &ctx->probe.groups[bucket_idx];
+    size = sizeof(bkvs_snap_ver) + sizeof(bkvs_pair) * (bkvs_u64)group->num;
+    for (bkvs_u32 i = 0; i < group->num; i++) {
+        size += ((group->pairs[i]->key_size + 7) & ~7ULL) + ((group->pairs[i]->value_size + 7) & ~7ULL);
+    }
+    ver = (bkvs_snap_ver *)malloc((size_t)size);
+    if (ver == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    data = (char *)(ver->pairs + group->num);
+    for (bkvs_u32 i = 0; i < group->num; i++) {
+        pair = group->pairs[i];
+        copy = &ver->pairs[i];
+        memset(copy, 0, sizeof(bkvs_pair));
+        copy->key_size = pair->key_size;
+        copy->value_size = pair->value_size;
+        copy->hash = pair->hash;
+        copy->flags = BKVS_PAIR_ARENA_KEY | BKVS_PAIR_ARENA_VALUE | (pair->flags & BKVS_PAIR_PACKED_VALUE);
+        copy->key = data;
+        pair_key_copy(pair, data);
+        data += (pair->key_size + 7) & ~7ULL;
+        copy->value = data;
+        memcpy(data, pair->value, pair->value_size);
+        data += (pair->value_size + 7) & ~7ULL;
+    }
+    ver->bucket_idx = bucket_idx;
+    ver->from = cow->gen;
+    ver->upto = ctx->snap.tail->gen;
+    ver->size = size;
+    ver->num = group->num;
+
+    /* link the copy, the bucket is now free to change until the next view. */
+    ver->next = cow->vers;
+    cow->vers = ver;
+    ver->link = ctx->snap.vers;
+    ctx->snap.vers = ver;
+    ctx->snap.size += size;
+    cow->gen = ctx->snap.tail->gen;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief free the bucket copies no live view needs anymore.
+*/
+static void snap_prune(bkvs_ctx *ctx) {
+    bkvs_snap_ver **ref;
+    bkvs_snap_ver **slot;
+    bkvs_snap_ver *ver;
+    bkvs_snap *snap;
+
+    ref = &ctx->snap.vers;
+    while ((ver = *ref) != NULL) {
+        for (snap = ctx->snap.head; snap != NULL && (snap->gen <= ver->from || snap->gen > ver->upto);
+             snap = snap->next);
+        if (snap != NULL) {
+            ref = &ver->link;
+            continue;
+        }
+        *ref = ver->link;
+        for (slot = &ctx->snap.cows[ver->bucket_idx].vers; *slot != ver; slot = &(*slot)->next);
+        *slot = ver->next;
+        ctx->snap.size -= ver->size;
+        free(ver);
+    }
+    if (ctx->snap.head == NULL) {
+        free(ctx->snap.cows);
+        ctx->snap.cows = NULL;
+    }
+}
+
+/**
+ * @brief point the inline key and value of a copied pair record into the copy.
+*/
+static void relocate_pair(bkvs_pair *pair) {
+    if ((pair->flags & BKVS_PAIR_INLINE_KEY) != 0) {
+        pair->key = (pair->flags & BKVS_PAIR_PREFIX_KEY) != 0 ? pair->suffix_buff : pair->key_buff;
+    }
+    if ((pair->flags & BKVS_PAIR_INLINE_VALUE) != 0) {
+        pair->value = pair->value_buff;
+    }
+}
+
+/**
+ * @brief enqueue the record of the pair into its bucket.
+ * 
+ * the queue holds the address of the record, which stays where it is for
+ * as long as the pair lives, also when the buckets are rehashed.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_idx bucket index.
+ * @param pair record of the pair, with its hash.
+*/
+static bkvs_res enqueue_pair(bkvs_ctx *ctx, bkvs_u32 bucket_idx, bkvs_pair *pair) {
+    bque_res mod_bque_res;
+    bque_stat mod_bque_stat;
+    bkvs_probe *group;
+    bkvs_res res;
+
+    res = probe_reserve(ctx, bucket_idx);
+    if (res != BKVS_OK) {
+        return res;
+    }
+    mod_bque_res = bque_enqueue(ctx->buckets[bucket_idx], &pair, sizeof(bkvs_pair *));
+    if (mod_bque_res != BQUE_OK) {
+        if (mod_bque_res == BQUE_ERR_NO_MEM) {
+            return BKVS_ERR_NO_MEM;
+        } else {
+            return BKVS_ERR;
+        }
+    }
+
+    /* the ordered index points at the record too. */
+    if (ctx->conf.ordered_index) {
+        res = art_insert(ctx, pair);
+        if (res != BKVS_OK) {
+            bque_status(ctx->buckets[bucket_idx], &mod_bque_stat);
+            bque_drop(ctx->buckets[bucket_idx], mod_bque_stat.buff_num - 1, NULL, NULL);
+
+            return res;
+        }
+    }
+    group = &ctx->probe.groups[bucket_idx];
+    group->tags[group->num] = probe_tag(pair->hash);
+    group->pairs[group->num] = pair;
+    group->num++;
+    probe_sort(group);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief move every pair to the bucket of a new seed of the keyed hash.
+ * 
+ * the records are enqueued into new buckets first, so the set is left as
+ * it was if memory runs out. the records themselves stay where they are,
+ * so the eviction lists, the ordered index and the pointers handed out by
+ * `bkvs_get()` still hold.
+ * 
+ * @param ctx context pointer.
+*/
+static bkvs_res rehash_buckets(bkvs_ctx *ctx) {
+    bque_ctx **old_buckets;
+    bkvs_probe *old_groups;
+    bkvs_u32 *old_hashes;
+    bkvs_u64 old_seed[2];
+    bkvs_u32 bucket_num;
+    bkvs_u32 ordered_index;
+    bkvs_u32 moved_num;
+    bkvs_pair *pair;
+    bkvs_res res;
+
+    bucket_num = ctx->conf.bucket_num;
+    old_buckets = (bque_ctx **)malloc((sizeof(bque_ctx *) + sizeof(bkvs_probe)) * bucket_num +
+                                      sizeof(bkvs_u32) * ((size_t)ctx->cache.pair_num + 1));
+    if (old_buckets == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    old_groups = (bkvs_probe *)(old_buckets + bucket_num);
+    old_hashes = (bkvs_u32 *)(old_groups + bucket_num);
+    memcpy(old_buckets, ctx->buckets, sizeof(bque_ctx *) * bucket_num);
+    memcpy(old_groups, ctx->probe.groups, sizeof(bkvs_probe) * bucket_num);
+    memset(ctx->buckets, 0, sizeof(bque_ctx *) * bucket_num);
+    memset(ctx->probe.groups, 0, sizeof(bkvs_probe) * bucket_num);
+    old_seed[0] = ctx->hash.seed[0];
+    old_seed[1] = ctx->hash.seed[1];
+    hash_seed(ctx);
+
+    /* move the records, the ordered index already points at them. */
+    ordered_index = ctx->conf.ordered_index;
+    ctx->conf.ordered_index = 0;
+    res = BKVS_OK;
+    moved_num = 0;
+    for (bkvs_u32 i = 0; i < bucket_num && res == BKVS_OK; i++) {
+        for (bkvs_u32 j = 0; j < old_groups[i].num && res == BKVS_OK; j++) {
+            bkvs_u32 bucket_idx;
+            const char *key;
+
+            pair = old_groups[i].pairs[j];
+            key = pair_key(ctx, pair);
+            if (key == NULL) {
+                res = BKVS_ERR_NO_MEM;
+                break;
+            }
+            old_hashes[moved_num++] = pair->hash;
+            pair->hash = hash_key(ctx, key, pair->key_size - 1);
+            bucket_idx = pair->hash % bucket_num;
+            if (ctx->buckets[bucket_idx] == NULL) {
+                res = create_pair_que(&ctx->buckets[bucket_idx]);
+            }
+            if (res == BKVS_OK) {
+                res = enqueue_pair(ctx, bucket_idx, pair);
+            }
+        }
+    }
+    ctx->conf.ordered_index = ordered_index;
+
+    /* restore the old hashes and buckets. */
+    if (res != BKVS_OK) {
+        for (bkvs_u32 i = 0; i < bucket_num && moved_num != 0; i++) {
+            for (bkvs_u32 j = 0; j < old_groups[i].num && moved_num != 0; j++, moved_num--) {
+                old_groups[i].pairs[j]->hash = *old_hashes++;
+            }
+        }
+        for (bkvs_u32 i = 0; i < bucket_num; i++) {
+            if (ctx->buckets[i] != NULL) {
+                bque_del(ctx->buckets[i]);
+            }
+        }
+        probe_free(ctx);
+        memcpy(ctx->buckets, old_buckets, sizeof(bque_ctx *) * bucket_num);
+        memcpy(ctx->probe.groups, old_groups, sizeof(bkvs_probe) * bucket_num);
+        ctx->hash.seed[0] = old_seed[0];
+        ctx->hash.seed[1] = old_seed[1];
+        free(old_buckets);
+
+        return res;
+    }
+
+    /* free the old queues, which held the addresses of the records only. */
+    for (bkvs_u32 i = 0; i < bucket_num; i++) {
+        if (old_buckets[i] != NULL) {
+            bque_del(old_buckets[i]);
+        }
+        free(old_groups[i].pairs);
+        free(old_groups[i].order);
+    }
+    free(old_buckets);
+    ctx->hash.rehash_num++;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief store a new pair, whose key is not in the set yet.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair to be copied into the set, with its hash.
+ * @param stored address of the pointer to the stored pair.
+*/
+static bkvs_res insert_pair(bkvs_ctx *ctx, bkvs_pair *pair, bkvs_pair **stored) {
+    bkvs_u32 bucket_idx;
+    bkvs_pair *copy;
+    bkvs_res res;
+
+    /* every engine links a record of its own. */
+    bucket_idx = 0;
+    if (ctx->conf.engine == BKVS_ENGINE_HASH) {
+        bucket_idx = pair->hash % ctx->conf.bucket_num;
+        res = snap_preserve(ctx, bucket_idx);
+        if (res != BKVS_OK) {
+            return res;
+        }
+    }
+    copy = (bkvs_pair *)malloc(sizeof(bkvs_pair));
+    if (copy == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    memcpy(copy, pair, sizeof(bkvs_pair));
+    relocate_pair(copy);
+    if (ctx->conf.engine != BKVS_ENGINE_HASH) {
+        res = ctx->conf.ordered_index ? art_insert(ctx, copy) : BKVS_OK;
+        if (res == BKVS_OK && ctx->conf.engine == BKVS_ENGINE_CUCKOO) {
+            res = cuckoo_insert(ctx, copy);
+            if (res != BKVS_OK && ctx->conf.ordered_index) {
+                art_delete(ctx, copy);
+            }
+        }
+    } else {
+        res = BKVS_OK;
+        if (ctx->buckets[bucket_idx] == NULL) {
+            res = create_pair_que(&ctx->buckets[bucket_idx]);
+        }
+        if (res == BKVS_OK) {
+            res = enqueue_pair(ctx, bucket_idx, copy);
+        }
+    }
+    if (res != BKVS_OK) {
+        free(copy);
+
+        return res;
+    }
+    *stored = copy;
+
+    /* a chain far above the average means colliding keys, which a new seed spreads out.
+       the live views and a running compaction need the buckets to stay where they are. */
+    if (ctx->conf.engine == BKVS_ENGINE_HASH && ctx->hash.seeded && ctx->snap.tail == NULL &&
+        ctx->compact.writer == NULL &&
+        ctx->probe.groups[bucket_idx].num > BKVS_CHAIN_GUARD + 2 * (ctx->cache.pair_num / ctx->conf.bucket_num)) {
+        rehash_buckets(ctx);
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief remove the pair from its bucket and free it.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_idx bucket index, unused by the tree engine.
+ * @param pair_idx index of the pair in the bucket, or its slot in the cuckoo engine.
+ * @param pair pair pointer.
+*/
+static bkvs_res remove_pair(bkvs_ctx *ctx, bkvs_u32 bucket_idx, bkvs_u32 pair_idx, bkvs_pair *pair) {
+    bque_res mod_bque_res;
+    bkvs_res res;
+
+    res = snap_preserve(ctx, bucket_idx);
+    if (res != BKVS_OK) {
+        return res;
+    }
+
+    if (ctx->conf.evict_policy != BKVS_EVICT_NONE) {
+        lru_unlink(ctx, pair);
+    }
+
+    if (ctx->conf.ordered_index) {
+        art_delete(ctx, pair);
+    }
+    if ((pair->flags & BKVS_PAIR_PREFIX_KEY) != 0) {
+        prefix_release(ctx, pair->prefix);
+    }
+    free_pair(pair);
+    if (ctx->conf.engine == BKVS_ENGINE_ART) {
+        free(pair);
+    } else if (ctx->conf.engine == BKVS_ENGINE_CUCKOO) {
+        cuckoo_remove(ctx, bucket_idx, pair_idx);
+        free(pair);
+    } else {
+        mod_bque_res = bque_drop(ctx->buckets[bucket_idx], pair_idx, NULL, NULL);
+        if (mod_bque_res != BQUE_OK) {
+            return BKVS_ERR;
+        }
+        probe_remove(ctx, bucket_idx, pair_idx);
+        free(pair);
+    }
+
+    /* update key-value pair number. */
+    ctx->cache.pair_num--;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief evict the pair chosen by the eviction policy.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer.
+*/
+static bkvs_res evict_pair(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_u32 bucket_idx;
+    bkvs_probe *group;
+    bkvs_u32 pair_idx;
+
+    if (ctx->conf.engine == BKVS_ENGINE_ART) {
+        ctx->cache.evict_num++;
+
+        return remove_pair(ctx, 0, 0, pair);
+    }
+    if (ctx->conf.engine == BKVS_ENGINE_CUCKOO) {
+        if (cuckoo_locate(ctx, pair, &bucket_idx, &pair_idx) != BKVS_OK) {
+            return BKVS_ERR;
+        }
+        ctx->cache.evict_num++;
+
+        return remove_pair(ctx, bucket_idx, pair_idx, pair);
+    }
+
+    /* locate the pair in its bucket. */
+    bucket_idx = pair->hash % ctx->conf.bucket_num;
+    group = &ctx->probe.groups[bucket_idx];
+    for (pair_idx = 0; pair_idx < group->num && group->pairs[pair_idx] != pair; pair_idx++);
+    if (pair_idx == group->num) {
+        return BKVS_ERR;
+    }
+
+    ctx->cache.evict_num++;
+
+    return remove_pair(ctx, bucket_idx, pair_idx, pair);
+}
+
+/**
+ * @brief admit a newly stored pair and evict pairs until the set fits.
+ * 
+ * @param ctx context pointer.
+ * @param pair the newly stored pair.
+*/
+static bkvs_res evict_admit(bkvs_ctx *ctx, bkvs_pair *pair) {
+    bkvs_lru *segs;
+    bkvs_pair *candidate;
+    bkvs_pair *victim;
+    bkvs_res res;
+
+    segs = ctx->evict.segs;
+    lru_push(ctx, pair, BKVS_SEG_WINDOW);
+    if (ctx->conf.evict_policy == BKVS_EVICT_LRU) {
+        while (ctx->cache.pair_num > ctx->conf.pair_num_max) {
+            res = evict_pair(ctx, segs[BKVS_SEG_WINDOW].tail);
+            if (res != BKVS_OK) {
+                return res;
+            }
+        }
+
+        return BKVS_OK;
+    }
+
+    /* the pair pushed out of the window becomes the admission candidate. */
+    candidate = NULL;
+    if (segs[BKVS_SEG_WINDOW].num > segs[BKVS_SEG_WINDOW].num_max) {
+        candidate = segs[BKVS_SEG_WINDOW].tail;
+        lru_unlink(ctx, candidate);
+        lru_push(ctx, candidate, BKVS_SEG_PROBATION);
+    }
+
+    while (ctx->cache.pair_num > ctx->conf.pair_num_max) {
+
+        /* pick the victim from the least valuable end of the main segment. */
+        victim = segs[BKVS_SEG_PROBATION].tail;
+        if (victim == candidate) {
+            victim = NULL;
+        }
+        if (victim == NULL) {
+            victim = segs[BKVS_SEG_PROTECTED].tail;
+        }
+        if (victim == NULL) {
+            victim = segs[BKVS_SEG_WINDOW].tail;
+        }
+
+        /* the candidate is only admitted if it is used more than the victim. */
+        if (candidate != NULL && (victim == NULL ||
+            sketch_freq(ctx, candidate->hash) <= sketch_freq(ctx, victim->hash))) {
+            victim = candidate;
+        }
+        if (victim == candidate) {
+            candidate = NULL;
+        }
+
+        res = evict_pair(ctx, victim);
+        if (res != BKVS_OK) {
+            return res;
+        }
+    }
+
+    return BKVS_OK;
+}
+
+static bkvs_res put_pair(bkvs_ctx *ctx, const char *key, const void *buff, bkvs_u32 size) {
+    bkvs_res res;
+
+    /* search key. */
+    res = search_key(ctx, key);
+    if (ctx->conf.evict_policy == BKVS_EVICT_TINYLFU) {
+        sketch_add(ctx, search_ctx.hash);
+    }
+    if (res == BKVS_ERR_NO_KEY) {
+        bkvs_pair pair;
+        bkvs_pair *stored = NULL;
+
+        /* put key-value pair. */
+        res = create_pair(ctx, &pair, key, buff, size);
+        if (res != BKVS_OK) {
+            return res;
+        }
+
+        /* lookups of the tree engine skip hashing, the hash is still kept for the snapshots. */
+        if (ctx->conf.engine == BKVS_ENGINE_ART && ctx->conf.evict_policy != BKVS_EVICT_TINYLFU) {
+            search_ctx.hash = hash_key(ctx, key, strlen(key));
+        }
+        pair.hash = search_ctx.hash;
+        res = insert_pair(ctx, &pair, &stored);
+        if (res != BKVS_OK) {
+            if ((pair.flags & BKVS_PAIR_PREFIX_KEY) != 0) {
+                prefix_release(ctx, pair.prefix);
+            }
+            free_pair(&pair);
+
+            return res;
+        }
+
+        /* update key-value pair number. */
+        ctx->cache.pair_num++;
+
+        /* make room for the new pair. */
+        if (ctx->conf.evict_policy != BKVS_EVICT_NONE) {
+            return evict_admit(ctx, stored);
+        }
+    } else if (res == BKVS_OK) {
+        char *alloc_value;
+        char *old_value;
+        bkvs_pair *pair;
+
+        bkvs_u32 value_size;
+        bkvs_u8 flags;
+
+        res = snap_preserve(ctx, search_ctx.bucket_idx);
+        if (res != BKVS_OK) {
+            return res;
+        }
+
+        /* compress value, or allocate memory for it unless it fits in the record. */
+        pair = (bkvs_pair *)search_ctx.buff.ptr;
+        old_value = (pair->flags & BKVS_PAIR_SHARED_VALUE) == 0 ? pair->value : NULL;
+        value_size = size;
+        res = pack_value(ctx, buff, size, &alloc_value, &value_size);
+        if (res != BKVS_OK) {
+            return res;
+        }
+        flags = pair->flags & ~(BKVS_PAIR_SHARED_VALUE | BKVS_PAIR_PACKED_VALUE);
+        if (alloc_value != NULL) {
+            flags |= BKVS_PAIR_PACKED_VALUE;
+        } else if (size <= BKVS_PAIR_INLINE_VALUE_SIZE) {
+            alloc_value = pair->value_buff;
+            flags |= BKVS_PAIR_INLINE_VALUE;
         } else {
+            alloc_value = (char *)malloc(size);
+            if (alloc_value == NULL) {
+                return BKVS_ERR_NO_MEM;
+            }
+        }
+
+        /* copy value, the buffer may be the old value itself. */
+        if ((flags & BKVS_PAIR_PACKED_VALUE) == 0) {
+            memmove(alloc_value, buff, size);
+        }
+
+        /* update value. */
+        free(old_value);
+        pair->flags = flags;
+        pair->value = alloc_value;
+        pair->value_size = value_size;
+        evict_touch(ctx, pair);
+    } else {
+        return res;
+    }
+
+    return BKVS_OK;
+}
+
+bkvs_res bkvs_put(bkvs_ctx *ctx, const char *key, const void *buff, bkvs_u32 size) {
+    bkvs_u64 lat_start;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+    BKVS_ASSERT(buff != NULL);
+    BKVS_ASSERT(size != 0);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+
+    BKVS_LAT_START(lat_start);
+    res = put_pair(ctx, key, buff, size);
+
+    /* log the change. */
+    if (res == BKVS_OK) {
+        res = wal_append(ctx, BKVS_WAL_PUT, key, buff, size);
+    }
+    BKVS_LAT_STOP(ctx, BKVS_OP_PUT, lat_start);
+
+    return res;
+}
+
+static bkvs_res drop_pair(bkvs_ctx *ctx, const char *key) {
+    bkvs_res res;
+
+    /* search key. */
+    res = search_key(ctx, key);
+    if (res != BKVS_OK) {
+        return res;
+    }
+
+    /* delete key-value pair. */
+    return remove_pair(ctx, search_ctx.bucket_idx, search_ctx.pair_idx,
+        (bkvs_pair *)search_ctx.buff.ptr);
+}
+
+bkvs_res bkvs_drop(bkvs_ctx *ctx, const char *key) {
+    bkvs_u64 lat_start;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+
+    BKVS_LAT_START(lat_start);
+    res = drop_pair(ctx, key);
+
+    /* log the change. */
+    if (res == BKVS_OK) {
+        res = wal_append(ctx, BKVS_WAL_DROP, key, NULL, 0);
+    }
+    BKVS_LAT_STOP(ctx, BKVS_OP_DROP, lat_start);
+
+    return res;
+}
+
+static bque_res empty_cb(bque_buff *buff, bque_u32 idx, bque_u32 num) {
+    bkvs_pair *pair;
+
+    pair = (bkvs_pair *)buff->ptr;
+    free_pair(pair);
+
+    return BQUE_OK;
+}
+
+static void empty_pairs(bkvs_ctx *ctx) {
+
+    /* empty key-value pair queues and free the records they point at. */
+    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+        if (ctx->buckets[i] != NULL) {
+            bucket_each(ctx, i, empty_cb);
+            bque_del(ctx->buckets[i]);
+            for (bkvs_u32 j = 0; j < ctx->probe.groups[i].num; j++) {
+                free(ctx->probe.groups[i].pairs[j]);
+            }
+        }
+    }
+    memset(ctx->buckets, 0, sizeof(bque_ctx *) * ctx->conf.bucket_num);
+    if (ctx->conf.engine == BKVS_ENGINE_ART) {
+        art_each(ctx->index.root, empty_cb);
+    }
+    cuckoo_each(ctx, empty_cb);
+    cuckoo_clear(ctx);
+    art_free(ctx, ctx->index.root);
+    ctx->index.root = NULL;
+    probe_free(ctx);
+    prefix_free(ctx);
+    ctx->cache.pair_num = 0;
+
+    /* free arena blocks. */
+    while (ctx->mem.arenas != NULL) {
+        bkvs_arena *next;
+
+        next = ctx->mem.arenas->next;
+        free(ctx->mem.arenas);
+        ctx->mem.arenas = next;
+    }
+
+    /* reset eviction state. */
+    for (bkvs_u32 i = 0; i < BKVS_SEG_NUM; i++) {
+        ctx->evict.segs[i].head = NULL;
+        ctx->evict.segs[i].tail = NULL;
+        ctx->evict.segs[i].num = 0;
+    }
+    if (ctx->evict.sketch != NULL) {
+        memset(ctx->evict.sketch, 0, sizeof(bkvs_u64) * (ctx->evict.sketch_mask + 1));
+        ctx->evict.sketch_add = 0;
+    }
+}
+
+bkvs_res bkvs_empty(bkvs_ctx *ctx) {
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+
+    if (ctx->map.base != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+
+    /* a frozen set becomes mutable again once emptied. */
+    if (ctx->frozen.slots != NULL) {
+        frozen_free(ctx);
+        ctx->cache.pair_num = 0;
+    } else {
+
+        /* the live views keep a copy of every bucket. */
+        for (bkvs_u32 i = 0; i < ctx->conf.bucket_num && ctx->snap.tail != NULL; i++) {
+            res = snap_preserve(ctx, i);
+            if (res != BKVS_OK) {
+                return res;
+            }
+        }
+        empty_pairs(ctx);
+    }
+
+    /* log the change. */
+    return wal_append(ctx, BKVS_WAL_EMPTY, NULL, NULL, 0);
+}
+
+/**
+ * @brief apply the changes of a batch, undoing them all if one fails.
+ * 
+ * @param ctx context pointer.
+ * @param data encoded changes.
+ * @param len size of the changes.
+ * @param num number of the changes.
+*/
+static bkvs_res batch_apply(bkvs_ctx *ctx, const bkvs_u8 *data, bkvs_u32 len, bkvs_u32 num) {
+    bkvs_batch_undo *undo;
+    bkvs_u32 value_size;
+    bkvs_u32 done;
+    bkvs_u32 off;
+    bkvs_u32 i;
+    bkvs_res res;
+
+    undo = (bkvs_batch_undo *)calloc(num != 0 ? num : 1, sizeof(bkvs_batch_undo));
+    if (undo == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+
+    res = BKVS_OK;
+    done = 0;
+    off = 0;
+    for (i = 0; i < num && res == BKVS_OK; i++) {
+        const char *key;
+        bkvs_pair *pair;
+        bkvs_u8 type;
+
+        type = data[off];
+        value_size = get_u32(data + off + 5);
+        key = (const char *)data + off + BKVS_BATCH_OP_SIZE;
+        off += BKVS_BATCH_OP_SIZE + get_u32(data + off + 1);
+
+        /* keep the value the change replaces. */
+        undo[i].key = key;
+        res = search_key(ctx, key);
+        if (res == BKVS_OK) {
+            pair = (bkvs_pair *)search_ctx.buff.ptr;
+            undo[i].value_size = pair_value_size(pair);
+            undo[i].value = malloc(undo[i].value_size);
+            if (undo[i].value == NULL) {
+                res = BKVS_ERR_NO_MEM;
+            } else {
+                res = pair_value_copy(ctx, pair, undo[i].value);
+            }
+        } else if (res == BKVS_ERR_NO_KEY) {
+            res = BKVS_OK;
+        }
+
+        /* apply the change. */
+        if (res == BKVS_OK) {
+            done++;
+            if (type == BKVS_WAL_PUT) {
+                res = put_pair(ctx, key, data + off, value_size);
+            } else if (undo[i].value != NULL) {
+                res = drop_pair(ctx, key);
+            }
+        }
+        off += value_size;
+    }
+
+    /* undo the tried changes, newest first, so the set is left as it was. */
+    if (res != BKVS_OK) {
+        i = done;
+        while (i-- > 0) {
+            if (undo[i].value != NULL) {
+                put_pair(ctx, undo[i].key, undo[i].value, undo[i].value_size);
+            } else {
+                drop_pair(ctx, undo[i].key);
+            }
+        }
+    }
+    for (i = 0; i < num; i++) {
+        free(undo[i].value);
+    }
+    free(undo);
+
+    return res;
+}
+
+/**
+ * @brief create an empty batch of changes.
+ * 
+ * @param batch the address of the batch pointer.
+*/
+bkvs_res bkvs_batch_new(bkvs_batch **batch) {
+    BKVS_ASSERT(batch != NULL);
+
+    *batch = (bkvs_batch *)calloc(1, sizeof(bkvs_batch));
+    if (*batch == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+
+    return BKVS_OK;
+}
+
+bkvs_res bkvs_batch_del(bkvs_batch *batch) {
+    BKVS_ASSERT(batch != NULL);
+
+    free(batch->data);
+    free(batch);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief remove the changes of the batch, keeping its memory for reuse.
+ * 
+ * @param batch batch pointer.
+*/
+bkvs_res bkvs_batch_clear(bkvs_batch *batch) {
+    BKVS_ASSERT(batch != NULL);
+
+    batch->len = 0;
+    batch->num = 0;
+
+    return BKVS_OK;
+}
+
+static bkvs_res batch_add(bkvs_batch *batch, bkvs_u8 type, const char *key, const void *buff, bkvs_u32 size) {
+    bkvs_u32 key_size;
+    bkvs_u64 need;
+    bkvs_u8 *ptr;
+
+    /* the batch has to fit in one log record. */
+    key_size = strlen(key) + 1;
+    need = (bkvs_u64)batch->len + BKVS_BATCH_OP_SIZE + key_size + size;
+    if (need > 0xffffffff - BKVS_BATCH_OP_SIZE - 17) {
+        return BKVS_ERR_NO_ROOM;
+    }
+    if (need > batch->cap) {
+        bkvs_u64 cap;
+
+        cap = batch->cap != 0 ? batch->cap : 256;
+        while (cap < need) {
+            cap *= 2;
+        }
+        if (cap > 0xffffffff) {
+            cap = need;
+        }
+        ptr = (bkvs_u8 *)realloc(batch->data, (size_t)cap);
+        if (ptr == NULL) {
+            return BKVS_ERR_NO_MEM;
+        }
+        batch->data = ptr;
+        batch->cap = (bkvs_u32)cap;
+    }
+
+    /* append the change. */
+    ptr = batch->data + batch->len;
+    ptr[0] = type;
+    put_u32(ptr + 1, key_size);
+    put_u32(ptr + 5, size);
+    memcpy(ptr + BKVS_BATCH_OP_SIZE, key, key_size);
+    if (size != 0) {
+        memcpy(ptr + BKVS_BATCH_OP_SIZE + key_size, buff, size);
+    }
+    batch->len = (bkvs_u32)need;
+    batch->num++;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief add a put to the batch, the key and the value are copied.
+ * 
+ * @param batch batch pointer.
+ * @param key key string.
+ * @param buff value buffer.
+ * @param size size of the value.
+*/
+bkvs_res bkvs_batch_put(bkvs_batch *batch, const char *key, const void *buff, bkvs_u32 size) {
+    BKVS_ASSERT(batch != NULL);
+    BKVS_ASSERT(key != NULL);
+    BKVS_ASSERT(buff != NULL);
+    BKVS_ASSERT(size != 0);
+
+    return batch_add(batch, BKVS_WAL_PUT, key, buff, size);
+}
+
+/**
+ * @brief add a drop to the batch, dropping a missing key is not an error.
+ * 
+ * @param batch batch pointer.
+ * @param key key string.
+*/
+bkvs_res bkvs_batch_drop(bkvs_batch *batch, const char *key) {
+    BKVS_ASSERT(batch != NULL);
+    BKVS_ASSERT(key != NULL);
+
+    return batch_add(batch, BKVS_WAL_DROP, key, NULL, 0);
+}
+
+/**
+ * @brief apply the changes of the batch to the set, all or none of them.
+ * 
+ * the changes are applied in the order they were added, with one log
+ * record for the whole batch, so a crash never replays part of it. if a
+ * change fails the ones before it are undone, apart from the pairs they
+ * evicted. the batch is kept and may be committed again or cleared.
+ * 
+ * @param ctx context pointer.
+ * @param batch batch pointer.
+*/
+bkvs_res bkvs_batch_commit(bkvs_ctx *ctx, bkvs_batch *batch) {
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(batch != NULL);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+    if (batch->num == 0) {
+        return BKVS_OK;
+    }
+
+    res = batch_apply(ctx, batch->data, batch->len, batch->num);
+
+    /* log the changes. */
+    if (res == BKVS_OK) {
+        res = wal_append(ctx, BKVS_WAL_BATCH, NULL, batch->data, batch->len);
+    }
+
+    return res;
+}
+
+/**
+ * @brief find the 64-bit value of the key to change it in place.
+ * 
+ * @param ctx context pointer, of a mutable set.
+ * @param key key string.
+ * @param pair the pair of the key.
+ * @param val value of the pair.
+*/
+static bkvs_res search_u64(bkvs_ctx *ctx, const char *key, bkvs_pair **pair, bkvs_u64 *val) {
+    bkvs_res res;
+
+    res = search_key(ctx, key);
+    if (ctx->conf.evict_policy == BKVS_EVICT_TINYLFU) {
+        sketch_add(ctx, search_ctx.hash);
+    }
+    if (res != BKVS_OK) {
+        return res;
+    }
+    *pair = (bkvs_pair *)search_ctx.buff.ptr;
+    if (pair_value_size(*pair) != sizeof(bkvs_u64)) {
+        return BKVS_ERR;
+    }
+
+    return pair_value_copy(ctx, *pair, val);
+}
+
+/**
+ * @brief store the new 64-bit value of the pair found by `search_u64()`.
+ * 
+ * 8-byte values are never compressed, so the value is written over in place.
+ * 
+ * @param ctx context pointer.
+ * @param pair the pair of the key.
+ * @param val new value.
+*/
+static bkvs_res update_u64(bkvs_ctx *ctx, bkvs_pair *pair, bkvs_u64 val) {
+    bkvs_res res;
+
+    /* the live views keep the value as it was. */
+    res = snap_preserve(ctx, search_ctx.bucket_idx);
+    if (res != BKVS_OK) {
+        return res;
+    }
+    memcpy(pair->value, &val, sizeof(val));
+    evict_touch(ctx, pair);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief add to the 64-bit value of the key in place.
+ * 
+ * the value is a `bkvs_u64` in host byte order, it wraps around on
+ * overflow. a missing key is put with the value `delta`.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+ * @param delta number added to the value.
+ * @param val new value, can be NULL.
+*/
+bkvs_res bkvs_incr(bkvs_ctx *ctx, const char *key, bkvs_s64 delta, bkvs_u64 *val) {
+    bkvs_u64 lat_start;
+    bkvs_pair *pair;
+    bkvs_u64 new_val;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+
+    BKVS_LAT_START(lat_start);
+    res = search_u64(ctx, key, &pair, &new_val);
+    if (res == BKVS_OK) {
+        new_val += (bkvs_u64)delta;
+        res = update_u64(ctx, pair, new_val);
+    } else if (res == BKVS_ERR_NO_KEY) {
+        new_val = (bkvs_u64)delta;
+        res = put_pair(ctx, key, &new_val, sizeof(new_val));
+    }
+
+    /* log the change. */
+    if (res == BKVS_OK) {
+        res = wal_append(ctx, BKVS_WAL_PUT, key, &new_val, sizeof(new_val));
+    }
+    BKVS_LAT_STOP(ctx, BKVS_OP_PUT, lat_start);
+    if (res == BKVS_OK && val != NULL) {
+        *val = new_val;
+    }
+
+    return res;
+}
+
+/**
+ * @brief replace the 64-bit value of the key in place if it is the expected one.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+ * @param expected value the key must have.
+ * @param val new value.
+ * @return BKVS_ERR_MISMATCH if the value is not `expected`, BKVS_ERR if it
+ *         is not 64-bit.
+*/
+bkvs_res bkvs_cas(bkvs_ctx *ctx, const char *key, bkvs_u64 expected, bkvs_u64 val) {
+    bkvs_u64 lat_start;
+    bkvs_pair *pair;
+    bkvs_u64 old_val;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+
+    BKVS_LAT_START(lat_start);
+    res = search_u64(ctx, key, &pair, &old_val);
+    if (res == BKVS_OK && old_val != expected) {
+        res = BKVS_ERR_MISMATCH;
+    } else if (res == BKVS_OK) {
+        res = update_u64(ctx, pair, val);
+
+        /* log the change. */
+        if (res == BKVS_OK) {
+            res = wal_append(ctx, BKVS_WAL_PUT, key, &val, sizeof(val));
+        }
+    }
+    BKVS_LAT_STOP(ctx, BKVS_OP_PUT, lat_start);
+
+    return res;
+}
+
+static bkvs_res merge_pair(bkvs_ctx *ctx, const char *key, const void *operand, bkvs_u32 size) {
+    bkvs_buff value;
+    bkvs_pair *pair;
+    bkvs_u32 dst_size;
+    bkvs_u64 need;
+    bkvs_res res;
+
+    /* search key. */
+    res = search_key(ctx, key);
+    if (ctx->conf.evict_policy == BKVS_EVICT_TINYLFU) {
+        sketch_add(ctx, search_ctx.hash);
+    }
+    pair = NULL;
+    value.ptr = NULL;
+    value.size = 0;
+    if (res == BKVS_OK) {
+        pair = (bkvs_pair *)search_ctx.buff.ptr;
+        res = pair_value(ctx, pair, &value, NULL, 0);
+    } else if (res == BKVS_ERR_NO_KEY) {
+        res = BKVS_OK;
+    }
+
+    /* merge into the scratch buffer, sized for the value plus the operand first. */
+    need = (bkvs_u64)value.size + size;
+    while (res == BKVS_OK) {
+        if (need > ctx->merge.buff_size) {
+            bkvs_u8 *buff;
+
+            if (need > 0xffffffff) {
+                return BKVS_ERR_NO_ROOM;
+            }
+            buff = (bkvs_u8 *)realloc(ctx->merge.buff, (size_t)need);
+            if (buff == NULL) {
+                return BKVS_ERR_NO_MEM;
+            }
+            ctx->merge.buff = buff;
+            ctx->merge.buff_size = (bkvs_u32)need;
+        }
+        dst_size = ctx->merge.buff_size;
+        res = ctx->conf.merge_cb(key, &value, operand, size, ctx->merge.buff, &dst_size);
+        if (res != BKVS_ERR_NO_ROOM || dst_size <= ctx->merge.buff_size) {
+            break;
+        }
+        need = dst_size;
+        res = BKVS_OK;
+    }
+    if (res != BKVS_OK) {
+        return res;
+    }
+    if (dst_size == 0 || dst_size > ctx->merge.buff_size) {
+        return BKVS_ERR;
+    }
+
+    /* a merged value of the same size overwrites the old one where it is. */
+    if (pair != NULL && (pair->flags & BKVS_PAIR_PACKED_VALUE) == 0 && pair->value_size == dst_size) {
+        res = snap_preserve(ctx, search_ctx.bucket_idx);
+        if (res != BKVS_OK) {
+            return res;
+        }
+        memcpy(pair->value, ctx->merge.buff, dst_size);
+        evict_touch(ctx, pair);
+    } else {
+        res = put_pair(ctx, key, ctx->merge.buff, dst_size);
+        if (res != BKVS_OK) {
+            return res;
+        }
+    }
+
+    /* log the merged value, replaying does not need the callback. */
+    return wal_append(ctx, BKVS_WAL_PUT, key, ctx->merge.buff, dst_size);
+}
+
+/**
+ * @brief merge the operand into the value of the key with `merge_cb`.
+ * 
+ * the value is merged without copying it out of the set, and a merged
+ * value of the same size is written where the old one is, without
+ * allocating memory.
+ * 
+ * @param ctx context pointer, of a set configured with `merge_cb`.
+ * @param key key string.
+ * @param operand operand buffer.
+ * @param size size of the operand.
+*/
+bkvs_res bkvs_merge(bkvs_ctx *ctx, const char *key, const void *operand, bkvs_u32 size) {
+    bkvs_u64 lat_start;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+    if (ctx->conf.merge_cb == NULL) {
+        return BKVS_ERR;
+    }
+
+    BKVS_LAT_START(lat_start);
+    res = merge_pair(ctx, key, operand, size);
+    BKVS_LAT_STOP(ctx, BKVS_OP_PUT, lat_start);
+
+    return res;
+}
+
+bkvs_res bkvs_has(bkvs_ctx *ctx, const char *key) {
+    bkvs_u64 lat_start;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+
+    BKVS_LAT_START(lat_start);
+    if (ctx->map.base != NULL) {
+        bkvs_pair map_pair;
+
+        res = map_search(ctx, key, &map_pair);
+    } else if (ctx->frozen.slots != NULL) {
+        bkvs_pair frozen_pair;
+
+        res = frozen_search(ctx, key, &frozen_pair);
+    } else {
+
+        /* search key. */
+        res = search_key(ctx, key);
+    }
+    BKVS_LAT_STOP(ctx, BKVS_OP_HAS, lat_start);
+    if (res == BKVS_OK) {
+        ctx->cache.has_hit_num++;
+    } else if (res == BKVS_ERR_NO_KEY) {
+        ctx->cache.has_miss_num++;
+    }
+
+    return res;
+}
+
+/**
+ * @brief find the value of the key.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+ * @param buff value found.
+ * @param dst buffer the value is copied into, NULL to point at the stored value.
+ * @param dst_size size of `dst`.
+*/
+static bkvs_res get_pair(bkvs_ctx *ctx, const char *key, bkvs_buff *buff, void *dst, bkvs_u32 dst_size) {
+    bkvs_res res;
+    bkvs_pair *pair;
+
+    /* point into the mapped table file. */
+    if (ctx->map.base != NULL) {
+        bkvs_pair map_pair;
+
+        res = map_search(ctx, key, &map_pair);
+        if (res != BKVS_OK) {
+            return res;
+        }
+
+        return pair_value(ctx, &map_pair, buff, dst, dst_size);
+    }
+
+    /* single probe into the frozen records. */
+    if (ctx->frozen.slots != NULL) {
+        bkvs_pair frozen_pair;
+
+        res = frozen_search(ctx, key, &frozen_pair);
+        if (res != BKVS_OK) {
+            return res;
+        }
+
+        return pair_value(ctx, &frozen_pair, buff, dst, dst_size);
+    }
+
+    /* search key. */
+    res = search_key(ctx, key);
+    if (ctx->conf.evict_policy == BKVS_EVICT_TINYLFU) {
+        sketch_add(ctx, search_ctx.hash);
+    }
+    if (res != BKVS_OK) {
+        return res;
+    }
+
+    /* copy value. */
+    pair = (bkvs_pair *)search_ctx.buff.ptr;
+    evict_touch(ctx, pair);
+
+    return pair_value(ctx, pair, buff, dst, dst_size);
+}
+
+/**
+ * @brief get the value of the key.
+ * 
+ * the value is not copied, it stays valid until the pair is changed. a
+ * compressed value is decompressed into a buffer of the set instead, valid
+ * until the next call.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+ * @param buff value found.
+*/
+bkvs_res bkvs_get(bkvs_ctx *ctx, const char *key, bkvs_buff *buff) {
+    bkvs_u64 lat_start;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+    BKVS_ASSERT(buff != NULL);
+
+    BKVS_LAT_START(lat_start);
+    res = get_pair(ctx, key, buff, NULL, 0);
+    BKVS_LAT_STOP(ctx, BKVS_OP_GET, lat_start);
+    if (res == BKVS_OK) {
+        ctx->cache.get_hit_num++;
+    } else if (res == BKVS_ERR_NO_KEY) {
+        ctx->cache.get_miss_num++;
+    }
+
+    return res;
+}
+
+/**
+ * @brief copy the value of the key into a caller buffer, decompressing it if needed.
+ * 
+ * @param ctx context pointer.
+ * @param key key string.
+ * @param buff buffer the value is copied into.
+ * @param size size of the buffer.
+ * @param value_size size of the value, also set if the buffer is too small, can be NULL.
+*/
+bkvs_res bkvs_read(bkvs_ctx *ctx, const char *key, void *buff, bkvs_u32 size, bkvs_u32 *value_size) {
+    bkvs_u64 lat_start;
+    bkvs_buff value;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(key != NULL);
+    BKVS_ASSERT(buff != NULL);
+
+    BKVS_LAT_START(lat_start);
+    value.size = 0;
+    res = get_pair(ctx, key, &value, buff, size);
+    BKVS_LAT_STOP(ctx, BKVS_OP_GET, lat_start);
+    if (res == BKVS_ERR_NO_KEY) {
+        ctx->cache.get_miss_num++;
+    } else if (res == BKVS_OK || res == BKVS_ERR_NO_ROOM) {
+        ctx->cache.get_hit_num++;
+        if (value_size != NULL) {
+            *value_size = value.size;
+        }
+    }
+
+    return res;
+}
+
+static bkvs_res walk_index(bkvs_ctx *ctx, bkvs_art_walk *walk) {
+    bkvs_res res;
+
+    if (!ctx->conf.ordered_index || ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR;
+    }
+    if (ctx->index.root == NULL) {
+        return BKVS_OK;
+    }
+    res = art_walk(ctx, walk, ctx->index.root, 0, walk->lo != NULL, walk->hi != NULL);
+
+    return res == BKVS_ART_DONE ? BKVS_OK : res;
+}
+
+/**
+ * @brief call back one pair of `bkvs_foreach()` with its whole key and value.
+ * 
+ * @param ctx context pointer.
+ * @param pair pair pointer.
+ * @param cb callback function.
+ * @param pair_idx index of the pair in the walk.
+*/
+static bkvs_res foreach_pair(bkvs_ctx *ctx, const bkvs_pair *pair, bkvs_foreach_cb cb, bkvs_u32 pair_idx) {
+    const char *key;
+    bkvs_buff buff;
+    bkvs_res res;
+
+    key = pair_key(ctx, pair);
+    if (key == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    res = pair_value(ctx, pair, &buff, NULL, 0);
+    if (res != BKVS_OK) {
+        return res;
+    }
+    res = cb(key, &buff, pair_idx, ctx->cache.pair_num);
+
+    return res == BKVS_ERR_ITER_STOP ? BKVS_ERR_ITER_STOP : BKVS_OK;
+}
+
+bkvs_res bkvs_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb) {
+    bque_res mod_bque_res;
+    bque_stat mod_bque_stat;
+    bque_buff mod_bque_buff;
+    bque_u32 pair_idx;
+    bkvs_art_walk walk;
+    bkvs_pair *pair;
+    bkvs_u32 slot_num;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(cb != NULL);
+
+    if (ctx->map.base != NULL) {
+        return map_foreach(ctx, cb);
+    }
+    if (ctx->frozen.slots != NULL) {
+        return frozen_foreach(ctx, cb);
+    }
+
+    /* the tree engine is walked in key order. */
+    if (ctx->conf.engine == BKVS_ENGINE_ART) {
+        memset(&walk, 0, sizeof(walk));
+        walk.cb = cb;
+
+        return walk_index(ctx, &walk);
+    }
+
+    /* the cuckoo engine is walked slot by slot. */
+    pair_idx = 0;
+    if (ctx->conf.engine == BKVS_ENGINE_CUCKOO) {
+        slot_num = (ctx->cuckoo.mask + 1) * BKVS_CUCKOO_WAYS + ctx->cuckoo.stash_num;
+        for (bkvs_u32 i = 0; i < slot_num; i++) {
+            pair = cuckoo_slot(ctx, i);
+            if (pair == NULL) {
+                continue;
+            }
+            res = foreach_pair(ctx, pair, cb, pair_idx);
+            if (res != BKVS_OK) {
+                return res;
+            }
+            pair_idx++;
+        }
+
+        return BKVS_OK;
+    }
+
+    /* foreach key-value pair queues. */
+    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+        if (ctx->buckets[i] != NULL) {
+
+            mod_bque_res = bque_status(ctx->buckets[i], &mod_bque_stat);
+            if (mod_bque_res != BQUE_OK) {
+                return BKVS_ERR;
+            }
+
+            for (bkvs_u32 j = 0; j < mod_bque_stat.buff_num; j++) {
+                mod_bque_res = bque_item(ctx->buckets[i], j, &mod_bque_buff);
+                if (mod_bque_res != BQUE_OK) {
+                    return BKVS_ERR;
+                }
+
+                pair = *(bkvs_pair **)mod_bque_buff.ptr;
+                res = foreach_pair(ctx, pair, cb, pair_idx);
+                if (res != BKVS_OK) {
+                    return res;
+                }
+                pair_idx++;
+            }
+        }
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief call back the pairs of the keys from `lo` up to but excluding `hi`, in byte order.
+ * 
+ * only the keys in the range are visited. the set must have been created
+ * with `ordered_index` and must not be changed from the callback.
+ * 
+ * @param ctx context pointer.
+ * @param lo lowest key, NULL if unbounded.
+ * @param hi key above the range, NULL if unbounded.
+ * @param cb callback function, returning `BKVS_ERR_ITER_STOP` to stop.
+*/
+bkvs_res bkvs_range(bkvs_ctx *ctx, const char *lo, const char *hi, bkvs_foreach_cb cb) {
+    bkvs_art_walk walk;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(cb != NULL);
+
+    memset(&walk, 0, sizeof(walk));
+    if (lo != NULL) {
+        walk.lo = (const bkvs_u8 *)lo;
+        walk.lo_len = strlen(lo) + 1;
+    }
+    if (hi != NULL) {
+        walk.hi = (const bkvs_u8 *)hi;
+        walk.hi_len = strlen(hi) + 1;
+    }
+    walk.cb = cb;
+
+    return walk_index(ctx, &walk);
+}
+
+/**
+ * @brief call back the pairs of the keys starting with `prefix`, in byte order.
+ * 
+ * @param ctx context pointer.
+ * @param prefix prefix of the keys.
+ * @param cb callback function, returning `BKVS_ERR_ITER_STOP` to stop.
+*/
+bkvs_res bkvs_prefix(bkvs_ctx *ctx, const char *prefix, bkvs_foreach_cb cb) {
+    bkvs_art_walk walk;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(prefix != NULL);
+    BKVS_ASSERT(cb != NULL);
+
+    memset(&walk, 0, sizeof(walk));
+    walk.lo = (const bkvs_u8 *)prefix;
+    walk.lo_len = strlen(prefix);
+    walk.hi = walk.lo;
+    walk.hi_len = walk.lo_len;
+    walk.hi_incl = 1;
+    walk.cb = cb;
+
+    return walk_index(ctx, &walk);
+}
+
+/**
+ * @brief take a point-in-time view of the set.
+ * 
+ * taking a view costs O(1). the first change of each bucket after that
+ * copies the bucket for the live views, so later changes are not seen by
+ * them and never wait for them. views are deleted along with the set, and
+ * the set cannot be frozen while any is live.
+ * 
+ * @param ctx context pointer, of a mutable set of the hash engine.
+ * @param snap the address of the view pointer.
+*/
+bkvs_res bkvs_snapshot(bkvs_ctx *ctx, bkvs_snap **snap) {
+    bkvs_snap *alloc_snap;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(snap != NULL);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL || ctx->conf.engine != BKVS_ENGINE_HASH) {
+        return BKVS_ERR;
+    }
+    alloc_snap = (bkvs_snap *)malloc(sizeof(bkvs_snap));
+    if (alloc_snap == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    if (ctx->snap.cows == NULL) {
+        ctx->snap.cows = (bkvs_cow *)calloc(ctx->conf.bucket_num, sizeof(bkvs_cow));
+        if (ctx->snap.cows == NULL) {
+            free(alloc_snap);
+
+            return BKVS_ERR_NO_MEM;
+        }
+    }
+    alloc_snap->ctx = ctx;
+    alloc_snap->gen = ++ctx->snap.gen;
+    alloc_snap->pair_num = ctx->cache.pair_num;
+    alloc_snap->prev = ctx->snap.tail;
+    alloc_snap->next = NULL;
+    if (ctx->snap.tail != NULL) {
+        ctx->snap.tail->next = alloc_snap;
+    } else {
+        ctx->snap.head = alloc_snap;
+    }
+    ctx->snap.tail = alloc_snap;
+    *snap = alloc_snap;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief delete the view and the bucket copies only it needed.
+ * 
+ * @param snap view pointer.
+*/
+bkvs_res bkvs_snap_del(bkvs_snap *snap) {
+    bkvs_ctx *ctx;
+
+    BKVS_ASSERT(snap != NULL);
+
+    ctx = snap->ctx;
+    if (snap->prev != NULL) {
+        snap->prev->next = snap->next;
+    } else {
+        ctx->snap.head = snap->next;
+    }
+    if (snap->next != NULL) {
+        snap->next->prev = snap->prev;
+    } else {
+        ctx->snap.tail = snap->prev;
+    }
+    free(snap);
+    snap_prune(ctx);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief get the copy of the bucket the view sees, NULL if it sees the live bucket.
+*/
+static bkvs_snap_ver *snap_version(const bkvs_snap *snap, bkvs_u32 bucket_idx) {
+    bkvs_snap_ver *ver;
+
+    /* the bucket has not changed since the view was taken. */
+    if (snap->ctx->snap.cows[bucket_idx].gen < snap->gen) {
+        return NULL;
+    }
+    for (ver = snap->ctx->snap.cows[bucket_idx].vers; ver != NULL && ver->from >= snap->gen; ver = ver->next);
+
+    return ver;
+}
+
+/**
+ * @brief get the value of the key as seen by the view.
+ * 
+ * the value stays valid until the view is deleted if the bucket has been
+ * copied, until the pair is changed otherwise.
+ * 
+ * @param snap view pointer.
+ * @param key key string.
+ * @param buff value found.
+*/
+bkvs_res bkvs_snap_get(bkvs_snap *snap, const char *key, bkvs_buff *buff) {
+    bkvs_snap_ver *ver;
+    bkvs_pair *pair;
+    bkvs_ctx *ctx;
+    bkvs_u32 hash;
+    bkvs_u32 key_size;
+    bkvs_res res;
+
+    BKVS_ASSERT(snap != NULL);
+    BKVS_ASSERT(key != NULL);
+    BKVS_ASSERT(buff != NULL);
+
+    ctx = snap->ctx;
+    hash = hash_key(ctx, key, strlen(key));
+    ver = snap_version(snap, hash % ctx->conf.bucket_num);
+    if (ver == NULL) {
+        res = search_key(ctx, key);
+        if (res != BKVS_OK) {
+            return res;
+        }
+        pair = (bkvs_pair *)search_ctx.buff.ptr;
+    } else {
+        key_size = strlen(key) + 1;
+        pair = NULL;
+        for (bkvs_u32 i = 0; i < ver->num && pair == NULL; i++) {
+            if (ver->pairs[i].hash == hash && ver->pairs[i].key_size == key_size &&
+                memcmp(ver->pairs[i].key, key, key_size) == 0) {
+                pair = &ver->pairs[i];
+            }
+        }
+        if (pair == NULL) {
+            return BKVS_ERR_NO_KEY;
+        }
+    }
+
+    return pair_value(ctx, pair, buff, NULL, 0);
+}
+
+/**
+ * @brief call back every pair of the view.
+ * 
+ * the set may be changed from the callback, the walk still sees the set
+ * as it was when the view was taken.
+ * 
+ * @param snap view pointer.
+ * @param cb callback function, returning `BKVS_ERR_ITER_STOP` to stop.
+*/
+bkvs_res bkvs_snap_foreach(bkvs_snap *snap, bkvs_foreach_cb cb) {
+    bkvs_snap_ver *ver;
+    bkvs_pair *pair;
+    bkvs_ctx *ctx;
+    const char *key;
+    bkvs_buff buff;
+    bkvs_u32 pair_idx;
+    bkvs_u32 num;
+    bkvs_res res;
+
+    BKVS_ASSERT(snap != NULL);
+    BKVS_ASSERT(cb != NULL);
+
+    ctx = snap->ctx;
+    pair_idx = 0;
+    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+
+        /* the bucket is looked up again after each callback, which may have copied it. */
+        for (bkvs_u32 j = 0; ; j++) {
+            ver = snap_version(snap, i);
+            num = ver != NULL ? ver->num : ctx->probe.groups[i].num;
+            if (j >= num) {
+                break;
+            }
+            pair = ver != NULL ? &ver->pairs[j] : ctx->probe.groups[i].pairs[j];
+            key = pair_key(ctx, pair);
+            if (key == NULL) {
+                return BKVS_ERR_NO_MEM;
+            }
+            res = pair_value(ctx, pair, &buff, NULL, 0);
+            if (res != BKVS_OK) {
+                return res;
+            }
+            res = cb(key, &buff, pair_idx++, snap->pair_num);
+            if (res == BKVS_ERR_ITER_STOP) {
+                return BKVS_ERR_ITER_STOP;
+            }
+        }
+    }
+
+    return BKVS_OK;
+}
+
+/* magic number of the snapshot file, "BKVS" in little-endian. */
+#define BKVS_FILE_MAGIC         0x53564b42
+
+/* version of the snapshot file format. */
+#define BKVS_FILE_VERSION       2
+
+/* size of the snapshot file header. */
+#define BKVS_FILE_HEAD_SIZE     52
+
+/* size of the snapshot file header of version 1, which has no sequence number. */
+#define BKVS_FILE_HEAD_SIZE_V1  44
+
+/* size of the record header: hash, key size and value size. */
+#define BKVS_FILE_REC_SIZE      12
+
+/* size of the buffer used for sequential file writes. */
+#define BKVS_FILE_BUFF_SIZE     (256 * 1024)
+
+/* magic number of the table file, "BKVT" in little-endian. */
+#define BKVS_TABLE_MAGIC        0x54564b42
+
+/* version of the table file format. */
+#define BKVS_TABLE_VERSION      1
+
+/* size of the table file header. */
+#define BKVS_TABLE_HEAD_SIZE    48
+
+/* built-in hash callbacks recorded in the snapshot file. */
+enum _bkvs_hash_id {
+    BKVS_HASH_CUSTOM    = 0,
+    BKVS_HASH_DJB2      = 1,
+    BKVS_HASH_SDBM      = 2,
+
+    /* keyed hash of a set, whose recorded hashes are not reused. */
+    BKVS_HASH_SEEDED    = 3,
+};
+
+/* buffered sequential writer of the snapshot file. */
+typedef struct _bkvs_writer {
+    FILE *file;
+    bkvs_u8 *buff;
+    bkvs_u32 len;
+
+    /* number of the bytes written after the header. */
+    bkvs_u64 size;
+
+    /* checksum of the bytes written after the header. */
+    bkvs_u32 crc;
+
+    /* number of the records written. */
+    bkvs_u32 rec_num;
+
+    /* first error occurred while writing. */
+    bkvs_res res;
+
+    /* set being written, whose compressed values are written decompressed. */
+    struct _bkvs_ctx *ctx;
+} bkvs_writer;
+
+/* lookup table of the CRC-32 of the snapshots, polynomial 0xedb88320. */
+static const bkvs_u32 crc_table[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+static BKVS_THREAD_LOCAL bkvs_writer *save_writer = NULL;
+
+static bkvs_u32 crc32_update(bkvs_u32 crc, const void *data, bkvs_u64 size) {
+    const bkvs_u8 *ptr;
+
+    ptr = (const bkvs_u8 *)data;
+    crc = ~crc;
+    while (size--) {
+        crc = crc_table[(crc ^ *ptr++) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+static void put_u16(bkvs_u8 *ptr, bkvs_u16 val) {
+    ptr[0] = (bkvs_u8)val;
+    ptr[1] = (bkvs_u8)(val >> 8);
+}
+
+static void put_u32(bkvs_u8 *ptr, bkvs_u32 val) {
+    put_u16(ptr, (bkvs_u16)val);
+    put_u16(ptr + 2, (bkvs_u16)(val >> 16));
+}
+
+static void put_u64(bkvs_u8 *ptr, bkvs_u64 val) {
+    put_u32(ptr, (bkvs_u32)val);
+    put_u32(ptr + 4, (bkvs_u32)(val >> 32));
+}
+
+static bkvs_u16 get_u16(const bkvs_u8 *ptr) {
+    return (bkvs_u16)(ptr[0] | (ptr[1] << 8));
+}
+
+static bkvs_u32 get_u32(const bkvs_u8 *ptr) {
+    return get_u16(ptr) | ((bkvs_u32)get_u16(ptr + 2) << 16);
+}
+
+static bkvs_u64 get_u64(const bkvs_u8 *ptr) {
+    return get_u32(ptr) | ((bkvs_u64)get_u32(ptr + 4) << 32);
+}
+
+static bkvs_u32 hash_id(bkvs_hash_cb hash_cb) {
+    if (hash_cb == bkvs_hash_cb_djb2) {
+        return BKVS_HASH_DJB2;
+    } else if (hash_cb == bkvs_hash_cb_sdbm) {
+        return BKVS_HASH_SDBM;
+    }
+
+    return BKVS_HASH_CUSTOM;
+}
+
+/* hash recorded along with the pairs in the snapshot file. */
+static bkvs_u32 file_hash(bkvs_ctx *ctx) {
+    if (ctx->hash.seeded && ctx->frozen.slots == NULL) {
+        return BKVS_HASH_SEEDED;
+    }
+
+    return hash_id(ctx->conf.hash_cb);
+}
+
+static bkvs_res writer_flush(bkvs_writer *writer) {
+    if (writer->len != 0 && writer->res == BKVS_OK) {
+        if (fwrite(writer->buff, 1, writer->len, writer->file) != writer->len) {
+            writer->res = BKVS_ERR_IO;
+        }
+    }
+    writer->len = 0;
+
+    return writer->res;
+}
+
+static bkvs_res writer_put(bkvs_writer *writer, const void *data, bkvs_u32 size) {
+    writer->crc = crc32_update(writer->crc, data, size);
+    writer->size += size;
+
+    /* large data bypasses the buffer. */
+    if (size > BKVS_FILE_BUFF_SIZE - writer->len) {
+        if (writer_flush(writer) != BKVS_OK) {
+            return writer->res;
+        }
+        if (size >= BKVS_FILE_BUFF_SIZE) {
+            if (fwrite(data, 1, size, writer->file) != size) {
+                writer->res = BKVS_ERR_IO;
+            }
+
+            return writer->res;
+        }
+    }
+
+    memcpy(writer->buff + writer->len, data, size);
+    writer->len += size;
+
+    return writer->res;
+}
+
+static bkvs_res writer_put_key(bkvs_writer *writer, const bkvs_pair *pair) {
+    bkvs_u32 prefix_size;
+
+    prefix_size = 0;
+    if ((pair->flags & BKVS_PAIR_PREFIX_KEY) != 0) {
+        prefix_size = pair->prefix->size;
+        writer_put(writer, pair->prefix->data, prefix_size);
+    }
+
+    return writer_put(writer, pair->key, pair->key_size - prefix_size);
+}
+
+static bkvs_res writer_put_value(bkvs_writer *writer, const bkvs_pair *pair) {
+    bkvs_buff value;
+    bkvs_res res;
+
+    res = pair_value(writer->ctx, pair, &value, NULL, 0);
+    if (res != BKVS_OK) {
+        writer->res = res;
+
+        return res;
+    }
+
+    return writer_put(writer, value.ptr, value.size);
+}
+
+static bque_res save_cb(bque_buff *buff, bque_u32 idx, bque_u32 num) {
+    bkvs_u8 head[BKVS_FILE_REC_SIZE];
+    bkvs_pair *pair;
+
+    pair = (bkvs_pair *)buff->ptr;
+    put_u32(head, pair->hash);
+    put_u32(head + 4, pair->key_size);
+    put_u32(head + 8, pair_value_size(pair));
+    save_writer->rec_num++;
+    writer_put(save_writer, head, sizeof(head));
+    writer_put_key(save_writer, pair);
+    if (writer_put_value(save_writer, pair) != BKVS_OK) {
+        return BQUE_ERR_ITER_STOP;
+    }
+
+    return BQUE_OK;
+}
+
+/**
+ * @brief parse the table record at `offset` and advance `offset` past it.
+ * 
+ * @param ctx context pointer.
+ * @param offset offset of the record.
+ * @param end end offset of the records to be parsed.
+ * @param pair pair filled with the hash, sizes and pointers of the record.
+*/
+static bkvs_res map_next(bkvs_ctx *ctx, bkvs_u64 *offset, bkvs_u64 end, bkvs_pair *pair) {
+    const bkvs_u8 *rec;
+    bkvs_u64 rec_size;
+
+    if (*offset >= end) {
+        return BKVS_ERR_NO_KEY;
+    }
+    if (end - *offset < BKVS_FILE_REC_SIZE) {
+        return BKVS_ERR_BAD_FILE;
+    }
+    rec = ctx->map.base + *offset;
+    pair->hash = get_u32(rec);
+    pair->key_size = get_u32(rec + 4);
+    pair->value_size = get_u32(rec + 8);
+    rec_size = BKVS_FILE_REC_SIZE + (bkvs_u64)pair->key_size + pair->value_size;
+    if (pair->key_size == 0 || end - *offset < rec_size) {
+        return BKVS_ERR_BAD_FILE;
+    }
+    pair->key = (char *)rec + BKVS_FILE_REC_SIZE;
+    pair->value = pair->key + pair->key_size;
+    pair->flags = 0;
+    if (pair->key[pair->key_size - 1] != '\0') {
+        return BKVS_ERR_BAD_FILE;
+    }
+    *offset += (rec_size + 7) & ~(bkvs_u64)7;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief rewrite the header of a snapshot once its records are written.
+ * 
+ * @param ctx context pointer.
+ * @param writer writer of the snapshot.
+ * @param seq sequence number of the last change the snapshot contains.
+*/
+static bkvs_res save_head(bkvs_ctx *ctx, bkvs_writer *writer, bkvs_u64 seq) {
+    bkvs_u8 head[BKVS_FILE_HEAD_SIZE];
+
+    put_u32(head, BKVS_FILE_MAGIC);
+    put_u16(head + 4, BKVS_FILE_VERSION);
+    put_u16(head + 6, BKVS_FILE_HEAD_SIZE);
+    put_u32(head + 8, file_hash(ctx));
+    put_u32(head + 12, ctx->conf.bucket_num);
+    put_u32(head + 16, ctx->conf.pair_num_max);
+    put_u32(head + 20, ctx->conf.evict_policy);
+    put_u32(head + 24, writer->rec_num);
+    put_u64(head + 28, writer->size);
+    put_u32(head + 36, writer->crc);
+    put_u64(head + 40, seq);
+    put_u32(head + 48, crc32_update(0, head, BKVS_FILE_HEAD_SIZE - 4));
+    if (writer->res == BKVS_OK &&
+        (fseek(writer->file, 0, SEEK_SET) != 0 ||
+         fwrite(head, 1, sizeof(head), writer->file) != sizeof(head))) {
+        writer->res = BKVS_ERR_IO;
+    }
+
+    return writer->res;
+}
+
+/**
+ * @brief save all the key-value pairs to a snapshot file.
+ * 
+ * the snapshot is written to "<path>.tmp" first and renamed over `path`
+ * once complete, so an existing snapshot is never left half-written.
+ * 
+ * @param ctx context pointer.
+ * @param path path of the snapshot file.
+*/
+bkvs_res bkvs_save(bkvs_ctx *ctx, const char *path) {
+    bkvs_u8 head[BKVS_FILE_HEAD_SIZE];
+    bkvs_writer writer;
+    char *tmp_path;
+    bkvs_u32 path_len;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(path != NULL);
+
+    /* build the temporary path. */
+    path_len = strlen(path);
+    tmp_path = (char *)malloc(path_len + sizeof(".tmp"));
+    if (tmp_path == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+
+    /* prepare writer. */
+    memset(&writer, 0, sizeof(writer));
+    writer.ctx = ctx;
+    writer.buff = (bkvs_u8 *)malloc(BKVS_FILE_BUFF_SIZE);
+    if (writer.buff == NULL) {
+        free(tmp_path);
+
+        return BKVS_ERR_NO_MEM;
+    }
+    writer.file = fopen(tmp_path, "wb");
+    if (writer.file == NULL) {
+        free(writer.buff);
+        free(tmp_path);
+
+        return BKVS_ERR_IO;
+    }
+
+    /* reserve the header, it is filled in once the body is written. */
+    memset(head, 0, sizeof(head));
+    if (fwrite(head, 1, sizeof(head), writer.file) != sizeof(head)) {
+        writer.res = BKVS_ERR_IO;
+    }
+
+    /* write records bucket by bucket. */
+    save_writer = &writer;
+    if (ctx->map.base != NULL) {
+        bkvs_u64 offset;
+        bkvs_pair pair;
+        bque_buff buff;
+
+        offset = BKVS_TABLE_HEAD_SIZE;
+        buff.ptr = (bque_u8 *)&pair;
+        buff.size = sizeof(pair);
+        while (writer.res == BKVS_OK && map_next(ctx, &offset, ctx->map.index_offset, &pair) == BKVS_OK) {
+            save_cb(&buff, 0, 0);
+        }
+    } else if (ctx->frozen.slots != NULL) {
+        bkvs_u64 offset;
+        bkvs_pair pair;
+        bque_buff buff;
+
+        offset = 0;
+        buff.ptr = (bque_u8 *)&pair;
+        buff.size = sizeof(pair);
+        while (writer.res == BKVS_OK && frozen_next(ctx, &offset, &pair) == BKVS_OK) {
+            save_cb(&buff, 0, 0);
+        }
+    } else if (ctx->conf.engine == BKVS_ENGINE_ART) {
+        art_each(ctx->index.root, save_cb);
+    } else if (ctx->conf.engine == BKVS_ENGINE_CUCKOO) {
+        cuckoo_each(ctx, save_cb);
+    } else {
+        for (bkvs_u32 i = 0; i < ctx->conf.bucket_num && writer.res == BKVS_OK; i++) {
+            if (ctx->buckets[i] != NULL) {
+                bucket_each(ctx, i, save_cb);
+            }
+        }
+    }
+    save_writer = NULL;
+    writer_flush(&writer);
+
+    /* write header. */
+    save_head(ctx, &writer, ctx->wal.seq);
+    if (fclose(writer.file) != 0 && writer.res == BKVS_OK) {
+        writer.res = BKVS_ERR_IO;
+    }
+    free(writer.buff);
+
+    /* replace the old snapshot. */
+    if (writer.res == BKVS_OK && rename(tmp_path, path) != 0) {
+        writer.res = BKVS_ERR_IO;
+    }
+    if (writer.res != BKVS_OK) {
+        remove(tmp_path);
+    }
+    free(tmp_path);
+
+    return writer.res;
+}
+
+/**
+ * @brief insert the loaded pairs, whose keys and values point into `data`.
+ * 
+ * @param ctx context pointer.
+ * @param data record section of the snapshot.
+ * @param size size of the record section.
+ * @param pair_num number of the records.
+ * @param reuse_hash whether the recorded hashes match `ctx`'s hash callback.
+*/
+static bkvs_res load_pairs(bkvs_ctx *ctx, bkvs_u8 *data, bkvs_u64 size,
+                           bkvs_u32 pair_num, bkvs_u32 reuse_hash) {
+    bkvs_u64 offset;
+    bkvs_pair pair;
+    bkvs_pair *stored;
+    bkvs_res res;
+
+    offset = 0;
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+
+        /* parse record. */
+        if (size - offset < BKVS_FILE_REC_SIZE) {
+            return BKVS_ERR_BAD_FILE;
+        }
+        memset(&pair, 0, sizeof(pair));
+        pair.hash = get_u32(data + offset);
+        pair.key_size = get_u32(data + offset + 4);
+        pair.value_size = get_u32(data + offset + 8);
+        offset += BKVS_FILE_REC_SIZE;
+        if (pair.key_size == 0 || pair.value_size == 0 ||
+            size - offset < (bkvs_u64)pair.key_size + pair.value_size) {
+            return BKVS_ERR_BAD_FILE;
+        }
+        pair.key = (char *)data + offset;
+        pair.value = (char *)data + offset + pair.key_size;
+        pair.flags = BKVS_PAIR_ARENA_KEY | BKVS_PAIR_ARENA_VALUE;
+        offset += pair.key_size + pair.value_size;
+        if (pair.key[pair.key_size - 1] != '\0') {
+            return BKVS_ERR_BAD_FILE;
+        }
+        if (!reuse_hash) {
+            pair.hash = hash_key(ctx, pair.key, pair.key_size - 1);
+        }
+
+        /* keys of a snapshot are unique, so no search is needed. */
+        res = insert_pair(ctx, &pair, &stored);
+        if (res != BKVS_OK) {
+            return res;
+        }
+        ctx->cache.pair_num++;
+        if (ctx->conf.evict_policy != BKVS_EVICT_NONE) {
+            res = evict_admit(ctx, stored);
+            if (res != BKVS_OK) {
+                return res;
+            }
+        }
+    }
+    if (offset != size) {
+        return BKVS_ERR_BAD_FILE;
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief create a buffer key-value set from a snapshot file.
+ * 
+ * the whole record section is read into one block, which the loaded keys
+ * and values point into, and the set is created with the bucket number of
+ * the snapshot unless configured otherwise.
+ * 
+ * @param path path of the snapshot file.
+ * @param ctx the address of the context pointer.
+ * @param conf configuration pointer, NULL to use the one in the snapshot.
+*/
+bkvs_res bkvs_load(const char *path, bkvs_ctx **ctx, bkvs_conf *conf) {
+    bkvs_u8 head[BKVS_FILE_HEAD_SIZE];
+    bkvs_conf load_conf;
+    bkvs_arena *arena;
+    bkvs_ctx *load_ctx;
+    bkvs_u32 file_hash_id;
+    bkvs_u32 pair_num;
+    bkvs_u32 head_size;
+    bkvs_u64 body_size;
+    bkvs_u64 seq;
+    FILE *file;
+    bkvs_res res;
+
+    BKVS_ASSERT(path != NULL);
+    BKVS_ASSERT(ctx != NULL);
+
+    /* the node is checked here since the block is bound before the set is created. */
+    if (conf != NULL && conf->numa_node > BKVS_NUMA_NODE_MAX) {
+        return BKVS_ERR;
+    }
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return BKVS_ERR_IO;
+    }
+
+    /* read and check header, version 1 is shorter and has no sequence number. */
+    if (fread(head, 1, BKVS_FILE_HEAD_SIZE_V1, file) != BKVS_FILE_HEAD_SIZE_V1) {
+        fclose(file);
+
+        return BKVS_ERR_BAD_FILE;
+    }
+    head_size = get_u16(head + 6);
+    if (get_u32(head) != BKVS_FILE_MAGIC ||
+        !((get_u16(head + 4) == 1 && head_size == BKVS_FILE_HEAD_SIZE_V1) ||
+          (get_u16(head + 4) == BKVS_FILE_VERSION && head_size == BKVS_FILE_HEAD_SIZE)) ||
+        fread(head + BKVS_FILE_HEAD_SIZE_V1, 1, head_size - BKVS_FILE_HEAD_SIZE_V1, file) !=
+            head_size - BKVS_FILE_HEAD_SIZE_V1 ||
+        get_u32(head + head_size - 4) != crc32_update(0, head, head_size - 4)) {
+        fclose(file);
+
+        return BKVS_ERR_BAD_FILE;
+    }
+    seq = head_size == BKVS_FILE_HEAD_SIZE ? get_u64(head + 40) : 0;
+    file_hash_id = get_u32(head + 8);
+    pair_num = get_u32(head + 24);
+    body_size = get_u64(head + 28);
+    if (body_size > (size_t)-1 - sizeof(bkvs_arena) || get_u32(head + 12) > BKVS_BUCKET_MAX) {
+        fclose(file);
+
+        return BKVS_ERR_BAD_FILE;
+    }
+
+    /* read the record section in one go. */
+    arena = (bkvs_arena *)malloc(sizeof(bkvs_arena) + (size_t)body_size);
+    if (arena == NULL) {
+        fclose(file);
+
+        return BKVS_ERR_NO_MEM;
+    }
+    arena->next = NULL;
+    numa_bind(conf != NULL ? conf->numa_node : 0, arena, sizeof(bkvs_arena) + (size_t)body_size);
+    if (fread(arena->data, 1, (size_t)body_size, file) != body_size) {
+        fclose(file);
+        free(arena);
+
+        return BKVS_ERR_BAD_FILE;
+    }
+    fclose(file);
+    if (crc32_update(0, arena->data, body_size) != get_u32(head + 36)) {
+        free(arena);
+
+        return BKVS_ERR_BAD_FILE;
+    }
+
+    /* configure the set, pre-sized to the snapshot. */
+    if (conf != NULL) {
+        load_conf = *conf;
+        if (load_conf.bucket_num == 0) {
+            load_conf.bucket_num = get_u32(head + 12);
+        }
+
+        /* the log is replayed on top of the snapshot, not before it. */
+        load_conf.wal_path = NULL;
+    } else {
+        memset(&load_conf, 0, sizeof(load_conf));
+        if (file_hash_id == BKVS_HASH_DJB2) {
+            load_conf.hash_cb = bkvs_hash_cb_djb2;
+        } else if (file_hash_id == BKVS_HASH_SDBM) {
+            load_conf.hash_cb = bkvs_hash_cb_sdbm;
+        } else if (file_hash_id != BKVS_HASH_SEEDED) {
+
+            /* the custom hash callback must be configured by the caller. */
+            free(arena);
+
+            return BKVS_ERR;
+        }
+        load_conf.bucket_num = get_u32(head + 12);
+        load_conf.pair_num_max = get_u32(head + 16);
+        load_conf.evict_policy = get_u32(head + 20);
+    }
+    res = bkvs_new(&load_ctx, &load_conf);
+    if (res != BKVS_OK) {
+        free(arena);
+
+        return res;
+    }
+    load_ctx->mem.arenas = arena;
+
+    /* insert pairs. */
+    res = load_pairs(load_ctx, arena->data, body_size, pair_num,
+        file_hash_id != BKVS_HASH_CUSTOM && file_hash_id != BKVS_HASH_SEEDED &&
+        file_hash_id == file_hash(load_ctx));
+    if (res != BKVS_OK) {
+        bkvs_del(load_ctx);
+
+        return res;
+    }
+
+    /* replay the changes made after the snapshot. */
+    load_ctx->wal.seq = seq;
+    if (conf != NULL && conf->wal_path != NULL) {
+        res = wal_open(load_ctx, conf->wal_path, conf->wal_sync, conf->wal_batch_num);
+        if (res != BKVS_OK) {
+            bkvs_del(load_ctx);
+
+            return res;
+        }
+    }
+
+    /* output context. */
+    *ctx = load_ctx;
+
+    return BKVS_OK;
+}
+
+static BKVS_THREAD_LOCAL bkvs_pair **collect_pairs = NULL;
+
+static BKVS_THREAD_LOCAL bkvs_u32 collect_num = 0;
+
+static bque_res collect_cb(bque_buff *buff, bque_u32 idx, bque_u32 num) {
+    collect_pairs[collect_num++] = (bkvs_pair *)buff->ptr;
+
+    return BQUE_OK;
+}
+
+/**
+ * @brief write the pairs into a table file that can be mapped by `bkvs_map()`.
+ * 
+ * records are grouped by their table bucket and followed by the bucket
+ * index, the table has a power-of-two bucket number of at least the pair
+ * number so that a lookup scans about one record.
+ * 
+ * @param ctx context pointer.
+ * @param path path of the table file.
+*/
+bkvs_res bkvs_save_table(bkvs_ctx *ctx, const char *path) {
+    static const bkvs_u8 zeros[8] = {0};
+    bkvs_u8 head[BKVS_TABLE_HEAD_SIZE];
+    bkvs_u8 rec[BKVS_FILE_REC_SIZE];
+    bkvs_pair **pairs;
+    bkvs_pair **sorted;
+    bkvs_pair *copies;
+    bkvs_u64 *offsets;
+    bkvs_u32 bucket_num;
+    bkvs_u32 bucket_idx;
+    bkvs_u32 pair_num;
+    bkvs_writer writer;
+    char *tmp_path;
+    bkvs_u32 path_len;
+
+    BKVS_ASSERT(ctx != NULL);
+    BKVS_ASSERT(path != NULL);
+
+    if (ctx->map.base != NULL) {
+        return BKVS_ERR;
+    }
+
+    /* size the table to the pairs. */
+    pair_num = ctx->cache.pair_num;
+    bucket_num = 1;
+    while (bucket_num < pair_num) {
+        bucket_num <<= 1;
+    }
+
+    /* sort the pairs by their table bucket. */
+    pairs = (bkvs_pair **)malloc(sizeof(bkvs_pair *) * (pair_num + 1));
+    sorted = (bkvs_pair **)malloc(sizeof(bkvs_pair *) * (pair_num + 1));
+    offsets = (bkvs_u64 *)calloc(bucket_num + 1, sizeof(bkvs_u64));
+    copies = NULL;
+    tmp_path = NULL;
+    writer.buff = NULL;
+    if (pairs == NULL || sorted == NULL || offsets == NULL) {
+        writer.res = BKVS_ERR_NO_MEM;
+        goto exit;
+    }
+    if (ctx->frozen.slots != NULL) {
+        bkvs_u64 offset;
+
+        /* frozen records carry no hash, copies of them are built instead. */
+        copies = (bkvs_pair *)malloc(sizeof(bkvs_pair) * (pair_num + 1));
+        if (copies == NULL) {
+            writer.res = BKVS_ERR_NO_MEM;
+            goto exit;
+        }
+        offset = 0;
+        for (bkvs_u32 i = 0; i < pair_num && frozen_next(ctx, &offset, &copies[i]) == BKVS_OK; i++) {
+            pairs[i] = &copies[i];
+        }
+    } else {
+        collect_pairs = pairs;
+        collect_num = 0;
+        for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+            if (ctx->buckets[i] != NULL) {
+                bucket_each(ctx, i, collect_cb);
+            }
+        }
+        art_each(ctx->conf.engine == BKVS_ENGINE_ART ? ctx->index.root : NULL, collect_cb);
+        cuckoo_each(ctx, collect_cb);
+        collect_pairs = NULL;
+
+        /* the table is searched with `hash_cb`, copies of the keyed pairs carry its hash. */
+        if (ctx->hash.seeded) {
+            copies = (bkvs_pair *)malloc(sizeof(bkvs_pair) * (pair_num + 1));
+            if (copies == NULL) {
+                writer.res = BKVS_ERR_NO_MEM;
+                goto exit;
+            }
+            for (bkvs_u32 i = 0; i < pair_num; i++) {
+                const char *key;
+
+                copies[i] = *pairs[i];
+                key = pair_key(ctx, pairs[i]);
+                if (key == NULL) {
+                    writer.res = BKVS_ERR_NO_MEM;
+                    goto exit;
+                }
+                copies[i].hash = ctx->conf.hash_cb(key);
+                pairs[i] = &copies[i];
+            }
+        }
+    }
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        offsets[(pairs[i]->hash & (bucket_num - 1)) + 1]++;
+    }
+    for (bkvs_u32 i = 0; i < bucket_num; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        sorted[offsets[pairs[i]->hash & (bucket_num - 1)]++] = pairs[i];
+    }
+
+    /* build the temporary path. */
+    path_len = strlen(path);
+    tmp_path = (char *)malloc(path_len + sizeof(".tmp"));
+    memset(&writer, 0, sizeof(writer));
+    writer.ctx = ctx;
+    writer.buff = (bkvs_u8 *)malloc(BKVS_FILE_BUFF_SIZE);
+    if (tmp_path == NULL || writer.buff == NULL) {
+        writer.res = BKVS_ERR_NO_MEM;
+        goto exit;
+    }
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+    writer.file = fopen(tmp_path, "wb");
+    if (writer.file == NULL) {
+        writer.res = BKVS_ERR_IO;
+        goto exit;
+    }
+
+    /* reserve the header. */
+    memset(head, 0, sizeof(head));
+    writer_put(&writer, head, sizeof(head));
+
+    /* write 8-byte aligned records, noting where each bucket starts. */
+    bucket_idx = 0;
+    for (bkvs_u32 i = 0; i < pair_num && writer.res == BKVS_OK; i++) {
+        bkvs_pair *pair;
+        bkvs_u32 pad;
+
+        pair = sorted[i];
+        while (bucket_idx <= (pair->hash & (bucket_num - 1))) {
+            offsets[bucket_idx++] = writer.size;
+        }
+        put_u32(rec, pair->hash);
+        put_u32(rec + 4, pair->key_size);
+        put_u32(rec + 8, pair_value_size(pair));
+        writer_put(&writer, rec, sizeof(rec));
+        writer_put_key(&writer, pair);
+        writer_put_value(&writer, pair);
+        pad = (8 - (sizeof(rec) + pair->key_size + pair_value_size(pair)) % 8) % 8;
+        writer_put(&writer, zeros, pad);
+    }
+    while (bucket_idx <= bucket_num) {
+        offsets[bucket_idx++] = writer.size;
+    }
+
+    /* write the bucket index. */
+    for (bkvs_u32 i = 0; i <= bucket_num; i++) {
+        bkvs_u8 entry[8];
+
+        put_u64(entry, offsets[i]);
+        writer_put(&writer, entry, sizeof(entry));
+    }
+    writer_flush(&writer);
+
+    /* write header. */
+    put_u32(head, BKVS_TABLE_MAGIC);
+    put_u16(head + 4, BKVS_TABLE_VERSION);
+    put_u16(head + 6, BKVS_TABLE_HEAD_SIZE);
+    put_u32(head + 8, hash_id(ctx->conf.hash_cb));
+    put_u32(head + 12, bucket_num);
+    put_u32(head + 16, pair_num);
+    put_u32(head + 20, 0);
+    put_u64(head + 24, writer.size - sizeof(bkvs_u64) * (bucket_num + 1));
+    put_u64(head + 32, writer.size);
+    put_u32(head + 40, crc32_update(0, head, 40));
+    if (writer.res == BKVS_OK &&
+        (fseek(writer.file, 0, SEEK_SET) != 0 ||
+         fwrite(head, 1, sizeof(head), writer.file) != sizeof(head))) {
+        writer.res = BKVS_ERR_IO;
+    }
+    if (fclose(writer.file) != 0 && writer.res == BKVS_OK) {
+        writer.res = BKVS_ERR_IO;
+    }
+
+    /* replace the old table. */
+    if (writer.res == BKVS_OK && rename(tmp_path, path) != 0) {
+        writer.res = BKVS_ERR_IO;
+    }
+    if (writer.res != BKVS_OK) {
+        remove(tmp_path);
+    }
+
+exit:
+    free(writer.buff);
+    free(tmp_path);
+    free(copies);
+    free(offsets);
+    free(sorted);
+    free(pairs);
+
+    return writer.res;
+}
+
+#ifndef BKVS_NO_POSIX
+
+static bkvs_res map_search(bkvs_ctx *ctx, const char *key, bkvs_pair *pair) {
+    const bkvs_u8 *index;
+    bkvs_u32 key_size;
+    bkvs_u32 hash;
+    bkvs_u32 bucket_idx;
+    bkvs_u64 offset;
+    bkvs_u64 end;
+    bkvs_res res;
+
+    /* locate the records of the bucket. */
+    hash = ctx->conf.hash_cb(key);
+    bucket_idx = hash & (ctx->conf.bucket_num - 1);
+    index = ctx->map.base + ctx->map.index_offset;
+    offset = get_u64(index + (bkvs_u64)bucket_idx * 8);
+    end = get_u64(index + (bkvs_u64)bucket_idx * 8 + 8);
+    if (offset < BKVS_TABLE_HEAD_SIZE || end > ctx->map.index_offset) {
+        return BKVS_ERR_BAD_FILE;
+    }
+
+    /* scan the records. */
+    key_size = strlen(key) + 1;
+    while ((res = map_next(ctx, &offset, end, pair)) == BKVS_OK) {
+        if (pair->hash == hash && pair->key_size == key_size &&
+            memcmp(pair->key, key, key_size) == 0) {
+            return BKVS_OK;
+        }
+    }
+
+    return res;
+}
+
+static bkvs_res map_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb) {
+    bkvs_u32 pair_idx;
+    bkvs_u64 offset;
+    bkvs_pair pair;
+    bkvs_buff buff;
+    bkvs_res res;
+
+    pair_idx = 0;
+    offset = BKVS_TABLE_HEAD_SIZE;
+    while ((res = map_next(ctx, &offset, ctx->map.index_offset, &pair)) == BKVS_OK) {
+        buff.ptr = (bkvs_u8 *)pair.value;
+        buff.size = pair.value_size;
+        if (cb(pair.key, &buff, pair_idx, ctx->cache.pair_num) == BKVS_ERR_ITER_STOP) {
+            return BKVS_ERR_ITER_STOP;
+        }
+        pair_idx++;
+    }
+
+    return res == BKVS_ERR_NO_KEY ? BKVS_OK : res;
+}
+
+static bkvs_res map_status(bkvs_ctx *ctx, bkvs_stat *stat) {
+    const bkvs_u8 *index;
+    bkvs_u64 offset;
+    bkvs_u64 end;
+    bkvs_pair pair;
+    bkvs_res res;
+
+    /* walk the records bucket by bucket. */
+    stat->bucket_num = ctx->conf.bucket_num;
+    index = ctx->map.base + ctx->map.index_offset;
+    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+        bkvs_u32 len;
+
+        offset = get_u64(index + (bkvs_u64)i * 8);
+        end = get_u64(index + (bkvs_u64)i * 8 + 8);
+        if (offset < BKVS_TABLE_HEAD_SIZE || end > ctx->map.index_offset) {
+            return BKVS_ERR_BAD_FILE;
+        }
+        len = 0;
+        while ((res = map_next(ctx, &offset, end, &pair)) == BKVS_OK) {
+            stat->key_size += pair.key_size;
+            stat->value_size += pair.value_size;
+            len++;
+        }
+        if (res != BKVS_ERR_NO_KEY) {
+            return res;
+        }
+        stat_chain(stat, len);
+    }
+
+    /* record headers, padding and the index of the file. */
+    stat->overhead_size += ctx->map.size - stat->key_size - stat->value_size;
+
+    return BKVS_OK;
+}
+
+static void map_del(bkvs_ctx *ctx) {
+    munmap(ctx->map.base, (size_t)ctx->map.size);
+}
+
+/**
+ * @brief create a read-only buffer key-value set backed by a mapped table file.
+ * 
+ * only the header is checked up front, so mapping is O(1) regardless of the
+ * table size, the values returned by `bkvs_get()` point into the shared
+ * read-only mapping and must not be written.
+ * 
+ * @param path path of the table file written by `bkvs_save_table()`.
+ * @param ctx the address of the context pointer.
+ * @param conf configuration pointer, only the hash callback is used and it
+ *             must be given if the table was written with a custom one.
+*/
+bkvs_res bkvs_map(const char *path, bkvs_ctx **ctx, bkvs_conf *conf) {
+    bkvs_hash_cb hash_cb;
+    bkvs_ctx *map_ctx;
+    bkvs_u8 *base;
+    bkvs_u32 file_hash_id;
+    bkvs_u32 bucket_num;
+    bkvs_u64 index_offset;
+    struct stat st;
+    int fd;
+
+    BKVS_ASSERT(path != NULL);
+    BKVS_ASSERT(ctx != NULL);
+
+    /* map the whole file. */
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return BKVS_ERR_IO;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+
+        return BKVS_ERR_IO;
+    }
+    if (st.st_size < BKVS_TABLE_HEAD_SIZE) {
+        close(fd);
+
+        return BKVS_ERR_BAD_FILE;
+    }
+    base = (bkvs_u8 *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return BKVS_ERR_IO;
+    }
+
+    /* check header. */
+    file_hash_id = get_u32(base + 8);
+    bucket_num = get_u32(base + 12);
+    index_offset = get_u64(base + 24);
+    if (get_u32(base) != BKVS_TABLE_MAGIC ||
+        get_u16(base + 4) != BKVS_TABLE_VERSION ||
+        get_u16(base + 6) != BKVS_TABLE_HEAD_SIZE ||
+        get_u32(base + 40) != crc32_update(0, base, 40) ||
+        get_u64(base + 32) != (bkvs_u64)st.st_size ||
+        bucket_num == 0 || (bucket_num & (bucket_num - 1)) != 0 ||
+        index_offset < BKVS_TABLE_HEAD_SIZE ||
+        index_offset + ((bkvs_u64)bucket_num + 1) * 8 != (bkvs_u64)st.st_size) {
+        munmap(base, (size_t)st.st_size);
+
+        return BKVS_ERR_BAD_FILE;
+    }
+
+    /* pick the hash callback the table was written with. */
+    if (conf != NULL && conf->hash_cb != NULL) {
+        hash_cb = conf->hash_cb;
+        if (file_hash_id != BKVS_HASH_CUSTOM && file_hash_id != hash_id(hash_cb)) {
+            munmap(base, (size_t)st.st_size);
+
+            return BKVS_ERR;
+        }
+    } else if (file_hash_id == BKVS_HASH_DJB2) {
+        hash_cb = bkvs_hash_cb_djb2;
+    } else if (file_hash_id == BKVS_HASH_SDBM) {
+        hash_cb = bkvs_hash_cb_sdbm;
+    } else {
+        munmap(base, (size_t)st.st_size);
+
+        return BKVS_ERR;
+    }
+
+    /* allocate context, a mapped set has no buckets of its own. */
+    map_ctx = (bkvs_ctx *)malloc(sizeof(bkvs_ctx));
+    if (map_ctx == NULL) {
+        munmap(base, (size_t)st.st_size);
+
+        return BKVS_ERR_NO_MEM;
+    }
+    memset(map_ctx, 0, sizeof(bkvs_ctx));
+    map_ctx->conf.hash_cb = hash_cb;
+    map_ctx->conf.bucket_num = bucket_num;
+    map_ctx->cache.pair_num = get_u32(base + 16);
+    map_ctx->map.base = base;
+    map_ctx->map.size = (bkvs_u64)st.st_size;
+    map_ctx->map.index_offset = index_offset;
+
+    /* output context. */
+    *ctx = map_ctx;
+
+    return BKVS_OK;
+}
+
+#else
+
+static bkvs_res map_search(bkvs_ctx *ctx, const char *key, bkvs_pair *pair) {
+    return BKVS_ERR;
+}
+
+static bkvs_res map_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb) {
+    return BKVS_ERR;
+}
+
+static bkvs_res map_status(bkvs_ctx *ctx, bkvs_stat *stat) {
+    return BKVS_ERR;
+}
+
+static void map_del(bkvs_ctx *ctx) {
+}
+
+bkvs_res bkvs_map(const char *path, bkvs_ctx **ctx, bkvs_conf *conf) {
+    return BKVS_ERR;
+}
+
+#endif
+
+/* average number of the keys per perfect hash bucket. */
+#define BKVS_MPH_BUCKET_LOAD    4
+
+/* number of the displacements tried for a perfect hash bucket. */
+#define BKVS_MPH_PILOT_MAX      65536
+
+/* number of the seeds tried before the slot number is grown. */
+#define BKVS_MPH_SEED_TRY       8
+
+/* slot of the frozen set that holds no pair. */
+#define BKVS_MPH_SLOT_EMPTY     0xffffffff
+
+static bkvs_u64 mph_mix(bkvs_u64 x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+static bkvs_u64 mph_hash(const char *key, bkvs_u32 size, bkvs_u64 seed) {
+    const bkvs_u8 *ptr;
+    bkvs_u64 hash;
+    bkvs_u64 word;
+
+    ptr = (const bkvs_u8 *)key;
+    hash = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+    while (size >= 8) {
+        memcpy(&word, ptr, 8);
+        hash = (hash ^ mph_mix(word)) * 0x9fb21c651e98df25ULL;
+        ptr += 8;
+        size -= 8;
+    }
+    word = 0;
+    memcpy(&word, ptr, size);
+
+    return mph_mix(hash ^ word);
+}
+
+static bkvs_u32 mph_bucket(bkvs_ctx *ctx, bkvs_u64 hash) {
+    return (bkvs_u32)(hash >> 32) % ctx->frozen.pilot_num;
+}
+
+static bkvs_u32 mph_slot(bkvs_ctx *ctx, bkvs_u64 hash, bkvs_u32 pilot) {
+    return (bkvs_u32)(mph_mix(hash ^ (pilot * 0x9e3779b97f4a7c15ULL)) % ctx->frozen.slot_num);
+}
+
+static void frozen_free(bkvs_ctx *ctx) {
+    free(ctx->frozen.blob);
+    free(ctx->frozen.slots);
+    free(ctx->frozen.pilots);
+    memset(&ctx->frozen, 0, sizeof(ctx->frozen));
+}
+
+static void frozen_record(bkvs_ctx *ctx, bkvs_u64 offset, bkvs_pair *pair) {
+    const bkvs_u8 *rec;
+
+    rec = ctx->frozen.blob + offset;
+    memcpy(&pair->key_size, rec, 4);
+    memcpy(&pair->value_size, rec + 4, 4);
+    pair->key = (char *)rec + 8;
+    pair->value = pair->key + pair->key_size;
+    pair->flags = 0;
+}
+
+static bkvs_res frozen_search(bkvs_ctx *ctx, const char *key, bkvs_pair *pair) {
+    bkvs_u32 key_size;
+    bkvs_u64 hash;
+    bkvs_u32 slot;
+
+    key_size = strlen(key) + 1;
+    hash = mph_hash(key, key_size - 1, ctx->frozen.seed);
+    slot = mph_slot(ctx, hash, ctx->frozen.pilots[mph_bucket(ctx, hash)]);
+    if (ctx->frozen.slots[slot] == BKVS_MPH_SLOT_EMPTY) {
+        return BKVS_ERR_NO_KEY;
+    }
+
+    /* the slot is the only candidate, it holds the key or the key is absent. */
+    frozen_record(ctx, (bkvs_u64)ctx->frozen.slots[slot] * 8, pair);
+    if (pair->key_size != key_size || memcmp(pair->key, key, key_size) != 0) {
+        return BKVS_ERR_NO_KEY;
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief get the frozen record at `offset` and advance `offset` past it.
+ * 
+ * @param ctx context pointer.
+ * @param offset offset of the record, 0 for the first one.
+ * @param pair pair filled with the record, including its hash.
+*/
+static bkvs_res frozen_next(bkvs_ctx *ctx, bkvs_u64 *offset, bkvs_pair *pair) {
+    for (; *offset < ctx->frozen.slot_num; (*offset)++) {
+        if (ctx->frozen.slots[*offset] != BKVS_MPH_SLOT_EMPTY) {
+            frozen_record(ctx, (bkvs_u64)ctx->frozen.slots[*offset] * 8, pair);
+            pair->hash = ctx->conf.hash_cb(pair->key);
+            (*offset)++;
+
+            return BKVS_OK;
+        }
+    }
+
+    return BKVS_ERR_NO_KEY;
+}
+
+static void frozen_status(bkvs_ctx *ctx, bkvs_stat *stat) {
+    bkvs_u64 blob_size;
+    bkvs_u64 offset;
+    bkvs_pair pair;
+
+    /* every pair sits alone in its slot. */
+    stat->bucket_num = ctx->frozen.slot_num;
+    stat->chain_hist[0] = ctx->frozen.slot_num - ctx->cache.pair_num;
+    stat->chain_hist[1] = ctx->cache.pair_num;
+    stat->bucket_used_num = ctx->cache.pair_num;
+    stat->chain_max = ctx->cache.pair_num != 0 ? 1 : 0;
+
+    blob_size = 0;
+    offset = 0;
+    while (frozen_next(ctx, &offset, &pair) == BKVS_OK) {
+        stat->key_size += pair.key_size;
+        stat->value_size += pair.value_size;
+        blob_size += (8 + (bkvs_u64)pair.key_size + pair.value_size + 7) & ~(bkvs_u64)7;
+    }
+    stat->overhead_size += blob_size - stat->key_size - stat->value_size +
+        sizeof(bkvs_u32) * ctx->frozen.slot_num + sizeof(bkvs_u16) * ctx->frozen.pilot_num +
+        BKVS_STAT_ALLOC_HEAD * 3;
+}
+
+static bkvs_res frozen_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb) {
+    bkvs_u32 pair_idx;
+    bkvs_pair pair;
+    bkvs_buff buff;
+
+    pair_idx = 0;
+    for (bkvs_u32 i = 0; i < ctx->frozen.slot_num; i++) {
+        if (ctx->frozen.slots[i] == BKVS_MPH_SLOT_EMPTY) {
+            continue;
+        }
+        frozen_record(ctx, (bkvs_u64)ctx->frozen.slots[i] * 8, &pair);
+        buff.ptr = (bkvs_u8 *)pair.value;
+        buff.size = pair.value_size;
+        if (cb(pair.key, &buff, pair_idx, ctx->cache.pair_num) == BKVS_ERR_ITER_STOP) {
+            return BKVS_ERR_ITER_STOP;
+        }
+        pair_idx++;
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief find a displacement for every perfect hash bucket.
+ * 
+ * buckets are placed from the largest to the smallest, each one gets the
+ * first displacement that sends all of its keys to distinct free slots.
+ * 
+ * @param ctx context pointer, with the frozen arrays allocated.
+ * @param hashes hashes of the keys.
+ * @param key_num number of the keys.
+ * @param order scratch array of `key_num` entries.
+ * @param starts scratch array of `pilot_num + 1` entries.
+*/
+static bkvs_res mph_build(bkvs_ctx *ctx, const bkvs_u64 *hashes, bkvs_u32 key_num,
+                          bkvs_u32 *order, bkvs_u32 *starts) {
+    bkvs_u32 pilot_num;
+    bkvs_u32 *by_size;
+    bkvs_u32 size_max;
+    bkvs_u32 size_starts[BKVS_MPH_BUCKET_LOAD * 16 + 2];
+
+    pilot_num = ctx->frozen.pilot_num;
+
+    /* group the keys by bucket. */
+    memset(starts, 0, sizeof(bkvs_u32) * (pilot_num + 1));
+    for (bkvs_u32 i = 0; i < key_num; i++) {
+        starts[mph_bucket(ctx, hashes[i]) + 1]++;
+    }
+    size_max = 0;
+    for (bkvs_u32 i = 0; i < pilot_num; i++) {
+        if (starts[i + 1] > size_max) {
+            size_max = starts[i + 1];
+        }
+        starts[i + 1] += starts[i];
+    }
+
+    /* an overfull bucket hints at a bad seed. */
+    if (size_max > BKVS_MPH_BUCKET_LOAD * 16) {
+        return BKVS_ERR;
+    }
+    for (bkvs_u32 i = 0; i < key_num; i++) {
+        order[starts[mph_bucket(ctx, hashes[i])]++] = i;
+    }
+    for (bkvs_u32 i = pilot_num; i > 0; i--) {
+        starts[i] = starts[i - 1];
+    }
+    starts[0] = 0;
+
+    /* sort the buckets by size, largest first. */
+    by_size = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * pilot_num);
+    if (by_size == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    memset(size_starts, 0, sizeof(size_starts));
+    for (bkvs_u32 i = 0; i < pilot_num; i++) {
+        size_starts[size_max - (starts[i + 1] - starts[i]) + 1]++;
+    }
+    for (bkvs_u32 i = 0; i <= size_max; i++) {
+        size_starts[i + 1] += size_starts[i];
+    }
+    for (bkvs_u32 i = 0; i < pilot_num; i++) {
+        by_size[size_starts[size_max - (starts[i + 1] - starts[i])]++] = i;
+    }
+
+    /* place the buckets. */
+    for (bkvs_u32 i = 0; i < ctx->frozen.slot_num; i++) {
+        ctx->frozen.slots[i] = BKVS_MPH_SLOT_EMPTY;
+    }
+    for (bkvs_u32 i = 0; i < pilot_num; i++) {
+        bkvs_u32 bucket_idx;
+        bkvs_u32 pilot;
+        bkvs_u32 j;
+
+        bucket_idx = by_size[i];
+        if (starts[bucket_idx] == starts[bucket_idx + 1]) {
+            ctx->frozen.pilots[bucket_idx] = 0;
+            continue;
+        }
+        for (pilot = 0; pilot < BKVS_MPH_PILOT_MAX; pilot++) {
+
+            /* claim the slots, rolling back on the first collision. */
+            for (j = starts[bucket_idx]; j < starts[bucket_idx + 1]; j++) {
+                bkvs_u32 slot = mph_slot(ctx, hashes[order[j]], pilot);
+                if (ctx->frozen.slots[slot] != BKVS_MPH_SLOT_EMPTY) {
+                    break;
+                }
+                ctx->frozen.slots[slot] = order[j];
+            }
+            if (j == starts[bucket_idx + 1]) {
+                break;
+            }
+            while (j-- > starts[bucket_idx]) {
+                ctx->frozen.slots[mph_slot(ctx, hashes[order[j]], pilot)] = BKVS_MPH_SLOT_EMPTY;
+            }
+        }
+        if (pilot == BKVS_MPH_PILOT_MAX) {
+            free(by_size);
+
             return BKVS_ERR;
         }
-    }
+        ctx->frozen.pilots[bucket_idx] = (bkvs_u16)pilot;
+    }
+    free(by_size);
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief freeze the buffer key-value set for read-only use.
+ * 
+ * keys and values are compacted into one block of records, indexed by a
+ * minimal-ish perfect hash (hash-and-displace, about 5% spare slots) so that
+ * `bkvs_get()` and `bkvs_has()` probe exactly one record. `bkvs_put()` and
+ * `bkvs_drop()` fail on a frozen set, `bkvs_empty()` thaws it.
+ * 
+ * @param ctx context pointer.
+*/
+bkvs_res bkvs_freeze(bkvs_ctx *ctx) {
+    bkvs_pair **pairs;
+    bkvs_u64 *hashes;
+    bkvs_u32 *order;
+    bkvs_u32 *starts;
+    bkvs_u32 *rec_offsets;
+    bkvs_u32 pair_num;
+    bkvs_u64 blob_size;
+    bkvs_u64 seed;
+    bkvs_res res;
+
+    BKVS_ASSERT(ctx != NULL);
+
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+
+    /* the compaction and the live views use the buckets, which freezing releases. */
+    if (ctx->compact.writer != NULL || ctx->snap.head != NULL) {
+        return BKVS_ERR;
+    }
+
+    /* collect the pairs and size their records. */
+    pair_num = ctx->cache.pair_num;
+    pairs = (bkvs_pair **)malloc(sizeof(bkvs_pair *) * (pair_num + 1));
+    hashes = (bkvs_u64 *)malloc(sizeof(bkvs_u64) * (pair_num + 1));
+    order = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * (pair_num + 1));
+    rec_offsets = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * (pair_num + 1));
+    starts = NULL;
+    if (pairs == NULL || hashes == NULL || order == NULL || rec_offsets == NULL) {
+        res = BKVS_ERR_NO_MEM;
+        goto exit;
+    }
+    collect_pairs = pairs;
+    collect_num = 0;
+    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
+        if (ctx->buckets[i] != NULL) {
+            bucket_each(ctx, i, collect_cb);
+        }
+    }
+    art_each(ctx->conf.engine == BKVS_ENGINE_ART ? ctx->index.root : NULL, collect_cb);
+    cuckoo_each(ctx, collect_cb);
+    collect_pairs = NULL;
+    blob_size = 0;
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        if (blob_size / 8 >= BKVS_MPH_SLOT_EMPTY) {
+            res = BKVS_ERR;
+            goto exit;
+        }
+        rec_offsets[i] = (bkvs_u32)(blob_size / 8);
+        blob_size += (8 + (bkvs_u64)pairs[i]->key_size + pair_value_size(pairs[i]) + 7) & ~(bkvs_u64)7;
+    }
+
+    /* build the perfect hash, growing the slots if no seed works. */
+    ctx->frozen.pilot_num = pair_num / BKVS_MPH_BUCKET_LOAD + 1;
+    ctx->frozen.slot_num = pair_num + pair_num / 20 + 1;
+    starts = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * (ctx->frozen.pilot_num + 1));
+    ctx->frozen.pilots = (bkvs_u16 *)malloc(sizeof(bkvs_u16) * ctx->frozen.pilot_num);
+    ctx->frozen.blob = (bkvs_u8 *)malloc((size_t)blob_size + 8);
+    if (starts == NULL || ctx->frozen.pilots == NULL || ctx->frozen.blob == NULL) {
+        res = BKVS_ERR_NO_MEM;
+        goto exit;
+    }
+    numa_bind(ctx->conf.numa_node, ctx->frozen.blob, (size_t)blob_size + 8);
+    seed = 0x2545f4914f6cdd1dULL;
+    while (1) {
+        free(ctx->frozen.slots);
+        ctx->frozen.slots = (bkvs_u32 *)malloc(sizeof(bkvs_u32) * ctx->frozen.slot_num);
+        if (ctx->frozen.slots == NULL) {
+            res = BKVS_ERR_NO_MEM;
+            goto exit;
+        }
+        numa_bind(ctx->conf.numa_node, ctx->frozen.slots, sizeof(bkvs_u32) * ctx->frozen.slot_num);
+        res = BKVS_ERR;
+        for (bkvs_u32 seed_try = 0; seed_try < BKVS_MPH_SEED_TRY && res == BKVS_ERR; seed_try++) {
+            seed = mph_mix(seed + seed_try);
+            ctx->frozen.seed = seed;
+            for (bkvs_u32 i = 0; i < pair_num; i++) {
+                const char *key;
+
+                key = pair_key(ctx, pairs[i]);
+                if (key == NULL) {
+                    res = BKVS_ERR_NO_MEM;
+                    goto exit;
+                }
+                hashes[i] = mph_hash(key, pairs[i]->key_size - 1, seed);
+            }
+            res = mph_build(ctx, hashes, pair_num, order, starts);
+        }
+        if (res != BKVS_ERR) {
+            break;
+        }
+        ctx->frozen.slot_num += ctx->frozen.slot_num / 10 + 1;
+    }
+    if (res != BKVS_OK) {
+        goto exit;
+    }
+
+    /* copy the records and point the slots at them. */
+    for (bkvs_u32 i = 0; i < pair_num; i++) {
+        bkvs_u32 value_size;
+        bkvs_u8 *rec;
+
+        rec = ctx->frozen.blob + (bkvs_u64)rec_offsets[i] * 8;
+        value_size = pair_value_size(pairs[i]);
+        memcpy(rec, &pairs[i]->key_size, 4);
+        memcpy(rec + 4, &value_size, 4);
+        pair_key_copy(pairs[i], (char *)rec + 8);
+        res = pair_value_copy(ctx, pairs[i], rec + 8 + pairs[i]->key_size);
+        if (res != BKVS_OK) {
+            goto exit;
+        }
+    }
+    for (bkvs_u32 i = 0; i < ctx->frozen.slot_num; i++) {
+        if (ctx->frozen.slots[i] != BKVS_MPH_SLOT_EMPTY) {
+            ctx->frozen.slots[i] = rec_offsets[ctx->frozen.slots[i]];
+        }
+    }
+
+    /* release the buckets, the frozen records replace them. */
+    empty_pairs(ctx);
+    ctx->cache.pair_num = pair_num;
+
+exit:
+    if (res != BKVS_OK) {
+        frozen_free(ctx);
+    }
+    free(starts);
+    free(rec_offsets);
+    free(order);
+    free(hashes);
+    free(pairs);
+
+    return res;
+}
+
+/* magic number of the log file, "BKVW" in little-endian. */
+#define BKVS_WAL_MAGIC          0x57564b42
+
+/* version of the log file format. */
+#define BKVS_WAL_VERSION        1
+
+/* size of the log file header. */
+#define BKVS_WAL_HEAD_SIZE      8
+
+/* size of the record header: checksum, length, sequence number, type, key size and value size. */
+#define BKVS_WAL_REC_SIZE       29
+
+/* size of the buffer holding records not written yet. */
+#define BKVS_WAL_BUFF_SIZE      (64 * 1024)
+
+/* default number of the records per group commit. */
+#define BKVS_WAL_DEF_BATCH_NUM  64
+
+#ifndef BKVS_NO_POSIX
+
+static bkvs_res write_all(int fd, const void *data, bkvs_u64 size) {
+    const bkvs_u8 *ptr;
+    ssize_t len;
+
+    ptr = (const bkvs_u8 *)data;
+    while (size != 0) {
+        len = write(fd, ptr, (size_t)size);
+        if (len < 0) {
+            return BKVS_ERR_IO;
+        }
+        ptr += len;
+        size -= len;
+    }
+
+    return BKVS_OK;
+}
+
+static bkvs_res wal_write(bkvs_ctx *ctx) {
+    bkvs_res res;
+
+    res = write_all(ctx->wal.fd, ctx->wal.buff, ctx->wal.len);
+    ctx->wal.len = 0;
+
+    return res;
+}
+
+/**
+ * @brief write the buffered records and fsync the log file.
+ * 
+ * @param ctx context pointer.
+*/
+static bkvs_res wal_commit(bkvs_ctx *ctx) {
+    bkvs_res res;
+
+    res = wal_write(ctx);
+    if (res != BKVS_OK) {
+        return res;
+    }
+    if (fsync(ctx->wal.fd) != 0) {
+        return BKVS_ERR_IO;
+    }
+    ctx->wal.pending = 0;
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief check the changes of a batch and count them.
+ * 
+ * @param data encoded changes.
+ * @param len size of the changes.
+ * @param num number of the changes, may be NULL.
+*/
+static bkvs_res batch_check(const bkvs_u8 *data, bkvs_u32 len, bkvs_u32 *num) {
+    bkvs_u32 key_size;
+    bkvs_u32 value_size;
+    bkvs_u32 op_num;
+    bkvs_u64 off;
+    bkvs_u8 type;
+
+    op_num = 0;
+    off = 0;
+    while (off < len) {
+        if (len - off < BKVS_BATCH_OP_SIZE) {
+            return BKVS_ERR_BAD_FILE;
+        }
+        type = data[off];
+        key_size = get_u32(data + off + 1);
+        value_size = get_u32(data + off + 5);
+        off += BKVS_BATCH_OP_SIZE;
+        if ((type != BKVS_WAL_PUT && type != BKVS_WAL_DROP) ||
+            (type == BKVS_WAL_PUT) != (value_size != 0) ||
+            key_size == 0 || (bkvs_u64)key_size + value_size > len - off ||
+            memchr(data + off, '\0', key_size) != data + off + key_size - 1) {
+            return BKVS_ERR_BAD_FILE;
+        }
+        off += (bkvs_u64)key_size + value_size;
+        op_num++;
+    }
+    if (num != NULL) {
+        *num = op_num;
+    }
+
+    return BKVS_OK;
+}
+
+/**
+ * @brief apply the records of the log file newer than the set.
+ * 
+ * replaying stops at the first torn or corrupted record, which is where the
+ * log has to be truncated before new records are appended.
+ * 
+ * @param ctx context pointer.
+ * @param file log file positioned after its header.
+ * @param end offset right after the last good record.
+*/
+static bkvs_res wal_replay(bkvs_ctx *ctx, FILE *file, bkvs_u64 *end) {
+    bkvs_u8 head[BKVS_WAL_REC_SIZE];
+    bkvs_u32 batch_num;
+    bkvs_u8 *body;
+    bkvs_u32 body_cap;
+    bkvs_res res;
+
+    batch_num = 0;
+    body = NULL;
+    body_cap = 0;
+    res = BKVS_OK;
+    while (fread(head, 1, sizeof(head), file) == sizeof(head)) {
+        bkvs_u32 key_size;
+        bkvs_u32 value_size;
+        bkvs_u64 body_size;
+        bkvs_u64 seq;
+        bkvs_u8 type;
+        const char *key;
+
+        /* parse record header. */
+        seq = get_u64(head + 8);
+        type = head[16];
+        key_size = get_u32(head + 17);
+        value_size = get_u32(head + 21);
+        body_size = (bkvs_u64)key_size + value_size;
+        if (get_u32(head + 4) != 17 + body_size || body_size > 0xffffffff) {
+            break;
+        }
+
+        /* read key and value. */
+        if (body_size > body_cap) {
+            bkvs_u8 *alloc_body;
+
+            alloc_body = (bkvs_u8 *)realloc(body, (size_t)body_size);
+            if (alloc_body == NULL) {
+                res = BKVS_ERR_NO_MEM;
+                break;
+            }
+            body = alloc_body;
+            body_cap = (bkvs_u32)body_size;
+        }
+        if (fread(body, 1, (size_t)body_size, file) != body_size ||
+            crc32_update(crc32_update(0, head + 8, sizeof(head) - 8), body, body_size) != get_u32(head)) {
+            break;
+        }
+        key = (const char *)body;
+        if (type == BKVS_WAL_EMPTY) {
+            if (body_size != 0) {
+                break;
+            }
+        } else if (type == BKVS_WAL_BATCH) {
+            if (key_size != 0 || value_size == 0 || batch_check(body, value_size, &batch_num) != BKVS_OK) {
+                break;
+            }
+        } else if (key_size == 0 || key[key_size - 1] != '\0' ||
+                   (type == BKVS_WAL_PUT && value_size == 0) ||
+                   (type == BKVS_WAL_DROP && value_size != 0) ||
+                   (type != BKVS_WAL_PUT && type != BKVS_WAL_DROP)) {
+            break;
+        }
+
+        /* apply the changes the set has not seen yet. */
+        if (seq > ctx->wal.seq) {
+            if (type == BKVS_WAL_PUT) {
+                res = put_pair(ctx, key, body + key_size, value_size);
+            } else if (type == BKVS_WAL_DROP) {
+                res = drop_pair(ctx, key);
+                if (res == BKVS_ERR_NO_KEY) {
+                    res = BKVS_OK;
+                }
+            } else if (type == BKVS_WAL_BATCH) {
+                res = batch_apply(ctx, body, value_size, batch_num);
+            } else {
+                empty_pairs(ctx);
+            }
+            if (res != BKVS_OK) {
+                break;
+            }
+            ctx->wal.seq = seq;
+        }
+        *end += sizeof(head) + body_size;
+    }
+    free(body);
+
+    return res;
+}
+
+/**
+ * @brief replay a log file.
+ * 
+ * @param ctx context pointer.
+ * @param path path of the log file.
+ * @param end offset right after the last good record, 0 if the file is
+ *            missing or has no header.
+*/
+static bkvs_res wal_replay_file(bkvs_ctx *ctx, const char *path, bkvs_u64 *end) {
+    bkvs_u8 head[BKVS_WAL_HEAD_SIZE];
+    FILE *file;
+    bkvs_res res;
+
+    *end = 0;
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return BKVS_OK;
+    }
+    res = BKVS_OK;
+    if (fread(head, 1, sizeof(head), file) == sizeof(head)) {
+        if (get_u32(head) != BKVS_WAL_MAGIC || get_u16(head + 4) != BKVS_WAL_VERSION) {
+            res = BKVS_ERR_BAD_FILE;
+        } else {
+            *end = BKVS_WAL_HEAD_SIZE;
+            res = wal_replay(ctx, file, end);
+        }
+    }
+    fclose(file);
+
+    return res;
+}
+
+static char *path_append(const char *path, const char *suffix) {
+    char *alloc_path;
+
+    alloc_path = (char *)malloc(strlen(path) + strlen(suffix) + 1);
+    if (alloc_path != NULL) {
+        strcpy(alloc_path, path);
+        strcat(alloc_path, suffix);
+    }
+
+    return alloc_path;
+}
+
+/**
+ * @brief fsync the directory holding `path`, making renames in it durable.
+ * 
+ * @param path path of a file in the directory.
+*/
+static bkvs_res sync_dir(const char *path) {
+    const char *slash;
+    char *dir_path;
+    bkvs_res res;
+    int fd;
+
+    slash = strrchr(path, '/');
+    if (slash == NULL) {
+        dir_path = path_append(".", "");
+    } else if (slash == path) {
+        dir_path = path_append("/", "");
+    } else {
+        dir_path = (char *)malloc(slash - path + 1);
+        if (dir_path != NULL) {
+            memcpy(dir_path, path, slash - path);
+            dir_path[slash - path] = '\0';
+        }
+    }
+    if (dir_path == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+
+    res = BKVS_OK;
+    fd = open(dir_path, O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0) {
+        res = BKVS_ERR_IO;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(dir_path);
+
+    return res;
+}
+
+/**
+ * @brief replay "<path>.next" and append its records to the log.
+ * 
+ * @param ctx context pointer.
+ * @param path path of the log file.
+ * @param fd descriptor of the log file, opened for appending.
+*/
+static bkvs_res wal_merge_next(bkvs_ctx *ctx, const char *path, int fd) {
+    bkvs_u8 buff[4096];
+    char *next_path;
+    bkvs_u64 end;
+    bkvs_u64 left;
+    FILE *file;
+    bkvs_res res;
+
+    next_path = path_append(path, ".next");
+    if (next_path == NULL) {
+        return BKVS_ERR_NO_MEM;
+    }
+    res = wal_replay_file(ctx, next_path, &end);
+    if (res != BKVS_OK || end == 0) {
+        if (res == BKVS_OK) {
+            remove(next_path);
+        }
+        free(next_path);
+
+        return res;
+    }
+
+    /* copy the good records. */
+    file = fopen(next_path, "rb");
+    if (file == NULL || fseek(file, BKVS_WAL_HEAD_SIZE, SEEK_SET) != 0) {
+        res = BKVS_ERR_IO;
+    }
+    left = end - BKVS_WAL_HEAD_SIZE;
+    while (res == BKVS_OK && left != 0) {
+        size_t len;
+
+        len = left < sizeof(buff) ? (size_t)left : sizeof(buff);
+        if (fread(buff, 1, len, file) != len) {
+            res = BKVS_ERR_IO;
+        } else {
+            res = write_all(fd, buff, len);
+            left -= len;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (res == BKVS_OK && fsync(fd) != 0) {
+        res = BKVS_ERR_IO;
+    }
+    if (res == BKVS_OK) {
+        remove(next_path);
+    }
+    free(next_path);
+
+    return res;
+}
+
+/**
+ * @brief replay the log file and open it for appending.
+ * 
+ * @param ctx context pointer.
+ * @param path path of the log file, created if it does not exist.
+ * @param sync sync policy.
+ * @param batch_num number of the records per group commit.
+*/
+static bkvs_res wal_open(bkvs_ctx *ctx, const char *path, bkvs_u32 sync, bkvs_u32 batch_num) {
+    bkvs_u8 head[BKVS_WAL_HEAD_SIZE];
+    bkvs_u64 end;
+    bkvs_res res;
+    int fd;
+
+    if (sync > BKVS_WAL_SYNC_NONE) {
+        return BKVS_ERR;
+    }
+
+    /* replay the existing log. */
+    res = wal_replay_file(ctx, path, &end);
+    if (res != BKVS_OK) {
+        return res;
+    }
+
+    /* drop the torn tail, or start a new log. */
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return BKVS_ERR_IO;
+    }
+    if (end == 0) {
+        memset(head, 0, sizeof(head));
+        put_u32(head, BKVS_WAL_MAGIC);
+        put_u16(head + 4, BKVS_WAL_VERSION);
+        if (ftruncate(fd, 0) != 0 || write_all(fd, head, sizeof(head)) != BKVS_OK) {
+            close(fd);
+
+            return BKVS_ERR_IO;
+        }
+    } else if (ftruncate(fd, (off_t)end) != 0) {
+        close(fd);
 
-    return BKVS_OK;
-}
+        return BKVS_ERR_IO;
+    }
 
-static bkvs_res create_pair(bkvs_pair *pair, const char *key, const void *buff, bkvs_u32 size) {
-    bkvs_u32 key_size;
-    char *alloc_key;
-    char *alloc_value;
+    /* a log rotated by an unfinished compaction is replayed and merged back. */
+    res = wal_merge_next(ctx, path, fd);
+    if (res != BKVS_OK) {
+        close(fd);
 
-    BKVS_ASSERT(pair != NULL);
-    BKVS_ASSERT(key != NULL);
-    BKVS_ASSERT(buff != NULL);
-    BKVS_ASSERT(size != 0);
+        return res;
+    }
+    if (fsync(fd) != 0) {
+        close(fd);
 
-    /* allocate memory for key. */
-    key_size = strlen(key) + 1;
-    alloc_key = (char *)malloc(key_size);
-    if (alloc_key == NULL) {
-        return BKVS_ERR_NO_MEM;
+        return BKVS_ERR_IO;
     }
 
-    /* allocate memory for value. */
-    alloc_value = (char *)malloc(size);
-    if (alloc_value == NULL) {
-        free(alloc_key);
+    /* enable logging. */
+    ctx->wal.buff = (bkvs_u8 *)malloc(BKVS_WAL_BUFF_SIZE);
+    ctx->wal.path = (char *)malloc(strlen(path) + 1);
+    if (ctx->wal.buff == NULL || ctx->wal.path == NULL) {
+        free(ctx->wal.buff);
+        free(ctx->wal.path);
+        ctx->wal.buff = NULL;
+        ctx->wal.path = NULL;
+        close(fd);
 
         return BKVS_ERR_NO_MEM;
     }
+    strcpy(ctx->wal.path, path);
+    ctx->wal.fd = fd;
+    ctx->wal.sync = sync;
+    ctx->wal.batch_num = batch_num != 0 ? batch_num : BKVS_WAL_DEF_BATCH_NUM;
+    ctx->wal.pending = 0;
+    ctx->wal.len = 0;
 
-    // /* allocate memory for key-value pair. */
-    // alloc_pair = (bkvs_pair *)malloc(sizeof(bkvs_pair));
-    // if (alloc_pair == NULL) {
-    //     free(alloc_key);
-    //     free(alloc_value);
+    return BKVS_OK;
+}
 
-    //     return BKVS_ERR_NO_MEM;
-    // }
+/**
+ * @brief append a change to the log, committing it as the sync policy says.
+ * 
+ * @param ctx context pointer.
+ * @param type record type.
+ * @param key key of the change, NULL for `BKVS_WAL_EMPTY`.
+ * @param value value of the change, NULL unless `BKVS_WAL_PUT`.
+ * @param value_size size of the value.
+*/
+static bkvs_res wal_append(bkvs_ctx *ctx, bkvs_u8 type, const char *key, const void *value, bkvs_u32 value_size) {
+    bkvs_u8 head[BKVS_WAL_REC_SIZE];
+    bkvs_u32 key_size;
+    bkvs_u64 rec_size;
+    bkvs_u32 crc;
+    bkvs_res res;
 
-    /* copy key and value. */
-    memcpy(alloc_key, key, key_size);
-    memcpy(alloc_value, buff, size);
+    if (ctx->wal.path == NULL) {
+        return BKVS_OK;
+    }
 
-    /* initialize key-value pair. */
-    pair->key = alloc_key;
-    pair->key_size = key_size;
-    pair->value = alloc_value;
-    pair->value_size = size;
+    /* build record header. */
+    key_size = key != NULL ? strlen(key) + 1 : 0;
+    rec_size = sizeof(head) + (bkvs_u64)key_size + value_size;
+    put_u32(head + 4, 17 + key_size + value_size);
+    put_u64(head + 8, ++ctx->wal.seq);
+    head[16] = type;
+    put_u32(head + 17, key_size);
+    put_u32(head + 21, value_size);
+    crc = crc32_update(0, head + 8, sizeof(head) - 8);
+    crc = crc32_update(crc, key, key_size);
+    crc = crc32_update(crc, value, value_size);
+    put_u32(head, crc);
 
-    // /* output key-value pair. */
-    // *pair = alloc_pair;
+    /* buffer the record, huge ones are written straight away. */
+    if (rec_size > BKVS_WAL_BUFF_SIZE - ctx->wal.len) {
+        res = wal_write(ctx);
+        if (res != BKVS_OK) {
+            return res;
+        }
+    }
+    if (rec_size > BKVS_WAL_BUFF_SIZE) {
+        if (write_all(ctx->wal.fd, head, sizeof(head)) != BKVS_OK ||
+            write_all(ctx->wal.fd, key, key_size) != BKVS_OK ||
+            write_all(ctx->wal.fd, value, value_size) != BKVS_OK) {
+            return BKVS_ERR_IO;
+        }
+    } else {
+        memcpy(ctx->wal.buff + ctx->wal.len, head, sizeof(head));
+        ctx->wal.len += sizeof(head);
+        if (key_size != 0) {
+            memcpy(ctx->wal.buff + ctx->wal.len, key, key_size);
+            ctx->wal.len += key_size;
+        }
+        if (value_size != 0) {
+            memcpy(ctx->wal.buff + ctx->wal.len, value, value_size);
+            ctx->wal.len += value_size;
+        }
+    }
+    ctx->wal.pending++;
+
+    /* commit. */
+    if (ctx->wal.sync == BKVS_WAL_SYNC_ALWAYS ||
+        (ctx->wal.sync == BKVS_WAL_SYNC_BATCH && ctx->wal.pending >= ctx->wal.batch_num)) {
+        return wal_commit(ctx);
+    }
 
     return BKVS_OK;
 }
 
-static bque_res search_key_cb(bque_buff *buff, bque_u32 idx, bque_u32 num) {
-    bkvs_pair *pair;
+static void wal_close(bkvs_ctx *ctx) {
+    if (ctx->wal.path == NULL) {
+        return;
+    }
+    compact_abort(ctx);
+    wal_commit(ctx);
+    close(ctx->wal.fd);
+    free(ctx->wal.buff);
+    free(ctx->wal.path);
+    ctx->wal.buff = NULL;
+    ctx->wal.path = NULL;
+}
 
-    pair = (bkvs_pair *)buff->ptr;
-    if (pair->key_size == search_ctx.key_size &&
-        memcmp(pair->key, search_ctx.key, search_ctx.key_size) == 0) {
-        search_ctx.pair_idx = idx;
-        search_ctx.buff.ptr = buff->ptr;
-        search_ctx.buff.size = buff->size;
+/**
+ * @brief make all the logged changes durable.
+ * 
+ * @param ctx context pointer.
+*/
+bkvs_res bkvs_sync(bkvs_ctx *ctx) {
+    BKVS_ASSERT(ctx != NULL);
 
-        return BQUE_ERR_ITER_STOP;
+    if (ctx->wal.path == NULL) {
+        return BKVS_OK;
     }
 
-    return BQUE_OK;
+    return wal_commit(ctx);
 }
 
-static bkvs_res search_key(bkvs_ctx *ctx, const char *key) {
-    bque_u32 bucket_idx;
-    bque_res mod_bque_res;
+static void compact_free(bkvs_ctx *ctx) {
+    if (ctx->compact.writer != NULL) {
+        free(ctx->compact.writer->buff);
+        free(ctx->compact.writer);
+    }
+    free(ctx->compact.path);
+    free(ctx->compact.tmp_path);
+    free(ctx->compact.next_path);
+    memset(&ctx->compact, 0, sizeof(ctx->compact));
+}
 
-    BKVS_ASSERT(ctx != NULL);
-    BKVS_ASSERT(key != NULL);
+/**
+ * @brief stop the running compaction and move the log back in place.
+ * 
+ * @param ctx context pointer.
+*/
+static void compact_abort(bkvs_ctx *ctx) {
+    int fd;
 
-    /* hash key string and get the bucket index. */
-    bucket_idx = ctx->conf.hash_cb(key) % ctx->conf.bucket_num;
-    if (ctx->buckets[bucket_idx] == NULL) {
-        return BKVS_ERR_NO_KEY;
+    if (ctx->compact.writer == NULL) {
+        return;
     }
-
-    /* search key in the key-value pair queues. */
-    search_ctx.key = key;
-    search_ctx.key_size = strlen(key) + 1;
-    mod_bque_res = bque_foreach(ctx->buckets[bucket_idx], search_key_cb, BQUE_ITER_FORWARD);
-    if (mod_bque_res != BQUE_ERR_ITER_STOP) {
-        return BKVS_ERR_NO_KEY;
+    if (ctx->compact.writer->file != NULL) {
+        fclose(ctx->compact.writer->file);
     }
+    remove(ctx->compact.tmp_path);
 
-    search_ctx.bucket_idx = bucket_idx;
-
-    return BKVS_OK;
+    /* append what was logged meanwhile, or leave it for the next open. */
+    if (wal_commit(ctx) == BKVS_OK) {
+        fd = open(ctx->wal.path, O_WRONLY | O_APPEND);
+        if (fd >= 0 && wal_merge_next(ctx, ctx->wal.path, fd) == BKVS_OK) {
+            close(ctx->wal.fd);
+            ctx->wal.fd = fd;
+        } else if (fd >= 0) {
+            close(fd);
+        }
+    }
+    compact_free(ctx);
 }
 
-bkvs_res bkvs_put(bkvs_ctx *ctx, const char *key, const void *buff, bkvs_u32 size) {
-    bque_res mod_bque_res;
+/**
+ * @brief start rewriting the snapshot from the live pairs.
+ * 
+ * the log is rotated to "<wal_path>.next" and the snapshot is written to
+ * "<path>.tmp" bucket by bucket by `bkvs_compact_step()`, so changes can be
+ * made in between. the snapshot may see some of those changes, which is
+ * fine as they are logged after its sequence number and replaying them
+ * again gives the same result.
+ * 
+ * @param ctx context pointer, with the write-ahead log enabled.
+ * @param path path of the new snapshot.
+*/
+bkvs_res bkvs_compact_begin(bkvs_ctx *ctx, const char *path) {
+    bkvs_u8 head[BKVS_FILE_HEAD_SIZE];
+    bkvs_writer *writer;
     bkvs_res res;
+    int fd;
 
     BKVS_ASSERT(ctx != NULL);
-    BKVS_ASSERT(key != NULL);
-    BKVS_ASSERT(buff != NULL);
-    BKVS_ASSERT(size != 0);
-
-    /* search key. */
-    res = search_key(ctx, key);
-    if (res == BKVS_ERR_NO_KEY) {
-        bkvs_u32 bucket_idx;
-        bkvs_pair pair;
+    BKVS_ASSERT(path != NULL);
 
-        /* hash key string and get the bucket index. */
-        bucket_idx = ctx->conf.hash_cb(key) % ctx->conf.bucket_num;
+    if (ctx->map.base != NULL || ctx->frozen.slots != NULL) {
+        return BKVS_ERR_READ_ONLY;
+    }
+    if (ctx->wal.path == NULL || ctx->compact.writer != NULL) {
+        return BKVS_ERR;
+    }
 
-        /* create key-value pair queue. */
-        if (ctx->buckets[bucket_idx] == NULL) {
-            res = create_pair_que(&ctx->buckets[bucket_idx]);
-            if (res != BKVS_OK) {
-                return res;
-            }
-        }
+    /* prepare writer. */
+    writer = (bkvs_writer *)calloc(1, sizeof(bkvs_writer));
+    ctx->compact.writer = writer;
+    if (writer != NULL) {
+        writer->ctx = ctx;
+    }
+    ctx->compact.path = path_append(path, "");
+    ctx->compact.tmp_path = path_append(path, ".tmp");
+    ctx->compact.next_path = path_append(ctx->wal.path, ".next");
+    if (writer == NULL || ctx->compact.path == NULL ||
+        ctx->compact.tmp_path == NULL || ctx->compact.next_path == NULL ||
+        (writer->buff = (bkvs_u8 *)malloc(BKVS_FILE_BUFF_SIZE)) == NULL) {
+        compact_free(ctx);
 
-        /* put key-value pair. */
-        res = create_pair(&pair, key, buff, size);
-        if (res != BKVS_OK) {
-            return res;
-        }
-        mod_bque_res = bque_enqueue(ctx->buckets[bucket_idx], &pair, sizeof(bkvs_pair));
-        if (mod_bque_res != BQUE_OK) {
-            if (mod_bque_res == BQUE_ERR_NO_MEM) {
-                return BKVS_ERR_NO_MEM;
-            } else {
-                return BKVS_ERR;
-            }
+        return BKVS_ERR_NO_MEM;
+    }
+    writer->file = fopen(ctx->compact.tmp_path, "wb");
+    memset(head, 0, sizeof(head));
+    if (writer->file == NULL || fwrite(head, 1, sizeof(head), writer->file) != sizeof(head)) {
+        if (writer->file != NULL) {
+            fclose(writer->file);
+            remove(ctx->compact.tmp_path);
         }
+        compact_free(ctx);
 
-        /* update key-value pair number. */
-        ctx->cache.pair_num++;
-    } else if (res == BKVS_OK) {
-        char *alloc_value;
-        bkvs_pair *pair;
+        return BKVS_ERR_IO;
+    }
 
-        /* allocate memory for value. */
-        alloc_value = (char *)malloc(size);
-        if (alloc_value == NULL) {
-            return BKVS_ERR_NO_MEM;
+    /* rotate the log, changes from now on are newer than the snapshot. */
+    res = wal_commit(ctx);
+    fd = -1;
+    if (res == BKVS_OK) {
+        fd = open(ctx->compact.next_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        put_u32(head, BKVS_WAL_MAGIC);
+        put_u16(head + 4, BKVS_WAL_VERSION);
+        if (fd < 0 || write_all(fd, head, BKVS_WAL_HEAD_SIZE) != BKVS_OK || fsync(fd) != 0) {
+            res = BKVS_ERR_IO;
         }
+    }
+    if (res != BKVS_OK) {
+        if (fd >= 0) {
+            close(fd);
+            remove(ctx->compact.next_path);
+        }
+        fclose(writer->file);
+        remove(ctx->compact.tmp_path);
+        compact_free(ctx);
 
-        /* copy value. */
-        memcpy(alloc_value, buff, size);
-
-        /* update value. */
-        pair = (bkvs_pair *)search_ctx.buff.ptr;
-        free(pair->value);
-        pair->value = alloc_value;
-        pair->value_size = size;
-    } else {
         return res;
     }
+    close(ctx->wal.fd);
+    ctx->wal.fd = fd;
+    ctx->compact.seq = ctx->wal.seq;
+    ctx->compact.cursor = 0;
 
     return BKVS_OK;
 }
 
-bkvs_res bkvs_drop(bkvs_ctx *ctx, const char *key) {
-    bque_res mod_bque_res;
+/**
+ * @brief make the new snapshot durable and swap it and the rotated log in.
+ * 
+ * @param ctx context pointer.
+*/
+static bkvs_res compact_finish(bkvs_ctx *ctx) {
+    bkvs_writer *writer;
     bkvs_res res;
-    bkvs_pair *pair;
-
-    BKVS_ASSERT(ctx != NULL);
-    BKVS_ASSERT(key != NULL);
 
-    /* search key. */
-    res = search_key(ctx, key);
-    if (res != BKVS_OK) {
-        return res;
+    /* complete the snapshot. */
+    writer = ctx->compact.writer;
+    writer_flush(writer);
+    save_head(ctx, writer, ctx->compact.seq);
+    if (writer->res == BKVS_OK &&
+        (fflush(writer->file) != 0 || fsync(fileno(writer->file)) != 0)) {
+        writer->res = BKVS_ERR_IO;
+    }
+    if (fclose(writer->file) != 0 && writer->res == BKVS_OK) {
+        writer->res = BKVS_ERR_IO;
     }
+    writer->file = NULL;
+    res = writer->res;
 
-    /* delete key-value pair. */
-    pair = (bkvs_pair *)search_ctx.buff.ptr;
-    free(pair->key);
-    free(pair->value);
-    mod_bque_res = bque_drop(ctx->buckets[search_ctx.bucket_idx], search_ctx.pair_idx, NULL, NULL);
-    if (mod_bque_res != BQUE_OK) {
-        return BKVS_ERR;
+    /* swap the snapshot in first, the old log is still complete until the log is swapped in. */
+    if (res == BKVS_OK && rename(ctx->compact.tmp_path, ctx->compact.path) != 0) {
+        res = BKVS_ERR_IO;
+    }
+    if (res == BKVS_OK) {
+        res = sync_dir(ctx->compact.path);
+    }
+    if (res == BKVS_OK) {
+        res = wal_commit(ctx);
     }
+    if (res == BKVS_OK && rename(ctx->compact.next_path, ctx->wal.path) != 0) {
+        res = BKVS_ERR_IO;
+    }
+    if (res == BKVS_OK) {
+        res = sync_dir(ctx->wal.path);
+    }
+    if (res != BKVS_OK) {
+        compact_abort(ctx);
 
-    /* update key-value pair number. */
-    ctx->cache.pair_num--;
+        return res;
+    }
+    compact_free(ctx);
 
     return BKVS_OK;
 }
 
-static bque_res empty_cb(bque_buff *buff, bque_u32 idx, bque_u32 num) {
-    bkvs_pair *pair;
-
-    pair = (bkvs_pair *)buff->ptr;
-    free(pair->key);
-    free(pair->value);
-
-    return BQUE_OK;
-}
+/**
+ * @brief write the next buckets of the snapshot started by `bkvs_compact_begin()`.
+ * 
+ * @param ctx context pointer.
+ * @param bucket_num number of the buckets to be written.
+ * @return BKVS_ERR_AGAIN if buckets are left, BKVS_OK once the new snapshot
+ *         and log are in place.
+*/
+bkvs_res bkvs_compact_step(bkvs_ctx *ctx, bkvs_u32 bucket_num) {
+    bkvs_writer *writer;
+    bkvs_res res;
 
-bkvs_res bkvs_empty(bkvs_ctx *ctx) {
     BKVS_ASSERT(ctx != NULL);
 
-    /* empty key-value pair queues. */
-    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
-        if (ctx->buckets[i] != NULL) {
-            bque_foreach(ctx->buckets[i], empty_cb, BQUE_ITER_FORWARD);
-            bque_del(ctx->buckets[i]);
+    writer = ctx->compact.writer;
+    if (writer == NULL) {
+        return BKVS_ERR;
+    }
+
+    /* write whole buckets, so each one is consistent. the tree and the cuckoo table,
+       whose pairs move between buckets, are written in one step. */
+    save_writer = writer;
+    if (ctx->conf.engine == BKVS_ENGINE_ART) {
+        art_each(ctx->index.root, save_cb);
+    }
+    cuckoo_each(ctx, save_cb);
+    for (bkvs_u32 i = 0; i < bucket_num && ctx->compact.cursor < ctx->conf.bucket_num &&
+         writer->res == BKVS_OK; i++, ctx->compact.cursor++) {
+        if (ctx->buckets[ctx->compact.cursor] != NULL) {
+            bucket_each(ctx, ctx->compact.cursor, save_cb);
         }
     }
-    memset(ctx->buckets, 0, sizeof(bque_ctx *) * ctx->conf.bucket_num);
+    save_writer = NULL;
+    if (writer->res != BKVS_OK) {
+        res = writer->res;
+        compact_abort(ctx);
 
-    return BKVS_OK;
+        return res;
+    }
+    if (ctx->compact.cursor < ctx->conf.bucket_num) {
+        return BKVS_ERR_AGAIN;
+    }
+
+    return compact_finish(ctx);
 }
 
-bkvs_res bkvs_has(bkvs_ctx *ctx, const char *key) {
+/**
+ * @brief rewrite the snapshot and truncate the log in one go.
+ * 
+ * @param ctx context pointer, with the write-ahead log enabled.
+ * @param path path of the new snapshot.
+*/
+bkvs_res bkvs_compact(bkvs_ctx *ctx, const char *path) {
     bkvs_res res;
-    bkvs_pair *pair;
 
-    BKVS_ASSERT(ctx != NULL);
+    res = bkvs_compact_begin(ctx, path);
+    while (res == BKVS_OK) {
+        res = bkvs_compact_step(ctx, ctx->conf.bucket_num);
+        if (res == BKVS_OK) {
+            break;
+        }
+    }
 
-    /* search key. */
-    return search_key(ctx, key);
+    return res;
 }
 
-bkvs_res bkvs_get(bkvs_ctx *ctx, const char *key, bkvs_buff *buff) {
-    bkvs_res res;
-    bkvs_pair *pair;
-
-    BKVS_ASSERT(ctx != NULL);
-    BKVS_ASSERT(key != NULL);
-    BKVS_ASSERT(buff != NULL);
-    BKVS_ASSERT(size != NULL);
-
-    /* search key. */
-    res = search_key(ctx, key);
-    if (res != BKVS_OK) {
-        return res;
-    }
+#else
 
-    /* copy value. */
-    pair = (bkvs_pair *)search_ctx.buff.ptr;
-    buff->ptr = (bkvs_u8 *)pair->value;
-    buff->size = pair->value_size;
+static bkvs_res wal_open(bkvs_ctx *ctx, const char *path, bkvs_u32 sync, bkvs_u32 batch_num) {
+    return BKVS_ERR;
+}
 
+static bkvs_res wal_append(bkvs_ctx *ctx, bkvs_u8 type, const char *key, const void *value, bkvs_u32 value_size) {
     return BKVS_OK;
 }
 
-bkvs_res bkvs_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb) {
-    bque_res mod_bque_res;
-    bque_stat mod_bque_stat;
-    bque_buff mod_bque_buff;
-    bque_u32 pair_idx;
-    bkvs_pair *pair;
-    bkvs_buff buff;
-    bkvs_res res;
-
-    BKVS_ASSERT(ctx != NULL);
-    BKVS_ASSERT(cb != NULL);
+static void wal_close(bkvs_ctx *ctx) {
+    compact_abort(ctx);
+}
 
-    /* foreach key-value pair queues. */
-    pair_idx = 0;
-    for (bkvs_u32 i = 0; i < ctx->conf.bucket_num; i++) {
-        if (ctx->buckets[i] != NULL) {
+bkvs_res bkvs_sync(bkvs_ctx *ctx) {
+    return BKVS_OK;
+}
 
-            mod_bque_res = bque_status(ctx->buckets[i], &mod_bque_stat);
-            if (mod_bque_res != BQUE_OK) {
-                return BKVS_ERR;
-            }
+static void compact_abort(bkvs_ctx *ctx) {
+}
 
-            for (bkvs_u32 j = 0; j < mod_bque_stat.buff_num; j++) {
-                mod_bque_res = bque_item(ctx->buckets[i], j, &mod_bque_buff);
-                if (mod_bque_res != BQUE_OK) {
-                    return BKVS_ERR;
-                }
+bkvs_res bkvs_compact_begin(bkvs_ctx *ctx, const char *path) {
+    return BKVS_ERR;
+}
 
-                pair = (bkvs_pair *)mod_bque_buff.ptr;
-                buff.ptr = (bkvs_u8 *)pair->value;
-                buff.size = pair->value_size;
-                res = cb(pair->key, &buff, pair_idx, ctx->cache.pair_num);
-                if (res == BKVS_ERR_ITER_STOP) {
-                    return BKVS_ERR_ITER_STOP;
-                }
-                pair_idx++;
-            }
-        }
-    }
+bkvs_res bkvs_compact_step(bkvs_ctx *ctx, bkvs_u32 bucket_num) {
+    return BKVS_ERR;
+}
 
-    return BKVS_OK;
+bkvs_res bkvs_compact(bkvs_ctx *ctx, const char *path) {
+    return BKVS_ERR;
 }
+
+#endif
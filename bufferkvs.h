@@ -61,8 +61,26 @@ enum _bkvs_res {
     /* failed to find the key. */
     BKVS_ERR_NO_KEY     = -3,
 
+    /* failed to read or write the file. */
+    BKVS_ERR_IO         = -4,
+
+    /* file is truncated, corrupted or of an unknown version. */
+    BKVS_ERR_BAD_FILE   = -5,
+
+    /* set is read-only. */
+    BKVS_ERR_READ_ONLY  = -6,
+
+    /* operation is not finished yet, call again. */
+    BKVS_ERR_AGAIN      = -7,
+
     /* iterating stoped. */
     BKVS_ERR_ITER_STOP  = -8,
+
+    /* buffer is too small for the value. */
+    BKVS_ERR_NO_ROOM    = -9,
+
+    /* value is not the expected one. */
+    BKVS_ERR_MISMATCH   = -10,
 };
 
 
@@ -90,37 +108,233 @@ typedef bkvs_s32            bkvs_res;
 
 #endif
 
+typedef struct _bkvs_buff {
+    bkvs_u8 *ptr;
+    bkvs_u32 size;
+} bkvs_buff;
+
 /* hash callback function for the key. */
 typedef bkvs_u32 (*bkvs_hash_cb)(const char *key);
 
+/* merge callback function, writing the value of the key merged with the
+   operand into `dst`. `value` has a NULL `ptr` if the key is missing. if
+   the merged value needs more than `*dst_size` bytes, set `*dst_size` to
+   its size and return `BKVS_ERR_NO_ROOM` to be called again. */
+typedef bkvs_res (*bkvs_merge_cb)(const char *key, const bkvs_buff *value, const void *operand,
+                                  bkvs_u32 size, void *dst, bkvs_u32 *dst_size);
+
+/* eviction policy applied once `pair_num_max` is reached. */
+enum _bkvs_evict {
+
+    /* never evict, `pair_num_max` is not enforced. */
+    BKVS_EVICT_NONE     = 0,
+
+    /* evict the least recently used pair. */
+    BKVS_EVICT_LRU      = 1,
+
+    /* W-TinyLFU: window LRU plus frequency-admitted segmented LRU. */
+    BKVS_EVICT_TINYLFU  = 2,
+};
+
+/* sync policy of the write-ahead log. */
+enum _bkvs_wal_sync {
+
+    /* write and fsync every change before returning. */
+    BKVS_WAL_SYNC_ALWAYS    = 0,
+
+    /* group commit: write and fsync once per `wal_batch_num` changes. */
+    BKVS_WAL_SYNC_BATCH     = 1,
+
+    /* write when the log buffer fills up, fsync only in `bkvs_sync()`. */
+    BKVS_WAL_SYNC_NONE      = 2,
+};
+
+/* storage of the keys. */
+enum _bkvs_key_mode {
+
+    /* every pair keeps its whole key. */
+    BKVS_KEY_PLAIN      = 0,
+
+    /* keys are split after their last delimiter, the pairs share one copy of each prefix. */
+    BKVS_KEY_PREFIX     = 1,
+};
+
+/* storage engine of the pairs. */
+enum _bkvs_engine {
+
+    /* hash buckets of pair queues. */
+    BKVS_ENGINE_HASH    = 0,
+
+    /* adaptive radix tree over the whole keys, kept in key order. */
+    BKVS_ENGINE_ART     = 1,
+
+    /* bucketized cuckoo table, every key in one of two 4-way buckets. */
+    BKVS_ENGINE_CUCKOO  = 2,
+};
+
+/* value of `numa_node` placing the set on a node. */
+#define BKVS_NUMA_NODE(node)    ((node) + 1)
+
+/* number of the NUMA nodes a set can be placed on. */
+#define BKVS_NUMA_NODE_MAX      256
+
 /* configuration of the buffer key-value set. */
 typedef struct _bkvs_conf {
 
-    /* hash callback function for the key. */
+    /* hash callback function for the key, NULL to use a hash keyed with a
+       random seed per set, which is changed when keys pile up in a bucket. */
     bkvs_hash_cb hash_cb;
 
-    /* number of the buckets. */
+    /* number of the buckets, at most 2^30. */
     bkvs_u32 bucket_num;
 
     /* maximum number of the the key-value pairs. */
     bkvs_u32 pair_num_max;
+
+    /* eviction policy, see `enum _bkvs_evict`. */
+    bkvs_u32 evict_policy;
+
+    /* path of the write-ahead log, NULL to disable logging. */
+    const char *wal_path;
+
+    /* sync policy of the write-ahead log, see `enum _bkvs_wal_sync`. */
+    bkvs_u32 wal_sync;
+
+    /* number of the changes per group commit, 0 to use the default. */
+    bkvs_u32 wal_batch_num;
+
+    /* storage of the keys, see `enum _bkvs_key_mode`. keys loaded from a
+       snapshot stay whole in the loaded block. */
+    bkvs_u32 key_mode;
+
+    /* delimiter ending the shared prefix of a key, 0 to use ':'. */
+    char key_delim;
+
+    /* values of at least this size are stored compressed if that saves
+       space, 0 to disable compression. values loaded from a snapshot are not. */
+    bkvs_u32 compress_min_size;
+
+    /* non-zero to keep the keys ordered for `bkvs_range()` and `bkvs_prefix()`. */
+    bkvs_u32 ordered_index;
+
+    /* storage engine, see `enum _bkvs_engine`. the tree engine has no buckets
+       and is always ordered. the cuckoo engine starts with room for `bucket_num`
+       pairs and grows when full, a new key whose hash collides with too many
+       others is refused with `BKVS_ERR_NO_ROOM`. */
+    bkvs_u32 engine;
+
+    /* merge callback function of `bkvs_merge()`, NULL if not merging. */
+    bkvs_merge_cb merge_cb;
+
+    /* NUMA node the buckets and the loaded blocks are bound to, as `BKVS_NUMA_NODE(node)`,
+       0 to leave them where first touched. the pairs are placed by the first touch of the
+       writing thread, so a set per node should be filled by threads running on it. */
+    bkvs_u32 numa_node;
 } bkvs_conf;
 
+/* number of the chain lengths counted by the status, longer chains go to the last one. */
+#define BKVS_STAT_CHAIN_NUM     16
+
 /* status of the buffer key-value set. */
 typedef struct _bkvs_stat {
 
     /* number of the the key-value pairs. */
     bkvs_u32 pair_num;
+
+    /* number of the pairs evicted so far. */
+    bkvs_u32 evict_num;
+
+    /* number of the times the buckets were rehashed with a new seed. */
+    bkvs_u32 rehash_num;
+
+    /* number of the buckets, or of the slots of a frozen set. */
+    bkvs_u32 bucket_num;
+
+    /* number of the buckets holding at least one pair. */
+    bkvs_u32 bucket_used_num;
+
+    /* number of the buckets long enough to be kept sorted and searched by halves. */
+    bkvs_u32 bucket_sorted_num;
+
+    /* number of the pairs of the cuckoo engine kept outside their two buckets. */
+    bkvs_u32 stash_num;
+
+    /* length of the longest bucket chain. */
+    bkvs_u32 chain_max;
+
+    /* mean length of the non-empty bucket chains. */
+    double chain_mean;
+
+    /* number of the buckets per chain length. */
+    bkvs_u32 chain_hist[BKVS_STAT_CHAIN_NUM];
+
+    /* total size of the stored keys, terminators included, shared prefixes counted once. */
+    bkvs_u64 key_size;
+
+    /* number of the shared key prefixes. */
+    bkvs_u32 prefix_num;
+
+    /* total size of the values. */
+    bkvs_u64 value_size;
+
+    /* estimated memory spent on top of the keys and values. */
+    bkvs_u64 overhead_size;
+
+    /* number of the `bkvs_get()` calls that found or missed the key. */
+    bkvs_u64 get_hit_num;
+    bkvs_u64 get_miss_num;
+
+    /* number of the `bkvs_has()` calls that found or missed the key. */
+    bkvs_u64 has_hit_num;
+    bkvs_u64 has_miss_num;
+
+    /* number of the values stored compressed, and their sizes before and after. */
+    bkvs_u32 packed_num;
+    bkvs_u64 packed_raw_size;
+    bkvs_u64 packed_size;
+
+    /* number of the values compressed, kept or not, and the time it took in nanoseconds. */
+    bkvs_u64 compress_num;
+    bkvs_u64 compress_ns;
+
+    /* number of the values decompressed and the time it took in nanoseconds. */
+    bkvs_u64 decompress_num;
+    bkvs_u64 decompress_ns;
 } bkvs_stat;
 
-typedef struct _bkvs_buff {
-    bkvs_u8 *ptr;
-    bkvs_u32 size;
-} bkvs_buff;
+/* operations timed when built with `BKVS_LATENCY`. */
+enum _bkvs_op {
+    BKVS_OP_PUT         = 0,
+    BKVS_OP_GET         = 1,
+    BKVS_OP_HAS         = 2,
+    BKVS_OP_DROP        = 3,
+    BKVS_OP_NUM,
+};
+
+/* latency of an operation, in nanoseconds. */
+typedef struct _bkvs_lat_stat {
+
+    /* number of the timed calls. */
+    bkvs_u64 count;
+
+    /* percentiles, accurate to 1/16 of the value. */
+    bkvs_u64 p50;
+    bkvs_u64 p99;
+    bkvs_u64 p999;
+
+    /* slowest call. */
+    bkvs_u64 max;
+} bkvs_lat_stat;
 
 /* context of the buffer key-value set. */
 typedef struct _bkvs_ctx    bkvs_ctx;
 
+/* point-in-time view of the set. */
+typedef struct _bkvs_snap   bkvs_snap;
+
+/* changes applied to a set all at once. */
+typedef struct _bkvs_batch  bkvs_batch;
+
 typedef bkvs_res (*bkvs_foreach_cb)(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num);
 
 bkvs_u32 bkvs_hash_cb_djb2(const char *str);
@@ -139,10 +353,68 @@ bkvs_res bkvs_drop(bkvs_ctx *ctx, const char *key);
 
 bkvs_res bkvs_empty(bkvs_ctx *ctx);
 
+bkvs_res bkvs_batch_new(bkvs_batch **batch);
+
+bkvs_res bkvs_batch_del(bkvs_batch *batch);
+
+bkvs_res bkvs_batch_clear(bkvs_batch *batch);
+
+bkvs_res bkvs_batch_put(bkvs_batch *batch, const char *key, const void *buff, bkvs_u32 size);
+
+bkvs_res bkvs_batch_drop(bkvs_batch *batch, const char *key);
+
+bkvs_res bkvs_batch_commit(bkvs_ctx *ctx, bkvs_batch *batch);
+
+bkvs_res bkvs_incr(bkvs_ctx *ctx, const char *key, bkvs_s64 delta, bkvs_u64 *val);
+
+bkvs_res bkvs_cas(bkvs_ctx *ctx, const char *key, bkvs_u64 expected, bkvs_u64 val);
+
+bkvs_res bkvs_merge(bkvs_ctx *ctx, const char *key, const void *operand, bkvs_u32 size);
+
 bkvs_res bkvs_has(bkvs_ctx *ctx, const char *key);
 
 bkvs_res bkvs_get(bkvs_ctx *ctx, const char *key, bkvs_buff *buff);
 
+bkvs_res bkvs_read(bkvs_ctx *ctx, const char *key, void *buff, bkvs_u32 size, bkvs_u32 *value_size);
+
 bkvs_res bkvs_foreach(bkvs_ctx *ctx, bkvs_foreach_cb cb);
 
+bkvs_res bkvs_range(bkvs_ctx *ctx, const char *lo, const char *hi, bkvs_foreach_cb cb);
+
+bkvs_res bkvs_prefix(bkvs_ctx *ctx, const char *prefix, bkvs_foreach_cb cb);
+
+bkvs_res bkvs_snapshot(bkvs_ctx *ctx, bkvs_snap **snap);
+
+bkvs_res bkvs_snap_del(bkvs_snap *snap);
+
+bkvs_res bkvs_snap_get(bkvs_snap *snap, const char *key, bkvs_buff *buff);
+
+bkvs_res bkvs_snap_foreach(bkvs_snap *snap, bkvs_foreach_cb cb);
+
+bkvs_res bkvs_save(bkvs_ctx *ctx, const char *path);
+
+bkvs_res bkvs_load(const char *path, bkvs_ctx **ctx, bkvs_conf *conf);
+
+bkvs_res bkvs_save_table(bkvs_ctx *ctx, const char *path);
+
+bkvs_res bkvs_map(const char *path, bkvs_ctx **ctx, bkvs_conf *conf);
+
+bkvs_res bkvs_freeze(bkvs_ctx *ctx);
+
+bkvs_res bkvs_sync(bkvs_ctx *ctx);
+
+bkvs_res bkvs_compact_begin(bkvs_ctx *ctx, const char *path);
+
+bkvs_res bkvs_compact_step(bkvs_ctx *ctx, bkvs_u32 bucket_num);
+
+bkvs_res bkvs_compact(bkvs_ctx *ctx, const char *path);
+
+bkvs_res bkvs_latency(bkvs_ctx *ctx, bkvs_u32 op, bkvs_lat_stat *stat);
+
+bkvs_res bkvs_latency_reset(bkvs_ctx *ctx);
+
+bkvs_res bkvs_mem_usage(bkvs_u64 *size, bkvs_u64 *num);
+
+bkvs_res bkvs_numa_node(bkvs_u32 *node);
+
 #endif
@@ -0,0 +1,101 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * helpers shared by the tests under tests/.
+ * 
+ * every test is a program exiting with 0 once all its checks pass, the first
+ * failed check prints its line and exits with 1. files go to `$TMPDIR`, or
+ * /tmp, under names unique to the test run. the tests of the files put the
+ * pairs "k<i>" with the 32-bit value i * 7 and check them after reopening.
+*/
+
+#ifndef __BKVS_TEST_H__
+#define __BKVS_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bufferkvs.h"
+
+#define TEST_CHECK(expr)                                                    \
+    do {                                                                    \
+        if (!(expr)) {                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n",                   \
+                    __FILE__, __LINE__, #expr);                             \
+            exit(1);                                                        \
+        }                                                                   \
+    } while (0)
+
+#define TEST_PATH_SIZE  256
+
+/* path of the file `name` of this test run. */
+static inline void test_path(char *path, const char *name) {
+    const char *dir;
+
+    dir = getenv("TMPDIR");
+    if (dir == NULL || dir[0] == '\0') {
+        dir = "/tmp";
+    }
+    snprintf(path, TEST_PATH_SIZE, "%s/bkvs_test_%d_%s", dir, (int)getpid(), name);
+}
+
+/* put the pair "k<i>". */
+static inline void test_put_pair(bkvs_ctx *ctx, bkvs_u32 i) {
+    char key[32];
+    bkvs_u32 value;
+
+    snprintf(key, sizeof(key), "k%u", i);
+    value = i * 7;
+    TEST_CHECK(bkvs_put(ctx, key, &value, sizeof(value)) == BKVS_OK);
+}
+
+/* drop the pair "k<i>". */
+static inline void test_drop_pair(bkvs_ctx *ctx, bkvs_u32 i) {
+    char key[32];
+
+    snprintf(key, sizeof(key), "k%u", i);
+    TEST_CHECK(bkvs_drop(ctx, key) == BKVS_OK);
+}
+
+/* check that the set holds the pairs "k<lo>" to "k<hi - 1>" and no other. */
+static inline void test_check_pairs(bkvs_ctx *ctx, bkvs_u32 lo, bkvs_u32 hi) {
+    char key[32];
+    bkvs_buff buff;
+    bkvs_stat stat;
+    bkvs_u32 value;
+
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.pair_num == hi - lo);
+    for (bkvs_u32 i = lo; i < hi; i++) {
+        snprintf(key, sizeof(key), "k%u", i);
+        TEST_CHECK(bkvs_get(ctx, key, &buff) == BKVS_OK);
+        TEST_CHECK(buff.size == sizeof(value));
+        memcpy(&value, buff.ptr, sizeof(value));
+        TEST_CHECK(value == i * 7);
+    }
+}
+
+#endif
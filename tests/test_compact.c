@@ -0,0 +1,171 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * incremental log compaction and its recovery.
+ * 
+ * a compaction runs step by step while pairs are put and dropped, and the
+ * snapshot it writes plus the log must hold the set. a process killed in the
+ * middle of a compaction, or between swapping in the snapshot and the log,
+ * leaves files the next set has to recover the whole set from.
+*/
+
+#include <sys/wait.h>
+
+#include "test.h"
+
+#define PAIR_NUM    1000
+
+static bkvs_conf conf;
+
+static char wal_path[TEST_PATH_SIZE];
+static char next_path[TEST_PATH_SIZE];
+static char snap_path[TEST_PATH_SIZE];
+static char tmp_path[TEST_PATH_SIZE];
+static char copy_path[TEST_PATH_SIZE];
+static char next_copy_path[TEST_PATH_SIZE];
+
+/* load the snapshot and replay the log, which must hold the pairs [lo, hi). */
+static void check_load(bkvs_u32 lo, bkvs_u32 hi) {
+    bkvs_ctx *ctx;
+
+    TEST_CHECK(bkvs_load(snap_path, &ctx, &conf) == BKVS_OK);
+    test_check_pairs(ctx, lo, hi);
+    TEST_CHECK(access(next_path, F_OK) != 0);
+    bkvs_del(ctx);
+}
+
+static void copy_file(const char *src, const char *dst) {
+    char buff[4096];
+    FILE *src_file;
+    FILE *dst_file;
+    size_t len;
+
+    src_file = fopen(src, "rb");
+    dst_file = fopen(dst, "wb");
+    TEST_CHECK(src_file != NULL && dst_file != NULL);
+    while ((len = fread(buff, 1, sizeof(buff), src_file)) != 0) {
+        TEST_CHECK(fwrite(buff, 1, len, dst_file) == len);
+    }
+    fclose(src_file);
+    fclose(dst_file);
+}
+
+int main(void) {
+    bkvs_ctx *ctx;
+    bkvs_u32 lo;
+    bkvs_u32 hi;
+    bkvs_res res;
+    pid_t pid;
+    int status;
+
+    test_path(wal_path, "compact.wal");
+    test_path(next_path, "compact.wal.next");
+    test_path(snap_path, "compact.bkvs");
+    test_path(tmp_path, "compact.bkvs.tmp");
+    test_path(copy_path, "compact_copy.wal");
+    test_path(next_copy_path, "compact_copy.wal.next");
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = 64;
+    conf.wal_path = wal_path;
+    conf.wal_sync = BKVS_WAL_SYNC_ALWAYS;
+
+    /* changes made between the steps go to the rotated log and survive. */
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    for (hi = 0; hi < PAIR_NUM; hi++) {
+        test_put_pair(ctx, hi);
+    }
+    lo = 0;
+    TEST_CHECK(bkvs_compact_begin(ctx, snap_path) == BKVS_OK);
+    TEST_CHECK(bkvs_compact_begin(ctx, snap_path) == BKVS_ERR);
+    TEST_CHECK(access(next_path, F_OK) == 0);
+    while ((res = bkvs_compact_step(ctx, 4)) == BKVS_ERR_AGAIN) {
+        test_put_pair(ctx, hi++);
+        test_drop_pair(ctx, lo++);
+    }
+    TEST_CHECK(res == BKVS_OK);
+    TEST_CHECK(access(next_path, F_OK) != 0 && access(tmp_path, F_OK) != 0);
+    test_check_pairs(ctx, lo, hi);
+    test_put_pair(ctx, hi++);
+    bkvs_del(ctx);
+    check_load(lo, hi);
+
+    /* a set deleted in the middle of a compaction moves the log back in place. */
+    TEST_CHECK(bkvs_load(snap_path, &ctx, &conf) == BKVS_OK);
+    TEST_CHECK(bkvs_compact_begin(ctx, snap_path) == BKVS_OK);
+    TEST_CHECK(bkvs_compact_step(ctx, 1) == BKVS_ERR_AGAIN);
+    test_put_pair(ctx, hi++);
+    bkvs_del(ctx);
+    TEST_CHECK(access(tmp_path, F_OK) != 0);
+    check_load(lo, hi);
+
+    /* a process killed in the middle of a compaction leaves the rotated log, which is merged back. */
+    pid = fork();
+    TEST_CHECK(pid >= 0);
+    if (pid == 0) {
+        TEST_CHECK(bkvs_load(snap_path, &ctx, &conf) == BKVS_OK);
+        TEST_CHECK(bkvs_compact_begin(ctx, snap_path) == BKVS_OK);
+        TEST_CHECK(bkvs_compact_step(ctx, 8) == BKVS_ERR_AGAIN);
+        for (bkvs_u32 i = 0; i < 50; i++) {
+            test_put_pair(ctx, hi + i);
+            test_drop_pair(ctx, lo + i);
+        }
+        _exit(0);
+    }
+    TEST_CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    TEST_CHECK(access(next_path, F_OK) == 0 && access(tmp_path, F_OK) == 0);
+    lo += 50;
+    hi += 50;
+    check_load(lo, hi);
+
+    /* the next compaction writes over the stale snapshot left behind. */
+    TEST_CHECK(bkvs_load(snap_path, &ctx, &conf) == BKVS_OK);
+    TEST_CHECK(bkvs_compact(ctx, snap_path) == BKVS_OK);
+    TEST_CHECK(access(tmp_path, F_OK) != 0);
+    bkvs_del(ctx);
+    check_load(lo, hi);
+
+    /* killed after the snapshot is swapped in but before the log is: the old log is
+       replayed on the new snapshot without applying its changes twice, then the
+       rotated one. */
+    TEST_CHECK(bkvs_load(snap_path, &ctx, &conf) == BKVS_OK);
+    TEST_CHECK(bkvs_compact_begin(ctx, snap_path) == BKVS_OK);
+    TEST_CHECK(bkvs_compact_step(ctx, 8) == BKVS_ERR_AGAIN);
+    for (bkvs_u32 i = 0; i < 50; i++) {
+        test_put_pair(ctx, hi++);
+        test_drop_pair(ctx, lo++);
+    }
+    copy_file(wal_path, copy_path);
+    copy_file(next_path, next_copy_path);
+    TEST_CHECK(bkvs_compact_step(ctx, conf.bucket_num) == BKVS_OK);
+    bkvs_del(ctx);
+    TEST_CHECK(rename(copy_path, wal_path) == 0);
+    TEST_CHECK(rename(next_copy_path, next_path) == 0);
+    check_load(lo, hi);
+
+    remove(wal_path);
+    remove(snap_path);
+
+    return 0;
+}
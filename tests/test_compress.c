@@ -0,0 +1,197 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * value compression round trips.
+ * 
+ * values of every shape the LZ4 block format has a rule for go through
+ * `bkvs_put()` and come back whole from `bkvs_get()` and `bkvs_read()`:
+ * incompressible data kept as is, values either side of `compress_min_size`,
+ * long literal runs and long matches with extended lengths, matches
+ * overlapping the bytes they produce at every small offset, and matches at
+ * the far end of the window.
+*/
+
+#include "test.h"
+
+#define MIN_SIZE    64
+
+#define VALUE_MAX   (1 << 20)
+
+static bkvs_u64 rand_state = 0x9e3779b97f4a7c15ULL;
+
+static bkvs_u8 rand_byte(void) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+
+    return (bkvs_u8)(rand_state >> 32);
+}
+
+static void fill_rand(bkvs_u8 *value, bkvs_u32 size) {
+    for (bkvs_u32 i = 0; i < size; i++) {
+        value[i] = rand_byte();
+    }
+}
+
+/* `size` bytes repeating the first `period` random ones. */
+static void fill_period(bkvs_u8 *value, bkvs_u32 size, bkvs_u32 period) {
+    fill_rand(value, period < size ? period : size);
+    for (bkvs_u32 i = period; i < size; i++) {
+        value[i] = value[i - period];
+    }
+}
+
+static bkvs_u8 *read_buff;
+
+/* put the value in place of the key's last one, read it back both ways and
+   return whether it is stored compressed. */
+static bkvs_u32 round_trip(bkvs_ctx *ctx, const char *key, const bkvs_u8 *value, bkvs_u32 size) {
+    bkvs_stat before;
+    bkvs_stat after;
+    bkvs_buff buff;
+    bkvs_u32 value_size;
+    bkvs_res res;
+
+    res = bkvs_drop(ctx, key);
+    TEST_CHECK(res == BKVS_OK || res == BKVS_ERR_NO_KEY);
+    TEST_CHECK(bkvs_status(ctx, &before) == BKVS_OK);
+    TEST_CHECK(bkvs_put(ctx, key, value, size) == BKVS_OK);
+    TEST_CHECK(bkvs_status(ctx, &after) == BKVS_OK);
+
+    TEST_CHECK(bkvs_get(ctx, key, &buff) == BKVS_OK);
+    TEST_CHECK(buff.size == size && memcmp(buff.ptr, value, size) == 0);
+    value_size = 0;
+    TEST_CHECK(bkvs_read(ctx, key, read_buff, size, &value_size) == BKVS_OK);
+    TEST_CHECK(value_size == size && memcmp(read_buff, value, size) == 0);
+
+    return after.packed_num > before.packed_num;
+}
+
+int main(void) {
+    char path[TEST_PATH_SIZE];
+    bkvs_u8 *value;
+    bkvs_conf conf;
+    bkvs_stat stat;
+    bkvs_ctx *ctx;
+    bkvs_ctx *loaded;
+    char key[32];
+    bkvs_buff buff;
+    bkvs_u32 value_size;
+    bkvs_u32 size;
+
+    test_path(path, "compress.bkvs");
+    value = (bkvs_u8 *)malloc(VALUE_MAX);
+    read_buff = (bkvs_u8 *)malloc(VALUE_MAX);
+    TEST_CHECK(value != NULL && read_buff != NULL);
+    memset(&conf, 0, sizeof(conf));
+    conf.compress_min_size = MIN_SIZE;
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+
+    /* incompressible data is kept as is. */
+    for (size = MIN_SIZE; size <= VALUE_MAX; size *= 4) {
+        fill_rand(value, size);
+        TEST_CHECK(!round_trip(ctx, "rand", value, size));
+    }
+
+    /* values from `compress_min_size` on are compressed, smaller ones are not. */
+    memset(value, 'a', MIN_SIZE);
+    TEST_CHECK(!round_trip(ctx, "min", value, MIN_SIZE - 1));
+    TEST_CHECK(round_trip(ctx, "min", value, MIN_SIZE));
+    TEST_CHECK(round_trip(ctx, "min", value, MIN_SIZE + 1));
+
+    /* the sizes around the end of block rules, where the last bytes stay literals. */
+    for (size = MIN_SIZE; size < MIN_SIZE + 32; size++) {
+        fill_period(value, size, 4);
+        round_trip(ctx, "tail", value, size);
+    }
+
+    /* overlapping matches at every small offset, with lengths extended past 15 + 255. */
+    for (bkvs_u32 period = 1; period <= 20; period++) {
+        fill_period(value, 10000, period);
+        TEST_CHECK(round_trip(ctx, "period", value, 10000));
+    }
+    memset(value, 0, VALUE_MAX);
+    TEST_CHECK(round_trip(ctx, "zero", value, VALUE_MAX));
+
+    /* literal runs longer than 15 + 255 between long matches. */
+    for (bkvs_u32 i = 0; i < 8; i++) {
+        fill_rand(value + i * 4096, 1000 + i * 300);
+        memset(value + i * 4096 + 1000 + i * 300, i, 4096 - 1000 - i * 300);
+    }
+    TEST_CHECK(round_trip(ctx, "literal", value, 8 * 4096));
+
+    /* matches at the far end of the 64 KB window, and past it. */
+    for (bkvs_u32 gap = 60000; gap <= 70000; gap += 5000) {
+        fill_rand(value, 1000);
+        memset(value + 1000, 0, gap);
+        memcpy(value + 1000 + gap, value, 1000);
+        TEST_CHECK(round_trip(ctx, "far", value, 2000 + gap));
+    }
+
+    /* a buffer too small for the value gets its size. */
+    fill_period(value, 5000, 7);
+    TEST_CHECK(round_trip(ctx, "small", value, 5000));
+    value_size = 0;
+    TEST_CHECK(bkvs_read(ctx, "small", read_buff, 4999, &value_size) == BKVS_ERR_NO_ROOM);
+    TEST_CHECK(value_size == 5000);
+    TEST_CHECK(bkvs_read(ctx, "small", read_buff, 0, NULL) == BKVS_ERR_NO_ROOM);
+    TEST_CHECK(bkvs_read(ctx, "none", read_buff, 5000, &value_size) == BKVS_ERR_NO_KEY);
+
+    /* compressed values are saved whole and loaded back. */
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.packed_num > 0);
+    TEST_CHECK(stat.packed_size < stat.packed_raw_size);
+    TEST_CHECK(bkvs_save(ctx, path) == BKVS_OK);
+    TEST_CHECK(bkvs_load(path, &loaded, NULL) == BKVS_OK);
+    TEST_CHECK(bkvs_get(loaded, "small", &buff) == BKVS_OK);
+    TEST_CHECK(buff.size == 5000 && memcmp(buff.ptr, value, 5000) == 0);
+    TEST_CHECK(bkvs_get(loaded, "zero", &buff) == BKVS_OK && buff.size == VALUE_MAX);
+    for (bkvs_u32 i = 0; i < VALUE_MAX; i++) {
+        TEST_CHECK(buff.ptr[i] == 0);
+    }
+    bkvs_del(loaded);
+    remove(path);
+
+    /* dropping and overwriting compressed values. */
+    for (bkvs_u32 i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        fill_period(value, 1000 + i, 1 + i % 9);
+        TEST_CHECK(round_trip(ctx, key, value, 1000 + i));
+    }
+    for (bkvs_u32 i = 0; i < 100; i += 2) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        TEST_CHECK(bkvs_drop(ctx, key) == BKVS_OK);
+    }
+    for (bkvs_u32 i = 1; i < 100; i += 2) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        fill_rand(value, 2000);
+        TEST_CHECK(!round_trip(ctx, key, value, 2000));
+    }
+
+    bkvs_del(ctx);
+    free(value);
+    free(read_buff);
+
+    return 0;
+}
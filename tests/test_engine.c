@@ -0,0 +1,239 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * the cuckoo engine.
+ * 
+ * keys of the same hash fill their two buckets and then the stash, after
+ * which a new key is refused with `BKVS_ERR_NO_ROOM` and leaves the set as
+ * it was. pairs dropped from the stash free its room again. keys of a good
+ * hash displace each other to fill the buckets almost full before they are
+ * doubled, and a set with a stash survives saving and loading. buckets
+ * that cannot be doubled for want of memory are left as they were.
+*/
+
+#include "test.h"
+
+/* doubling runs out of memory under a limit of the address space, which the address sanitizer needs whole. */
+#if defined(__linux__) && !defined(__SANITIZE_ADDRESS__)
+#define LIMIT_AS
+#include <sys/resource.h>
+#endif
+
+#define PAIR_NUM    20000
+
+/* size of a bucket of the cuckoo engine, one cache line. */
+#define LINE_SIZE   64
+
+/* room of the stash, `BKVS_CUCKOO_STASH_MAX`. */
+#define STASH_NUM   8
+
+/* two buckets of four slots and the stash. */
+#define SAME_NUM    (2 * 4 + STASH_NUM)
+
+/* every key lands in the same two buckets. */
+static bkvs_u32 same_hash(const char *key) {
+    (void)key;
+
+    return 1;
+}
+
+static bkvs_u32 visit_num;
+
+static bkvs_res order_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    static char last[32];
+
+    TEST_CHECK(idx == visit_num && (visit_num == 0 || strcmp(last, key) < 0));
+    snprintf(last, sizeof(last), "%s", key);
+    visit_num++;
+    (void)buff;
+    (void)num;
+
+    return BKVS_OK;
+}
+
+static void check_stat(bkvs_ctx *ctx, bkvs_u32 bucket_num, bkvs_u32 stash_num) {
+    bkvs_stat stat;
+
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK);
+    TEST_CHECK(stat.bucket_num == bucket_num && stat.stash_num == stash_num);
+}
+
+#ifdef LIMIT_AS
+/* the index of the key "k<i>", which fills the buckets in turn. */
+static bkvs_u32 index_hash(const char *key) {
+    return (bkvs_u32)strtoul(key + 1, NULL, 10);
+}
+
+/* size of the address space of the process. */
+static rlim_t vm_size(void) {
+    unsigned long page_num;
+    FILE *file;
+
+    file = fopen("/proc/self/statm", "r");
+    TEST_CHECK(file != NULL && fscanf(file, "%lu", &page_num) == 1);
+    fclose(file);
+
+    return (rlim_t)page_num * (rlim_t)sysconf(_SC_PAGESIZE);
+}
+
+/* the buckets are kept when their doubling runs out of memory, and doubled once it is there. */
+static void check_resize(void) {
+    struct rlimit limit;
+    struct rlimit saved;
+    bkvs_u32 bucket_num;
+    bkvs_u32 full_num;
+    char key[32];
+    bkvs_ctx *ctx;
+    bkvs_conf conf;
+    bkvs_stat stat;
+    bkvs_u32 value;
+    bkvs_res res;
+
+    /* fill every slot and the stash. */
+    bucket_num = 1 << 16;
+    full_num = bucket_num * 4 + STASH_NUM;
+    memset(&conf, 0, sizeof(conf));
+    conf.engine = BKVS_ENGINE_CUCKOO;
+    conf.hash_cb = index_hash;
+    conf.bucket_num = bucket_num * 4;
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < full_num; i++) {
+        test_put_pair(ctx, i);
+    }
+    check_stat(ctx, bucket_num, STASH_NUM);
+
+    /* leave room for the pair but not for the doubled buckets. */
+    TEST_CHECK(getrlimit(RLIMIT_AS, &saved) == 0);
+    limit = saved;
+    limit.rlim_cur = vm_size() + (rlim_t)LINE_SIZE * bucket_num / 2;
+    TEST_CHECK(setrlimit(RLIMIT_AS, &limit) == 0);
+    snprintf(key, sizeof(key), "k%u", full_num);
+    value = full_num * 7;
+    res = bkvs_put(ctx, key, &value, sizeof(value));
+    TEST_CHECK(setrlimit(RLIMIT_AS, &saved) == 0);
+    TEST_CHECK(res == BKVS_ERR_NO_MEM);
+    check_stat(ctx, bucket_num, STASH_NUM);
+    test_check_pairs(ctx, 0, full_num);
+    test_put_pair(ctx, full_num);
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.bucket_num == bucket_num * 2);
+    test_check_pairs(ctx, 0, full_num + 1);
+    bkvs_del(ctx);
+}
+#endif
+
+int main(void) {
+    char path[TEST_PATH_SIZE];
+    char key[32];
+    bkvs_ctx *ctx;
+    bkvs_conf conf;
+    bkvs_stat stat;
+    bkvs_u32 value;
+
+    test_path(path, "engine.bkvs");
+    memset(&conf, 0, sizeof(conf));
+    conf.engine = BKVS_ENGINE_CUCKOO;
+    conf.hash_cb = same_hash;
+    conf.bucket_num = 2 * 4;
+    conf.ordered_index = 1;
+
+    /* the keys fill the two buckets, then the stash. */
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < SAME_NUM; i++) {
+        test_put_pair(ctx, i);
+    }
+    check_stat(ctx, 2, STASH_NUM);
+
+    /* one more key is refused, also after doubling the buckets, and is not indexed. */
+    snprintf(key, sizeof(key), "k%u", SAME_NUM);
+    value = SAME_NUM * 7;
+    TEST_CHECK(bkvs_put(ctx, key, &value, sizeof(value)) == BKVS_ERR_NO_ROOM);
+    TEST_CHECK(bkvs_has(ctx, key) == BKVS_ERR_NO_KEY);
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.stash_num == STASH_NUM && stat.bucket_num > 2);
+    test_check_pairs(ctx, 0, SAME_NUM);
+    visit_num = 0;
+    TEST_CHECK(bkvs_range(ctx, NULL, NULL, order_cb) == BKVS_OK && visit_num == SAME_NUM);
+
+    /* the stash survives saving and loading. */
+    TEST_CHECK(bkvs_save(ctx, path) == BKVS_OK);
+    bkvs_del(ctx);
+    TEST_CHECK(bkvs_load(path, &ctx, &conf) == BKVS_OK);
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.stash_num == STASH_NUM);
+    test_check_pairs(ctx, 0, SAME_NUM);
+
+    /* a pair dropped from the middle of the stash makes room for another one. */
+    test_drop_pair(ctx, SAME_NUM - 5);
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.stash_num == STASH_NUM - 1);
+    for (bkvs_u32 i = 0; i < SAME_NUM; i++) {
+        snprintf(key, sizeof(key), "k%u", i);
+        TEST_CHECK(bkvs_has(ctx, key) == (i == SAME_NUM - 5 ? BKVS_ERR_NO_KEY : BKVS_OK));
+    }
+    test_put_pair(ctx, SAME_NUM - 5);
+    test_check_pairs(ctx, 0, SAME_NUM);
+    for (bkvs_u32 i = SAME_NUM; i-- > 0;) {
+        test_drop_pair(ctx, i);
+        test_check_pairs(ctx, 0, i);
+    }
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.stash_num == 0);
+    bkvs_del(ctx);
+
+    /* keys of a good hash move to their other buckets and fill them before doubling. */
+    conf.hash_cb = NULL;
+    conf.ordered_index = 0;
+    conf.bucket_num = PAIR_NUM;
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < stat.bucket_num * 4 * 9 / 10; i++) {
+        test_put_pair(ctx, i);
+    }
+    check_stat(ctx, stat.bucket_num, 0);
+    test_check_pairs(ctx, 0, stat.bucket_num * 4 * 9 / 10);
+    bkvs_del(ctx);
+
+    /* and grow by doubling from the smallest table. */
+    conf.bucket_num = 2 * 4;
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    check_stat(ctx, 2, 0);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        test_put_pair(ctx, i);
+    }
+
+    /* the buckets are doubled only once half of the slots are used, so at least a quarter is. */
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.stash_num == 0);
+    TEST_CHECK((stat.bucket_num & (stat.bucket_num - 1)) == 0 && stat.bucket_num > 2);
+    TEST_CHECK(PAIR_NUM * 4 >= stat.bucket_num * 4);
+    test_check_pairs(ctx, 0, PAIR_NUM);
+    TEST_CHECK(bkvs_save(ctx, path) == BKVS_OK);
+    bkvs_del(ctx);
+    TEST_CHECK(bkvs_load(path, &ctx, &conf) == BKVS_OK);
+    test_check_pairs(ctx, 0, PAIR_NUM);
+    bkvs_del(ctx);
+    remove(path);
+
+#ifdef LIMIT_AS
+    check_resize();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * rehashing the keyed buckets.
+ * 
+ * keys piling up in one bucket make the set draw a new seed and move every
+ * pair to its new bucket. the records stay where they are, so the values
+ * got before the rehash are still readable, the eviction order is kept and
+ * the ordered index still walks every key.
+*/
+
+#include "test.h"
+
+#define BUCKET_NUM  64
+
+/* one more than `BKVS_CHAIN_GUARD`, with less than one pair per bucket on average. */
+#define PILE_NUM    33
+
+static bkvs_u32 visit_num;
+
+static bkvs_res order_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    static char last[32];
+    bkvs_u32 value;
+
+    TEST_CHECK(idx == visit_num && (visit_num == 0 || strcmp(last, key) < 0));
+    TEST_CHECK(buff->size == sizeof(value));
+    memcpy(&value, buff->ptr, sizeof(value));
+    TEST_CHECK(value == (bkvs_u32)atoi(key + 1) * 7);
+    snprintf(last, sizeof(last), "%s", key);
+    visit_num++;
+    (void)num;
+
+    return BKVS_OK;
+}
+
+static bkvs_u32 bucket_used_num(bkvs_ctx *ctx) {
+    bkvs_stat stat;
+
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK);
+
+    return stat.bucket_used_num;
+}
+
+int main(void) {
+    const bkvs_u8 *values[PILE_NUM];
+    bkvs_u32 pile[PILE_NUM];
+    bkvs_u32 pile_num;
+    char key[32];
+    bkvs_ctx *ctx;
+    bkvs_conf conf;
+    bkvs_buff buff;
+    bkvs_stat stat;
+    bkvs_u32 value;
+    bkvs_u32 i;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = BUCKET_NUM;
+    conf.evict_policy = BKVS_EVICT_LRU;
+    conf.pair_num_max = PILE_NUM;
+    conf.ordered_index = 1;
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+
+    /* keep the keys that land in the bucket of the first one, all but the last. */
+    pile_num = 0;
+    for (i = 0; pile_num < PILE_NUM - 1; i++) {
+        test_put_pair(ctx, i);
+        if (bucket_used_num(ctx) == 1) {
+            pile[pile_num++] = i;
+        } else {
+            test_drop_pair(ctx, i);
+        }
+    }
+
+    /* use them oldest first and keep the addresses of their values. */
+    for (bkvs_u32 j = 0; j < pile_num; j++) {
+        snprintf(key, sizeof(key), "k%u", pile[j]);
+        TEST_CHECK(bkvs_get(ctx, key, &buff) == BKVS_OK);
+        values[j] = buff.ptr;
+    }
+
+    /* the next one in the bucket makes its chain too long. */
+    for (stat.rehash_num = 0; stat.rehash_num == 0; i++) {
+        test_put_pair(ctx, i);
+        TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK);
+        if (stat.rehash_num == 0) {
+            TEST_CHECK(stat.bucket_used_num == 2);
+            test_drop_pair(ctx, i);
+        }
+    }
+    pile[pile_num++] = i - 1;
+    TEST_CHECK(stat.rehash_num == 1 && stat.bucket_used_num > 1 && stat.pair_num == PILE_NUM);
+
+    /* the values got before the rehash are still in place. */
+    for (bkvs_u32 j = 0; j < PILE_NUM - 1; j++) {
+        memcpy(&value, values[j], sizeof(value));
+        TEST_CHECK(value == pile[j] * 7);
+    }
+
+    /* the ordered index walks every key in byte order. */
+    visit_num = 0;
+    TEST_CHECK(bkvs_range(ctx, NULL, NULL, order_cb) == BKVS_OK);
+    TEST_CHECK(visit_num == PILE_NUM);
+
+    /* the least recently used pairs are evicted first. */
+    for (bkvs_u32 j = 0; j < 3; j++) {
+        test_put_pair(ctx, i + j);
+        snprintf(key, sizeof(key), "k%u", pile[j]);
+        TEST_CHECK(bkvs_has(ctx, key) == BKVS_ERR_NO_KEY);
+        snprintf(key, sizeof(key), "k%u", pile[j + 1]);
+        TEST_CHECK(bkvs_has(ctx, key) == BKVS_OK);
+    }
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK && stat.evict_num == 3);
+    for (bkvs_u32 j = 3; j < PILE_NUM; j++) {
+        snprintf(key, sizeof(key), "k%u", pile[j]);
+        TEST_CHECK(bkvs_get(ctx, key, &buff) == BKVS_OK);
+        memcpy(&value, buff.ptr, sizeof(value));
+        TEST_CHECK(value == pile[j] * 7);
+    }
+    bkvs_del(ctx);
+
+    return 0;
+}
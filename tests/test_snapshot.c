@@ -0,0 +1,209 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * snapshot save and load round trips.
+ * 
+ * values of every size up to a few hundred bytes are saved and loaded back
+ * with the saved configuration and with a different hash, the loaded pairs
+ * are overwritten and dropped, and damaged or truncated snapshots must fail
+ * to load with `BKVS_ERR_BAD_FILE`. sets of distinct threads are saved at the
+ * same time.
+*/
+
+#include <pthread.h>
+
+#include "test.h"
+
+#define PAIR_NUM    5000
+
+#define VALUE_MAX   300
+
+#define THREAD_NUM  4
+
+static void make_value(bkvs_u32 i, bkvs_u8 *value, bkvs_u32 *size) {
+    *size = 1 + i % VALUE_MAX;
+    for (bkvs_u32 n = 0; n < *size; n++) {
+        value[n] = (bkvs_u8)(i * 31 + n);
+    }
+}
+
+static void check_pairs(bkvs_ctx *ctx, bkvs_u32 lo, bkvs_u32 hi) {
+    bkvs_u8 value[VALUE_MAX];
+    char key[32];
+    bkvs_buff buff;
+    bkvs_u32 size;
+
+    for (bkvs_u32 i = lo; i < hi; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        make_value(i, value, &size);
+        TEST_CHECK(bkvs_get(ctx, key, &buff) == BKVS_OK);
+        TEST_CHECK(buff.size == size && memcmp(buff.ptr, value, size) == 0);
+    }
+}
+
+static void damage(const char *path, long offset, long size) {
+    FILE *file;
+    int byte;
+
+    file = fopen(path, "r+b");
+    TEST_CHECK(file != NULL);
+    if (size >= 0) {
+        TEST_CHECK(ftruncate(fileno(file), size) == 0);
+    } else {
+        TEST_CHECK(fseek(file, offset, SEEK_SET) == 0);
+        byte = fgetc(file);
+        TEST_CHECK(byte != EOF);
+        TEST_CHECK(fseek(file, offset, SEEK_SET) == 0);
+        fputc(byte ^ 0x55, file);
+    }
+    fclose(file);
+}
+
+/* fill, save and load back a set of its own. */
+static void *save_thread(void *arg) {
+    char path[TEST_PATH_SIZE];
+    char name[32];
+    bkvs_u8 value[VALUE_MAX];
+    bkvs_ctx *ctx;
+    bkvs_ctx *loaded;
+    char key[32];
+    bkvs_u32 size;
+
+    snprintf(name, sizeof(name), "thread_%u.bkvs", *(bkvs_u32 *)arg);
+    test_path(path, name);
+    TEST_CHECK(bkvs_new(&ctx, NULL) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        make_value(i, value, &size);
+        TEST_CHECK(bkvs_put(ctx, key, value, size) == BKVS_OK);
+    }
+    for (bkvs_u32 round = 0; round < 4; round++) {
+        TEST_CHECK(bkvs_save(ctx, path) == BKVS_OK);
+        TEST_CHECK(bkvs_load(path, &loaded, NULL) == BKVS_OK);
+        check_pairs(loaded, 0, PAIR_NUM);
+        bkvs_del(loaded);
+    }
+    bkvs_del(ctx);
+    remove(path);
+
+    return NULL;
+}
+
+int main(void) {
+    char path[TEST_PATH_SIZE];
+    char copy_path[TEST_PATH_SIZE];
+    bkvs_u8 value[VALUE_MAX];
+    bkvs_conf conf;
+    bkvs_stat stat;
+    bkvs_ctx *ctx;
+    bkvs_ctx *loaded;
+    char key[32];
+    bkvs_u32 size;
+    long file_size;
+    FILE *file;
+    pthread_t threads[THREAD_NUM];
+    bkvs_u32 thread_ids[THREAD_NUM];
+
+    test_path(path, "snapshot.bkvs");
+    test_path(copy_path, "snapshot_copy.bkvs");
+
+    /* sets of distinct threads are saved at the same time, the first saves of the process. */
+    for (bkvs_u32 i = 0; i < THREAD_NUM; i++) {
+        thread_ids[i] = i;
+        TEST_CHECK(pthread_create(&threads[i], NULL, save_thread, &thread_ids[i]) == 0);
+    }
+    for (bkvs_u32 i = 0; i < THREAD_NUM; i++) {
+        TEST_CHECK(pthread_join(threads[i], NULL) == 0);
+    }
+
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = 97;
+    conf.hash_cb = bkvs_hash_cb_sdbm;
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+
+    /* an empty set round trips. */
+    TEST_CHECK(bkvs_save(ctx, path) == BKVS_OK);
+    TEST_CHECK(bkvs_load(path, &loaded, NULL) == BKVS_OK);
+    TEST_CHECK(bkvs_status(loaded, &stat) == BKVS_OK && stat.pair_num == 0);
+    bkvs_del(loaded);
+
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        make_value(i, value, &size);
+        TEST_CHECK(bkvs_put(ctx, key, value, size) == BKVS_OK);
+    }
+    TEST_CHECK(bkvs_save(ctx, path) == BKVS_OK);
+    TEST_CHECK(access(path, F_OK) == 0);
+
+    /* load with the configuration of the snapshot. */
+    TEST_CHECK(bkvs_load(path, &loaded, NULL) == BKVS_OK);
+    TEST_CHECK(bkvs_status(loaded, &stat) == BKVS_OK && stat.pair_num == PAIR_NUM);
+    check_pairs(loaded, 0, PAIR_NUM);
+
+    /* loaded pairs can be overwritten and dropped, then saved again. */
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i += 2) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        make_value(i, value, &size);
+        TEST_CHECK(bkvs_put(loaded, key, value, size) == BKVS_OK);
+    }
+    for (bkvs_u32 i = PAIR_NUM / 2; i < PAIR_NUM; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        TEST_CHECK(bkvs_drop(loaded, key) == BKVS_OK);
+    }
+    TEST_CHECK(bkvs_save(loaded, copy_path) == BKVS_OK);
+    bkvs_del(loaded);
+    TEST_CHECK(bkvs_load(copy_path, &loaded, NULL) == BKVS_OK);
+    TEST_CHECK(bkvs_status(loaded, &stat) == BKVS_OK && stat.pair_num == PAIR_NUM / 2);
+    check_pairs(loaded, 0, PAIR_NUM / 2);
+    snprintf(key, sizeof(key), "key:%u", PAIR_NUM - 1);
+    TEST_CHECK(bkvs_has(loaded, key) == BKVS_ERR_NO_KEY);
+    bkvs_del(loaded);
+
+    /* load with a different hash and bucket number, the pairs are rehashed. */
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = 1024;
+    TEST_CHECK(bkvs_load(path, &loaded, &conf) == BKVS_OK);
+    check_pairs(loaded, 0, PAIR_NUM);
+    bkvs_del(loaded);
+    bkvs_del(ctx);
+
+    /* a flipped byte in the records or a truncated file is rejected. */
+    file = fopen(path, "rb");
+    TEST_CHECK(file != NULL && fseek(file, 0, SEEK_END) == 0);
+    file_size = ftell(file);
+    fclose(file);
+    damage(path, file_size / 2, -1);
+    TEST_CHECK(bkvs_load(path, &loaded, NULL) == BKVS_ERR_BAD_FILE);
+    damage(copy_path, 0, file_size / 3);
+    TEST_CHECK(bkvs_load(copy_path, &loaded, NULL) == BKVS_ERR_BAD_FILE);
+    damage(copy_path, 0, 0);
+    TEST_CHECK(bkvs_load(copy_path, &loaded, NULL) == BKVS_ERR_BAD_FILE);
+
+    remove(path);
+    remove(copy_path);
+    TEST_CHECK(bkvs_load(path, &loaded, NULL) == BKVS_ERR_IO);
+
+    return 0;
+}
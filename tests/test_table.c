@@ -0,0 +1,114 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * read-only table files.
+ * 
+ * a set written by `bkvs_save_table()` is mapped back and looked up and
+ * iterated in place. the records are only checked when read, so a key
+ * missing its terminating NUL must fail with `BKVS_ERR_BAD_FILE` instead of
+ * reaching the callbacks, and damaged headers must fail to map.
+*/
+
+#include "test.h"
+
+#define PAIR_NUM    2000
+
+static bkvs_u32 visit_num;
+
+static bkvs_res count_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    TEST_CHECK(strncmp(key, "key:", 4) == 0);
+    TEST_CHECK(buff->size == strlen(key) + 1 && memcmp(buff->ptr, key, buff->size) == 0);
+    TEST_CHECK(idx == visit_num && num == PAIR_NUM);
+    visit_num++;
+
+    return BKVS_OK;
+}
+
+static void poke(const char *path, long offset, int byte) {
+    FILE *file;
+
+    file = fopen(path, "r+b");
+    TEST_CHECK(file != NULL && fseek(file, offset, SEEK_SET) == 0);
+    fputc(byte, file);
+    fclose(file);
+}
+
+int main(void) {
+    char path[TEST_PATH_SIZE];
+    bkvs_ctx *ctx;
+    bkvs_ctx *mapped;
+    char key[32];
+    bkvs_buff buff;
+    bkvs_u32 key_size;
+    FILE *file;
+    bkvs_u8 rec[12];
+
+    test_path(path, "table.bkvt");
+
+    TEST_CHECK(bkvs_new(&ctx, NULL) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        TEST_CHECK(bkvs_put(ctx, key, key, strlen(key) + 1) == BKVS_OK);
+    }
+    TEST_CHECK(bkvs_save_table(ctx, path) == BKVS_OK);
+    bkvs_del(ctx);
+
+    /* the mapped set answers lookups and iterates every pair, but takes no changes. */
+    TEST_CHECK(bkvs_map(path, &mapped, NULL) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        snprintf(key, sizeof(key), "key:%u", i);
+        TEST_CHECK(bkvs_get(mapped, key, &buff) == BKVS_OK);
+        TEST_CHECK(strcmp((const char *)buff.ptr, key) == 0);
+    }
+    TEST_CHECK(bkvs_has(mapped, "key:none") == BKVS_ERR_NO_KEY);
+    TEST_CHECK(bkvs_put(mapped, "key:0", "x", 2) == BKVS_ERR_READ_ONLY);
+    TEST_CHECK(bkvs_foreach(mapped, count_cb) == BKVS_OK && visit_num == PAIR_NUM);
+    bkvs_del(mapped);
+
+    /* a key of the first record running into its value is rejected. */
+    file = fopen(path, "rb");
+    TEST_CHECK(file != NULL && fseek(file, 48, SEEK_SET) == 0);
+    TEST_CHECK(fread(rec, 1, sizeof(rec), file) == sizeof(rec));
+    fclose(file);
+    key_size = rec[4] | rec[5] << 8 | (bkvs_u32)rec[6] << 16 | (bkvs_u32)rec[7] << 24;
+    TEST_CHECK(key_size > 1 && key_size < 32);
+    poke(path, 48 + 12 + key_size - 1, 'x');
+    TEST_CHECK(bkvs_map(path, &mapped, NULL) == BKVS_OK);
+    visit_num = 0;
+    TEST_CHECK(bkvs_foreach(mapped, count_cb) == BKVS_ERR_BAD_FILE);
+    TEST_CHECK(visit_num == 0);
+    bkvs_del(mapped);
+
+    /* a damaged header or a truncated file does not map. */
+    poke(path, 48 + 12 + key_size - 1, '\0');
+    poke(path, 12, 0xff);
+    TEST_CHECK(bkvs_map(path, &mapped, NULL) == BKVS_ERR_BAD_FILE);
+    TEST_CHECK(truncate(path, 100) == 0);
+    TEST_CHECK(bkvs_map(path, &mapped, NULL) == BKVS_ERR_BAD_FILE);
+
+    remove(path);
+
+    return 0;
+}
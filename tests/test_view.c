@@ -0,0 +1,251 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * copy-on-write point-in-time views.
+ * 
+ * the pairs "k<i>" hold the value i * <version> of the version they were put
+ * with. every view must keep seeing the version it was taken at through
+ * `bkvs_snap_get()` and `bkvs_snap_foreach()` while the set is overwritten,
+ * dropped, emptied or changed from inside the walk of the view itself, and
+ * deleting the views must free the bucket copies they no longer share.
+*/
+
+#include "test.h"
+
+#define PAIR_NUM    1000
+
+#define BIG_SIZE    100
+
+static bkvs_ctx *ctx;
+
+static bkvs_u8 seen[PAIR_NUM * 2];
+
+static bkvs_u32 seen_num;
+
+static bkvs_u32 walk_version;
+
+/* put "k<i>" with its value of `version`, every tenth one large enough not to be kept in the record. */
+static void put_version(bkvs_u32 i, bkvs_u32 version) {
+    bkvs_u32 value[BIG_SIZE / 4];
+    char key[32];
+
+    snprintf(key, sizeof(key), "k%u", i);
+    for (bkvs_u32 n = 0; n < BIG_SIZE / 4; n++) {
+        value[n] = i * version;
+    }
+    TEST_CHECK(bkvs_put(ctx, key, value, i % 10 == 0 ? BIG_SIZE : 4) == BKVS_OK);
+}
+
+static void check_value(bkvs_u32 i, const bkvs_buff *buff, bkvs_u32 version) {
+    bkvs_u32 value;
+
+    TEST_CHECK(buff->size == (i % 10 == 0 ? BIG_SIZE : 4));
+    for (bkvs_u32 n = 0; n < buff->size; n += 4) {
+        memcpy(&value, buff->ptr + n, sizeof(value));
+        TEST_CHECK(value == i * version);
+    }
+}
+
+/* check that the view sees "k<lo>" to "k<hi - 1>" of `version` and no "k<hi>". */
+static void check_view(bkvs_snap *snap, bkvs_u32 lo, bkvs_u32 hi, bkvs_u32 version) {
+    char key[32];
+    bkvs_buff buff;
+
+    for (bkvs_u32 i = lo; i < hi; i++) {
+        snprintf(key, sizeof(key), "k%u", i);
+        TEST_CHECK(bkvs_snap_get(snap, key, &buff) == BKVS_OK);
+        check_value(i, &buff, version);
+    }
+    snprintf(key, sizeof(key), "k%u", hi);
+    TEST_CHECK(bkvs_snap_get(snap, key, &buff) == BKVS_ERR_NO_KEY);
+}
+
+static bkvs_u32 key_index(const char *key) {
+    TEST_CHECK(key[0] == 'k');
+
+    return (bkvs_u32)strtoul(key + 1, NULL, 10);
+}
+
+/* count the pairs of the walk, each seen once and of `walk_version`. */
+static bkvs_res count_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    bkvs_u32 i;
+
+    i = key_index(key);
+    TEST_CHECK(i < PAIR_NUM * 2 && !seen[i]);
+    TEST_CHECK(idx == seen_num && idx < num);
+    check_value(i, buff, walk_version);
+    seen[i] = 1;
+    seen_num++;
+
+    return BKVS_OK;
+}
+
+/* drop each pair of the walk and put a new version of a pair past it. */
+static bkvs_res change_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    bkvs_u32 i;
+    bkvs_res res;
+
+    /* the key and value point into the live pair until it is dropped. */
+    res = count_cb(key, buff, idx, num);
+    i = key_index(key);
+    TEST_CHECK(bkvs_drop(ctx, key) == BKVS_OK);
+    put_version(i + PAIR_NUM, 5);
+
+    return res;
+}
+
+static bkvs_res stop_cb(const char *key, bkvs_buff *buff, bkvs_u32 idx, bkvs_u32 num) {
+    (void)key;
+    (void)buff;
+    (void)num;
+
+    return idx == 9 ? BKVS_ERR_ITER_STOP : BKVS_OK;
+}
+
+static void walk(bkvs_snap *snap, bkvs_foreach_cb cb, bkvs_u32 version, bkvs_u32 num) {
+    memset(seen, 0, sizeof(seen));
+    seen_num = 0;
+    walk_version = version;
+    TEST_CHECK(bkvs_snap_foreach(snap, cb) == BKVS_OK);
+    TEST_CHECK(seen_num == num);
+}
+
+static bkvs_u64 overhead_size(void) {
+    bkvs_stat stat;
+
+    TEST_CHECK(bkvs_status(ctx, &stat) == BKVS_OK);
+
+    return stat.overhead_size;
+}
+
+int main(void) {
+    bkvs_conf conf;
+    bkvs_snap *first;
+    bkvs_snap *second;
+    bkvs_snap *view;
+    bkvs_ctx *tree;
+    char key[32];
+    bkvs_buff kept;
+    bkvs_buff buff;
+    bkvs_u64 base_size;
+    bkvs_u64 size;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.bucket_num = 64;
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        put_version(i, 1);
+    }
+    base_size = overhead_size();
+
+    /* a view keeps the version it was taken at, the set moves on. */
+    TEST_CHECK(bkvs_snapshot(ctx, &first) == BKVS_OK);
+    check_view(first, 0, PAIR_NUM, 1);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        put_version(i, 2);
+    }
+    for (bkvs_u32 i = PAIR_NUM; i < PAIR_NUM + 100; i++) {
+        put_version(i, 2);
+    }
+    for (bkvs_u32 i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "k%u", i);
+        TEST_CHECK(bkvs_drop(ctx, key) == BKVS_OK);
+    }
+    check_view(first, 0, PAIR_NUM, 1);
+    walk(first, count_cb, 1, PAIR_NUM);
+    TEST_CHECK(bkvs_snap_get(first, "k0", &kept) == BKVS_OK);
+    TEST_CHECK(bkvs_get(ctx, "k0", &buff) == BKVS_ERR_NO_KEY);
+    TEST_CHECK(bkvs_get(ctx, "k100", &buff) == BKVS_OK);
+    check_value(100, &buff, 2);
+
+    /* a second view sees the second version, the first one is not disturbed. */
+    TEST_CHECK(bkvs_snapshot(ctx, &second) == BKVS_OK);
+    for (bkvs_u32 i = 100; i < PAIR_NUM + 100; i++) {
+        put_version(i, 3);
+    }
+    check_view(first, 0, PAIR_NUM, 1);
+    check_view(second, 100, PAIR_NUM + 100, 2);
+    walk(second, count_cb, 2, PAIR_NUM);
+    check_value(0, &kept, 1);
+
+    /* deleting the views frees the copies only they needed. */
+    size = overhead_size();
+    TEST_CHECK(size > base_size);
+    TEST_CHECK(bkvs_snap_del(first) == BKVS_OK);
+    TEST_CHECK(overhead_size() < size);
+    check_view(second, 100, PAIR_NUM + 100, 2);
+    TEST_CHECK(bkvs_snap_del(second) == BKVS_OK);
+
+    /* values overwritten at the same sizes leave nothing behind once the view is gone. */
+    base_size = overhead_size();
+    TEST_CHECK(bkvs_snapshot(ctx, &view) == BKVS_OK);
+    for (bkvs_u32 i = 100; i < PAIR_NUM + 100; i++) {
+        put_version(i, 7);
+    }
+    TEST_CHECK(overhead_size() > base_size);
+    check_view(view, 100, PAIR_NUM + 100, 3);
+    TEST_CHECK(bkvs_snap_del(view) == BKVS_OK);
+    TEST_CHECK(overhead_size() == base_size);
+
+    /* the walk of a view sees the set as it was when the callback changes it. */
+    TEST_CHECK(bkvs_empty(ctx) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        put_version(i, 4);
+    }
+    TEST_CHECK(bkvs_snapshot(ctx, &view) == BKVS_OK);
+    walk(view, change_cb, 4, PAIR_NUM);
+    walk(view, count_cb, 4, PAIR_NUM);
+    for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+        snprintf(key, sizeof(key), "k%u", i);
+        TEST_CHECK(bkvs_has(ctx, key) == BKVS_ERR_NO_KEY);
+        snprintf(key, sizeof(key), "k%u", i + PAIR_NUM);
+        TEST_CHECK(bkvs_get(ctx, key, &buff) == BKVS_OK);
+        check_value(i + PAIR_NUM, &buff, 5);
+    }
+    TEST_CHECK(bkvs_snap_foreach(view, stop_cb) == BKVS_ERR_ITER_STOP);
+    TEST_CHECK(bkvs_snap_del(view) == BKVS_OK);
+
+    /* emptying the set keeps every bucket for the live views. */
+    TEST_CHECK(bkvs_snapshot(ctx, &view) == BKVS_OK);
+    TEST_CHECK(bkvs_empty(ctx) == BKVS_OK);
+    put_version(0, 6);
+    walk(view, count_cb, 5, PAIR_NUM);
+    TEST_CHECK(bkvs_snap_get(view, "k0", &buff) == BKVS_ERR_NO_KEY);
+    TEST_CHECK(bkvs_get(ctx, "k0", &buff) == BKVS_OK);
+    check_value(0, &buff, 6);
+
+    /* a set with live views cannot be frozen, and is deleted along with them. */
+    TEST_CHECK(bkvs_snapshot(ctx, &second) == BKVS_OK);
+    TEST_CHECK(bkvs_freeze(ctx) != BKVS_OK);
+    bkvs_del(ctx);
+
+    /* only the hash engine takes views. */
+    conf.engine = BKVS_ENGINE_ART;
+    TEST_CHECK(bkvs_new(&tree, &conf) == BKVS_OK);
+    TEST_CHECK(bkvs_snapshot(tree, &view) == BKVS_ERR);
+    bkvs_del(tree);
+
+    return 0;
+}
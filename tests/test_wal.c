@@ -0,0 +1,252 @@
+/**
+ * MIT License
+ * 
+ * Copyright (c) 2023 Alex Chen
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * write-ahead log replay.
+ * 
+ * puts and drops logged under each sync policy are replayed by the next set
+ * opening the log, alone and on top of a snapshot. a last record cut short,
+ * damaged or followed by garbage, as left by a crash in the middle of a
+ * write, is dropped with everything after it and the log goes on from the
+ * last whole record. a batch is replayed whole or, when its record is cut,
+ * not at all, and a batch with a failing change leaves the set and the log
+ * as they were.
+*/
+
+#include "test.h"
+
+#define PAIR_NUM    1000
+
+static bkvs_conf conf;
+
+static long file_size(const char *path) {
+    FILE *file;
+    long size;
+
+    file = fopen(path, "rb");
+    TEST_CHECK(file != NULL && fseek(file, 0, SEEK_END) == 0);
+    size = ftell(file);
+    fclose(file);
+
+    return size;
+}
+
+/* every key lands in the same two buckets of the cuckoo engine. */
+static bkvs_u32 same_hash(const char *key) {
+    (void)key;
+
+    return 1;
+}
+
+/* add a put of the pair "k<i>" to the batch. */
+static void batch_put(bkvs_batch *batch, bkvs_u32 i, bkvs_u32 value) {
+    char key[32];
+
+    snprintf(key, sizeof(key), "k%u", i);
+    TEST_CHECK(bkvs_batch_put(batch, key, &value, sizeof(value)) == BKVS_OK);
+}
+
+/* add a drop of the pair "k<i>" to the batch. */
+static void batch_drop(bkvs_batch *batch, bkvs_u32 i) {
+    char key[32];
+
+    snprintf(key, sizeof(key), "k%u", i);
+    TEST_CHECK(bkvs_batch_drop(batch, key) == BKVS_OK);
+}
+
+/* reopen the log, which must hold the pairs [lo, hi) and end at `size`. */
+static void reopen(bkvs_u32 lo, bkvs_u32 hi, long size) {
+    bkvs_ctx *ctx;
+
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    test_check_pairs(ctx, lo, hi);
+    TEST_CHECK(file_size(conf.wal_path) == size);
+    bkvs_del(ctx);
+}
+
+int main(void) {
+    char wal_path[TEST_PATH_SIZE];
+    char snap_path[TEST_PATH_SIZE];
+    bkvs_batch *batch;
+    bkvs_ctx *ctx;
+    bkvs_u32 num;
+    long good_size;
+    long size;
+    FILE *file;
+
+    test_path(wal_path, "log.wal");
+    test_path(snap_path, "log.bkvs");
+    memset(&conf, 0, sizeof(conf));
+    conf.wal_path = wal_path;
+
+    /* every sync policy logs puts and drops for the next set to replay. */
+    for (bkvs_u32 sync = BKVS_WAL_SYNC_ALWAYS; sync <= BKVS_WAL_SYNC_NONE; sync++) {
+        remove(wal_path);
+        conf.wal_sync = sync;
+        conf.wal_batch_num = 10;
+        TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+        for (bkvs_u32 i = 0; i < PAIR_NUM; i++) {
+            test_put_pair(ctx, i);
+        }
+        for (bkvs_u32 i = 0; i < PAIR_NUM / 2; i++) {
+            test_drop_pair(ctx, i);
+        }
+        TEST_CHECK(bkvs_sync(ctx) == BKVS_OK);
+        bkvs_del(ctx);
+        reopen(PAIR_NUM / 2, PAIR_NUM, file_size(wal_path));
+    }
+    conf.wal_sync = BKVS_WAL_SYNC_ALWAYS;
+
+    /* a snapshot replays only the changes logged after it. */
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    TEST_CHECK(bkvs_save(ctx, snap_path) == BKVS_OK);
+    for (bkvs_u32 i = PAIR_NUM; i < PAIR_NUM + 100; i++) {
+        test_put_pair(ctx, i);
+    }
+    bkvs_del(ctx);
+    TEST_CHECK(bkvs_load(snap_path, &ctx, &conf) == BKVS_OK);
+    test_check_pairs(ctx, PAIR_NUM / 2, PAIR_NUM + 100);
+    bkvs_del(ctx);
+
+    /* a torn last record is dropped and the log goes on after the one before it. */
+    remove(wal_path);
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < 10; i++) {
+        test_put_pair(ctx, i);
+    }
+    good_size = file_size(wal_path);
+    test_put_pair(ctx, 10);
+    bkvs_del(ctx);
+    size = file_size(wal_path);
+    for (long cut = size - 1; cut > good_size; cut -= 5) {
+        TEST_CHECK(truncate(wal_path, cut) == 0);
+        reopen(0, 10, good_size);
+    }
+
+    /* a damaged last record is dropped too. */
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    test_put_pair(ctx, 10);
+    bkvs_del(ctx);
+    TEST_CHECK(file_size(wal_path) == size);
+    file = fopen(wal_path, "r+b");
+    TEST_CHECK(file != NULL && fseek(file, size - 2, SEEK_SET) == 0);
+    fputc(0xa5, file);
+    fclose(file);
+    reopen(0, 10, good_size);
+
+    /* garbage after the last record is cut, and later puts survive the next replay. */
+    file = fopen(wal_path, "ab");
+    TEST_CHECK(file != NULL && fwrite("garbage!", 1, 8, file) == 8);
+    fclose(file);
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    test_check_pairs(ctx, 0, 10);
+    test_put_pair(ctx, 10);
+    test_put_pair(ctx, 11);
+    bkvs_del(ctx);
+    reopen(0, 12, file_size(wal_path));
+
+    /* a batch is logged as one record and replayed whole. */
+    remove(wal_path);
+    TEST_CHECK(bkvs_batch_new(&batch) == BKVS_OK);
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    for (bkvs_u32 i = 0; i < 10; i++) {
+        test_put_pair(ctx, i);
+    }
+    for (bkvs_u32 i = 0; i < 5; i++) {
+        batch_drop(batch, i);
+    }
+    batch_put(batch, 5, 1);
+    for (bkvs_u32 i = 10; i < 20; i++) {
+        batch_put(batch, i, i * 7);
+    }
+    batch_put(batch, 5, 5 * 7);
+    TEST_CHECK(bkvs_batch_commit(ctx, batch) == BKVS_OK);
+    test_check_pairs(ctx, 5, 20);
+    bkvs_del(ctx);
+    reopen(5, 20, file_size(wal_path));
+
+    /* a batch record cut short is dropped with all of its changes. */
+    TEST_CHECK(bkvs_batch_clear(batch) == BKVS_OK);
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    good_size = file_size(wal_path);
+    for (bkvs_u32 i = 5; i < 10; i++) {
+        batch_drop(batch, i);
+    }
+    for (bkvs_u32 i = 20; i < 30; i++) {
+        batch_put(batch, i, i * 7);
+    }
+    TEST_CHECK(bkvs_batch_commit(ctx, batch) == BKVS_OK);
+    test_check_pairs(ctx, 10, 30);
+    bkvs_del(ctx);
+    size = file_size(wal_path);
+    for (long cut = size - 1; cut > good_size; cut -= 7) {
+        TEST_CHECK(truncate(wal_path, cut) == 0);
+        reopen(5, 20, good_size);
+    }
+
+    /* a batch with a failing change undoes the changes before it and is not logged. */
+    remove(wal_path);
+    conf.engine = BKVS_ENGINE_CUCKOO;
+    conf.hash_cb = same_hash;
+    TEST_CHECK(bkvs_batch_clear(batch) == BKVS_OK);
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_OK);
+    num = 0;
+    for (;;) {
+        char key[32];
+        bkvs_u32 value;
+
+        snprintf(key, sizeof(key), "k%u", num);
+        value = num * 7;
+        if (bkvs_put(ctx, key, &value, sizeof(value)) == BKVS_ERR_NO_ROOM) {
+            break;
+        }
+        num++;
+    }
+    TEST_CHECK(num > 1);
+    size = file_size(wal_path);
+    batch_put(batch, 0, 1);
+    batch_drop(batch, 1);
+    batch_put(batch, num, num * 7);
+    batch_put(batch, num + 1, (num + 1) * 7);
+    TEST_CHECK(bkvs_batch_commit(ctx, batch) == BKVS_ERR_NO_ROOM);
+    test_check_pairs(ctx, 0, num);
+    TEST_CHECK(file_size(wal_path) == size);
+    bkvs_del(ctx);
+    reopen(0, num, size);
+    TEST_CHECK(bkvs_batch_del(batch) == BKVS_OK);
+    conf.engine = BKVS_ENGINE_HASH;
+    conf.hash_cb = NULL;
+
+    /* a log of another format is not replayed. */
+    TEST_CHECK(truncate(wal_path, 0) == 0);
+    file = fopen(wal_path, "wb");
+    TEST_CHECK(file != NULL && fwrite("not a log", 1, 9, file) == 9);
+    fclose(file);
+    TEST_CHECK(bkvs_new(&ctx, &conf) == BKVS_ERR_BAD_FILE);
+
+    remove(wal_path);
+    remove(snap_path);
+
+    return 0;
+}